@@ -0,0 +1,515 @@
+// CommentFree 开环压测工具
+// 按固定速率产生请求（不受响应快慢影响），延迟从计划发送时间算起，修正协调遗漏
+#include "metrics.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace bench {
+
+enum class RequestKind {
+    view,
+    like,
+    submit,
+    count
+};
+
+const char* const kind_names[] = {"view", "like", "submit"};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    int connections = 16;
+    double rate = 1000.0;                   // 每秒请求数（所有连接合计）
+    int duration = 30;                      // 秒
+    bool keep_alive = true;
+    std::array<int, 3> mix = {80, 15, 5};   // view/like/submit权重
+    int images = 1;                         // submit附带的图片数
+    size_t image_size = 64 * 1024;
+    std::vector<std::string> ids;
+};
+
+struct Stats {
+    metrics::Histogram latency;             // 从计划发送时间算起（已修正）
+    metrics::Histogram service_time;        // 从实际发送时间算起（未修正）
+    std::array<uint64_t, 3> completed{};
+    uint64_t errors = 0;
+    uint64_t non_2xx = 0;
+    uint64_t unsent = 0;
+};
+
+class LoadGenerator;
+
+// 单个连接：串行发送请求，空闲时向生成器领取下一个到期的请求
+class Connection : public std::enable_shared_from_this<Connection> {
+private:
+    LoadGenerator& gen;
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    http::request<http::string_body> req;
+    http::response<http::string_body> res;
+    Clock::time_point intended;
+    Clock::time_point sent;
+    RequestKind kind = RequestKind::view;
+    bool connected = false;
+    
+public:
+    Connection(net::io_context& ioc, LoadGenerator& gen) : gen(gen), stream(ioc) {}
+    
+    void start(Clock::time_point intended_time);
+    
+private:
+    void send();
+    void on_response(beast::error_code ec);
+    void fail();
+};
+
+class LoadGenerator {
+private:
+    net::io_context& ioc;
+    Options opts;
+    tcp::resolver::results_type endpoints;
+    net::steady_timer timer;
+    std::mt19937_64 rng{42};
+    std::string submit_body;
+    std::string boundary = "----CommentFreeBenchBoundary";
+    
+    std::vector<std::shared_ptr<Connection>> idle;
+    std::deque<Clock::time_point> backlog;  // 已到计划时间、等待空闲连接的请求
+    Clock::time_point start_time;
+    Clock::time_point end_time;
+    Clock::time_point next_intended;
+    Clock::duration interval;
+    size_t outstanding = 0;
+    
+public:
+    Stats stats;
+    
+    LoadGenerator(net::io_context& ioc, Options options)
+        : ioc(ioc), opts(std::move(options)), timer(ioc) {
+        interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / opts.rate));
+        build_submit_body();
+    }
+    
+    const tcp::resolver::results_type& target() const { return endpoints; }
+    const Options& options() const { return opts; }
+    
+    bool resolve() {
+        beast::error_code ec;
+        tcp::resolver resolver(ioc);
+        endpoints = resolver.resolve(opts.host, opts.port, ec);
+        if (ec) {
+            std::cerr << "解析地址失败: " << ec.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    // 没有指定评论ID时从 /api/posts 取一页
+    bool load_ids() {
+        if (!opts.ids.empty() || (opts.mix[0] == 0 && opts.mix[1] == 0)) {
+            return true;
+        }
+        
+        try {
+            beast::tcp_stream stream(ioc);
+            stream.connect(endpoints);
+            http::request<http::empty_body> req{http::verb::get, "/api/posts?limit=100", 11};
+            req.set(http::field::host, opts.host);
+            http::write(stream, req);
+            
+            beast::flat_buffer buffer;
+            http::response<http::string_body> res;
+            http::read(stream, buffer, res);
+            
+            const std::string key = "\"id\":\"";
+            const std::string& body = res.body();
+            for (size_t pos = body.find(key); pos != std::string::npos; pos = body.find(key, pos)) {
+                pos += key.size();
+                size_t end = body.find('"', pos);
+                if (end == std::string::npos) {
+                    break;
+                }
+                opts.ids.push_back(body.substr(pos, end - pos));
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "获取评论ID失败: " << e.what() << std::endl;
+        }
+        
+        if (opts.ids.empty()) {
+            std::cerr << "没有可用的评论ID，请用 --ids 指定，或只压测submit (--mix 0,0,1)" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    void run() {
+        for (int i = 0; i < opts.connections; ++i) {
+            idle.push_back(std::make_shared<Connection>(ioc, *this));
+        }
+        
+        start_time = Clock::now();
+        end_time = start_time + std::chrono::seconds(opts.duration);
+        next_intended = start_time;
+        schedule();
+        ioc.run();
+    }
+    
+    RequestKind pick_kind() {
+        int total = opts.mix[0] + opts.mix[1] + opts.mix[2];
+        int r = static_cast<int>(rng() % static_cast<uint64_t>(total));
+        for (size_t i = 0; i < opts.mix.size(); ++i) {
+            if (r < opts.mix[i]) {
+                return static_cast<RequestKind>(i);
+            }
+            r -= opts.mix[i];
+        }
+        return RequestKind::view;
+    }
+    
+    void build_request(RequestKind kind, http::request<http::string_body>& req) {
+        req = {};
+        req.version(11);
+        req.set(http::field::host, opts.host);
+        req.set(http::field::user_agent, "commentfree_bench/1.0");
+        req.keep_alive(opts.keep_alive);
+        
+        switch (kind) {
+        case RequestKind::view:
+            req.method(http::verb::get);
+            req.target("/api/view/" + opts.ids[rng() % opts.ids.size()]);
+            break;
+        case RequestKind::like:
+            req.method(http::verb::post);
+            req.target("/api/like/" + opts.ids[rng() % opts.ids.size()]);
+            break;
+        default:
+            req.method(http::verb::post);
+            req.target("/api/submit");
+            req.set(http::field::content_type, "multipart/form-data; boundary=" + boundary);
+            req.body() = submit_body;
+            break;
+        }
+        req.prepare_payload();
+    }
+    
+    void record(RequestKind kind, Clock::time_point intended, Clock::time_point sent, unsigned status) {
+        auto now = Clock::now();
+        stats.latency.record(to_nanos(now - intended));
+        stats.service_time.record(to_nanos(now - sent));
+        stats.completed[static_cast<size_t>(kind)]++;
+        if (status < 200 || status >= 300) {
+            stats.non_2xx++;
+        }
+    }
+    
+    void on_idle(std::shared_ptr<Connection> conn) {
+        outstanding--;
+        idle.push_back(std::move(conn));
+        dispatch();
+    }
+    
+    static uint64_t to_nanos(Clock::duration d) {
+        return static_cast<uint64_t>(std::max<int64_t>(
+            0, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()));
+    }
+    
+private:
+    void schedule() {
+        auto now = Clock::now();
+        
+        // 把到期的计划请求放入积压队列，发送速率不受响应延迟影响
+        while (next_intended <= now && next_intended < end_time) {
+            backlog.push_back(next_intended);
+            next_intended += interval;
+        }
+        dispatch();
+        
+        if (next_intended < end_time) {
+            // 高速率时按1ms批量生成，避免每个请求一个定时器
+            timer.expires_at(std::max(next_intended, now + std::chrono::milliseconds(1)));
+            timer.async_wait([this](beast::error_code ec) {
+                if (!ec) {
+                    schedule();
+                }
+            });
+        } else {
+            finish_when_drained();
+        }
+    }
+    
+    void dispatch() {
+        while (!idle.empty() && !backlog.empty() && Clock::now() < end_time + std::chrono::seconds(5)) {
+            auto conn = std::move(idle.back());
+            idle.pop_back();
+            Clock::time_point intended = backlog.front();
+            backlog.pop_front();
+            outstanding++;
+            conn->start(intended);
+        }
+    }
+    
+    void finish_when_drained() {
+        // 计划结束后最多再等5秒让在途请求完成
+        if ((backlog.empty() && outstanding == 0) || Clock::now() >= end_time + std::chrono::seconds(5)) {
+            // 没来得及发送的请求按至少等到现在计入延迟，否则饱和时尾延迟会被低估
+            auto now = Clock::now();
+            stats.unsent = backlog.size();
+            for (auto intended : backlog) {
+                stats.latency.record(to_nanos(now - intended));
+            }
+            backlog.clear();
+            ioc.stop();
+            return;
+        }
+        
+        timer.expires_after(std::chrono::milliseconds(10));
+        timer.async_wait([this](beast::error_code ec) {
+            if (!ec) {
+                finish_when_drained();
+            }
+        });
+    }
+    
+    // 中英文混排的正文和带JPEG文件头的随机图片
+    void build_submit_body() {
+        std::string content = "压测内容：这是一条由commentfree_bench生成的评论，用于测量提交接口的吞吐和延迟。"
+                              "Benchmark payload with mixed CJK and ASCII text to exercise the parser.";
+        
+        std::string body;
+        body += "--" + boundary + "\r\n";
+        body += "Content-Disposition: form-data; name=\"content\"\r\n\r\n";
+        body += content + "\r\n";
+        
+        for (int i = 0; i < opts.images; ++i) {
+            std::string image = "\xFF\xD8\xFF\xE0";
+            image.reserve(opts.image_size);
+            while (image.size() + 2 < opts.image_size) {
+                image.push_back(static_cast<char>(rng() & 0xFF));
+            }
+            image += "\xFF\xD9";
+            
+            body += "--" + boundary + "\r\n";
+            body += "Content-Disposition: form-data; name=\"images\"; filename=\"bench" + std::to_string(i) + ".jpg\"\r\n";
+            body += "Content-Type: image/jpeg\r\n\r\n";
+            body += image + "\r\n";
+        }
+        body += "--" + boundary + "--\r\n";
+        submit_body = std::move(body);
+    }
+};
+
+void Connection::start(Clock::time_point intended_time) {
+    intended = intended_time;
+    kind = gen.pick_kind();
+    gen.build_request(kind, req);
+    
+    if (connected) {
+        return send();
+    }
+    
+    stream.expires_after(std::chrono::seconds(10));
+    stream.async_connect(gen.target(),
+        [self = shared_from_this()](beast::error_code ec, const tcp::endpoint&) {
+            if (ec) {
+                return self->fail();
+            }
+            self->connected = true;
+            self->send();
+        });
+}
+
+void Connection::send() {
+    sent = Clock::now();
+    stream.expires_after(std::chrono::seconds(30));
+    http::async_write(stream, req,
+        [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec) {
+                return self->fail();
+            }
+            self->res = {};
+            http::async_read(self->stream, self->buffer, self->res,
+                [self](beast::error_code ec, std::size_t) {
+                    self->on_response(ec);
+                });
+        });
+}
+
+void Connection::on_response(beast::error_code ec) {
+    if (ec) {
+        return fail();
+    }
+    
+    gen.record(kind, intended, sent, res.result_int());
+    
+    if (!gen.options().keep_alive || !res.keep_alive()) {
+        beast::error_code ignored;
+        stream.socket().shutdown(tcp::socket::shutdown_both, ignored);
+        stream.close();
+        buffer.clear();
+        connected = false;
+    }
+    gen.on_idle(shared_from_this());
+}
+
+void Connection::fail() {
+    gen.stats.errors++;
+    stream.close();
+    buffer.clear();
+    connected = false;
+    gen.on_idle(shared_from_this());
+}
+
+void print_latency(const char* title, const metrics::Histogram& h) {
+    auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    std::printf("%s\n", title);
+    std::printf("  p50    %10.3f ms\n", ms(h.value_at_quantile(0.5)));
+    std::printf("  p90    %10.3f ms\n", ms(h.value_at_quantile(0.9)));
+    std::printf("  p99    %10.3f ms\n", ms(h.value_at_quantile(0.99)));
+    std::printf("  p99.9  %10.3f ms\n", ms(h.value_at_quantile(0.999)));
+    std::printf("  max    %10.3f ms\n", ms(h.max()));
+}
+
+void print_usage(const char* program_name) {
+    std::cout << "用法: " << program_name << " [选项]\n"
+              << "选项:\n"
+              << "  -h, --help              显示此帮助信息\n"
+              << "  --host HOST             服务器地址 (默认: 127.0.0.1)\n"
+              << "  --port PORT             服务器端口 (默认: 8080)\n"
+              << "  -c, --connections N     并发连接数 (默认: 16)\n"
+              << "  -r, --rate R            每秒请求数 (默认: 1000)\n"
+              << "  -t, --duration SEC      压测时长秒数 (默认: 30)\n"
+              << "  --no-keepalive          每个请求新建连接\n"
+              << "  --mix V,L,S             view/like/submit请求比例 (默认: 80,15,5)\n"
+              << "  --images N              每次submit附带的图片数 (默认: 1)\n"
+              << "  --image-size BYTES      合成图片大小 (默认: 65536)\n"
+              << "  --ids ID1,ID2,...       view/like使用的评论ID (默认: 从/api/posts获取)\n"
+              << "\n服务器端请以 --no-rate-limit 启动，否则单一来源IP会被限流\n";
+}
+
+std::vector<std::string> split(const std::string& value, char sep) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(sep, start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        if (end > start) {
+            parts.push_back(value.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return parts;
+}
+
+} // namespace bench
+
+int main(int argc, char* argv[]) {
+    bench::Options opts;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        
+        try {
+            if (arg == "-h" || arg == "--help") {
+                bench::print_usage(argv[0]);
+                return 0;
+            } else if (arg == "--no-keepalive") {
+                opts.keep_alive = false;
+            } else if (!has_value) {
+                std::cerr << "错误: 参数缺少值 " << arg << std::endl;
+                return 1;
+            } else if (arg == "--host") {
+                opts.host = argv[++i];
+            } else if (arg == "--port") {
+                opts.port = argv[++i];
+            } else if (arg == "-c" || arg == "--connections") {
+                opts.connections = std::stoi(argv[++i]);
+            } else if (arg == "-r" || arg == "--rate") {
+                opts.rate = std::stod(argv[++i]);
+            } else if (arg == "-t" || arg == "--duration") {
+                opts.duration = std::stoi(argv[++i]);
+            } else if (arg == "--mix") {
+                auto parts = bench::split(argv[++i], ',');
+                if (parts.size() != 3) {
+                    std::cerr << "错误: --mix 需要三个数字" << std::endl;
+                    return 1;
+                }
+                for (size_t k = 0; k < 3; ++k) {
+                    opts.mix[k] = std::stoi(parts[k]);
+                }
+            } else if (arg == "--images") {
+                opts.images = std::stoi(argv[++i]);
+            } else if (arg == "--image-size") {
+                opts.image_size = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--ids") {
+                opts.ids = bench::split(argv[++i], ',');
+            } else {
+                std::cerr << "错误: 未知参数 " << arg << std::endl;
+                bench::print_usage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "错误: 参数值无效 " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (opts.connections < 1 || opts.rate <= 0 || opts.duration < 1 ||
+        opts.mix[0] < 0 || opts.mix[1] < 0 || opts.mix[2] < 0 || opts.mix[0] + opts.mix[1] + opts.mix[2] == 0) {
+        std::cerr << "错误: 连接数、速率、时长和请求比例必须为正" << std::endl;
+        return 1;
+    }
+    
+    net::io_context ioc{1};
+    bench::LoadGenerator gen(ioc, opts);
+    if (!gen.resolve() || !gen.load_ids()) {
+        return 1;
+    }
+    
+    std::printf("压测 %s:%s  连接数 %d  速率 %.0f req/s  时长 %ds  比例 view/like/submit=%d/%d/%d  keep-alive=%s\n",
+                opts.host.c_str(), opts.port.c_str(), opts.connections, opts.rate, opts.duration,
+                opts.mix[0], opts.mix[1], opts.mix[2], opts.keep_alive ? "on" : "off");
+    
+    auto started = Clock::now();
+    gen.run();
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    
+    const bench::Stats& s = gen.stats;
+    uint64_t completed = s.completed[0] + s.completed[1] + s.completed[2];
+    
+    std::printf("\n完成 %llu 个请求，用时 %.2fs，吞吐 %.1f req/s\n",
+                static_cast<unsigned long long>(completed), elapsed, static_cast<double>(completed) / elapsed);
+    for (size_t k = 0; k < 3; ++k) {
+        std::printf("  %-7s %llu\n", bench::kind_names[k], static_cast<unsigned long long>(s.completed[k]));
+    }
+    std::printf("连接/读写错误 %llu  非2xx响应 %llu  未发送 %llu\n",
+                static_cast<unsigned long long>(s.errors), static_cast<unsigned long long>(s.non_2xx),
+                static_cast<unsigned long long>(s.unsent));
+    
+    bench::print_latency("延迟（从计划发送时间算起，已修正协调遗漏）:", s.latency);
+    bench::print_latency("服务时间（从实际发送时间算起）:", s.service_time);
+    
+    return 0;
+}
@@ -0,0 +1,182 @@
+// 热点辅助函数的微基准，报告吞吐（bytes/s）和每次调用的内存分配次数
+#include "http_server.hpp"
+#include "routes.hpp"
+#include "utils.hpp"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// 统计全局operator new调用次数
+// 替换的new/delete不内联，避免编译器把内部的malloc/free与new/delete配对检查误报
+static std::atomic<uint64_t> g_allocations{0};
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// 在基准循环前后读取分配计数，折算为每次调用的分配次数
+class AllocationCounter {
+private:
+    benchmark::State& state;
+    uint64_t start;
+    
+public:
+    explicit AllocationCounter(benchmark::State& state)
+        : state(state), start(g_allocations.load(std::memory_order_relaxed)) {}
+    ~AllocationCounter() {
+        uint64_t total = g_allocations.load(std::memory_order_relaxed) - start;
+        state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(total),
+                                                          benchmark::Counter::kAvgIterations);
+    }
+};
+
+// 评论正文语料：中文、英文、中英混排，含需要转义的字符
+std::string make_corpus(size_t size, int kind) {
+    static const std::string cjk = "这是一条用于性能测试的评论，包含“引号”和换行\n以及制表符\t。";
+    static const std::string ascii = "A benchmark comment with \"quotes\", back\\slashes and a newline\n. ";
+    static const std::string mixed = "混排 mixed 内容 content：emoji 😀 与 \"转义\" chars\t";
+    const std::string& unit = kind == 0 ? cjk : (kind == 1 ? ascii : mixed);
+    
+    std::string out;
+    while (out.size() < size) {
+        out += unit;
+    }
+    return out;
+}
+
+std::string make_url_encoded(size_t size) {
+    return utils::StringUtils::url_encode(make_corpus(size, 2));
+}
+
+// 解析只切分表单，不写盘；文件部分会被复制进UploadPart
+std::string make_multipart(const std::string& boundary, size_t content_size, int files, size_t file_size) {
+    std::string body;
+    body += "--" + boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"content\"\r\n\r\n";
+    body += make_corpus(content_size, 2) + "\r\n";
+    for (int i = 0; i < files; ++i) {
+        body += "--" + boundary + "\r\n";
+        body += "Content-Disposition: form-data; name=\"images\"; filename=\"photo" + std::to_string(i) + ".jpg\"\r\n";
+        body += "Content-Type: image/jpeg\r\n\r\n";
+        body += std::string(file_size, static_cast<char>(0xAB)) + "\r\n";
+    }
+    body += "--" + boundary + "--\r\n";
+    return body;
+}
+
+void BM_EscapeJsonString(benchmark::State& state) {
+    std::string input = make_corpus(static_cast<size_t>(state.range(0)), static_cast<int>(state.range(1)));
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(utils::JsonUtils::escape_json_string(input));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_EscapeJsonString)->ArgsProduct({{64, 1024, 16384}, {0, 1, 2}})->ArgNames({"bytes", "cjk/ascii/mixed"});
+
+void BM_UrlDecode(benchmark::State& state) {
+    std::string input = make_url_encoded(static_cast<size_t>(state.range(0)));
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(utils::StringUtils::url_decode(input));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_UrlDecode)->Arg(64)->Arg(1024)->Arg(16384);
+
+void BM_Trim(benchmark::State& state) {
+    std::string input = "  \t" + make_corpus(static_cast<size_t>(state.range(0)), 2) + " \r\n ";
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(utils::StringUtils::trim(input));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_Trim)->Arg(64)->Arg(1024);
+
+void BM_ValidateImageFormat(benchmark::State& state) {
+    static const std::vector<std::string> names = {
+        "photo.jpg", "IMG_20240101_120000.JPEG", "screenshot.png", "animation.gif",
+        "document.pdf", "archive.tar.gz", "图片.webp", "noextension"
+    };
+    AllocationCounter allocs(state);
+    size_t bytes = 0;
+    for (auto _ : state) {
+        for (const auto& name : names) {
+            benchmark::DoNotOptimize(utils::FileHandler::validate_image_format(name));
+            bytes += name.size();
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * names.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_ValidateImageFormat);
+
+void BM_MimeType(benchmark::State& state) {
+    // 覆盖if链的前部、中部、末尾和未命中
+    static const std::vector<std::string> paths = {
+        "../frontend/index.html", "../frontend/style.css", "../frontend/app.js",
+        "uploads/img_1700000000000.jpg", "uploads/img_1700000000001.png",
+        "../frontend/logo.svg", "uploads/file.unknown"
+    };
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+        for (const auto& path : paths) {
+            benchmark::DoNotOptimize(server::mime_type(path));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+}
+BENCHMARK(BM_MimeType);
+
+void BM_ParseMultipartForm(benchmark::State& state) {
+    const std::string boundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+    std::string body = make_multipart(boundary, static_cast<size_t>(state.range(0)),
+                                      static_cast<int>(state.range(1)), static_cast<size_t>(state.range(2)));
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+        std::string content;
+        std::vector<utils::UploadPart> images;
+        benchmark::DoNotOptimize(routes::RouteHandler::parse_multipart_form(body, boundary, content, images));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+BENCHMARK(BM_ParseMultipartForm)
+    ->Args({200, 0, 0})
+    ->Args({2000, 1, 64 * 1024})
+    ->Args({2000, 3, 256 * 1024})
+    ->Args({2000, 9, 1024 * 1024})
+    ->ArgNames({"content", "files", "file_bytes"});
+
+void BM_ExtractPostId(benchmark::State& state) {
+    static const std::vector<std::string> paths = {"/api/view/word42", "/api/like/apple7", "/api/view/"};
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+        for (const auto& path : paths) {
+            benchmark::DoNotOptimize(routes::RouteHandler::extract_post_id_from_path(path));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+}
+BENCHMARK(BM_ExtractPostId);
+
+} // namespace
+
+BENCHMARK_MAIN();
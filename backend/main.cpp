@@ -1,6 +1,25 @@
 #include "server/http_server.hpp"
 #include "server/db.hpp"
+#include "server/async_db.hpp"
 #include "server/utils.hpp"
+#include "server/post_cache.hpp"
+#include "server/trending.hpp"
+#include "server/site_stats.hpp"
+#include "server/live_hub.hpp"
+#include "server/unique_views.hpp"
+#include "server/like_filter.hpp"
+#include "server/rate_limiter.hpp"
+#include "server/load_shedder.hpp"
+#include "server/metrics.hpp"
+#include "server/tracing.hpp"
+#include "server/thumbnailer.hpp"
+#include "server/file_io.hpp"
+#include "server/snapshot.hpp"
+#include "server/submit_log.hpp"
+#include "server/change_feed.hpp"
+#include "server/search_index.hpp"
+#include "server/tls.hpp"
+#include <boost/asio/co_spawn.hpp>
 #include <iostream>
 #include <string>
 #include <memory>
@@ -9,8 +28,122 @@
 // 全局数据库管理器实例（放到server命名空间以供其他翻译单元extern引用）
 namespace server {
     std::shared_ptr<db::DatabaseManager> g_db_manager;
+    std::shared_ptr<cache::PostCache> g_post_cache;
+    std::shared_ptr<trending::TrendingIndex> g_trending;
+    std::shared_ptr<stats::SiteStats> g_site_stats;
+    std::shared_ptr<LiveHub> g_live_hub;
+    std::shared_ptr<hll::UniqueViewTracker> g_unique_views;
+    std::shared_ptr<filter::LikeFilter> g_like_filter;
+    std::shared_ptr<RateLimiter> g_rate_limiter;
+    std::shared_ptr<LoadShedder> g_load_shedder;
 }
 
+namespace db {
+    std::shared_ptr<AsyncDatabase> g_async_db;
+}
+
+namespace media {
+    std::shared_ptr<Thumbnailer> g_thumbnailer;
+}
+
+namespace fileio {
+    std::shared_ptr<FileIo> g_file_io;
+}
+
+namespace wal {
+    std::shared_ptr<SubmitLog> g_submit_log;
+}
+
+namespace search {
+    std::shared_ptr<SearchIndex> g_search_index;
+}
+
+namespace {
+
+// 后台任务的查询与请求处理一样交给数据库线程，不阻塞io线程；没有数据库线程时退回主连接
+template<class F>
+net::awaitable<std::invoke_result_t<F&, db::DatabaseManager&>> background_query(F f) {
+    if (db::g_async_db) {
+        co_return co_await db::g_async_db->run(std::move(f));
+    }
+    co_return f(*server::g_db_manager);
+}
+
+void spawn_background(net::any_io_executor executor, net::awaitable<void> task) {
+    net::co_spawn(executor, std::move(task), [](std::exception_ptr e) {
+        if (e) {
+            try {
+                std::rethrow_exception(e);
+            } catch (const std::exception& ex) {
+                std::cerr << "后台任务异常: " << ex.what() << std::endl;
+            }
+        }
+    });
+}
+
+// 用数据库校准站点统计
+net::awaitable<void> reconcile_stats() {
+    db::SiteTotals totals;
+    if (co_await background_query([&](db::DatabaseManager& db) { return db.get_site_totals(totals); })) {
+        server::g_site_stats->reconcile(totals);
+    }
+}
+
+// 持久化变化的访客草图，失败时重新标记留到下一轮
+net::awaitable<void> persist_sketches() {
+    auto dirty = server::g_unique_views->take_dirty();
+    if (dirty.empty()) {
+        co_return;
+    }
+    if (!co_await background_query([&](db::DatabaseManager& db) { return db.save_viewer_sketches(dirty); })) {
+        server::g_unique_views->mark_dirty(dirty);
+    }
+}
+
+// 缩略图生成完成：写库并使引用该图片的评论缓存失效
+net::awaitable<void> apply_image_variants(media::VariantResult result) {
+    std::vector<std::string> post_ids;
+    bool saved = co_await background_query([&](db::DatabaseManager& db) {
+        return db.set_image_variants(result.source_path, result.thumbnail_path, result.medium_path, post_ids);
+    });
+    if (saved && server::g_post_cache) {
+        for (const auto& id : post_ids) {
+            server::g_post_cache->erase(id);
+        }
+    }
+}
+
+// 其他实例发表的评论：通知里没有内容，取一次评论补进搜索索引
+net::awaitable<void> index_remote_post(std::string post_id) {
+    auto post = co_await background_query([&](db::DatabaseManager& db) { return db.get_post(post_id); });
+    if (post) {
+        search::g_search_index->add(post->id, post->content);
+    }
+}
+
+// 清理没有评论引用的上传文件，尚未入库的评论引用的图片同样保留；目录扫描和查询都在数据库线程上
+net::awaitable<void> sweep_uploads() {
+    size_t removed = co_await background_query([](db::DatabaseManager& db) {
+        auto pending = wal::g_submit_log ? wal::g_submit_log->pending_images() : std::unordered_set<std::string>();
+        return utils::FileHandler::sweep_orphan_uploads("uploads", std::chrono::hours(24),
+            [&](const std::vector<std::string>& paths, std::unordered_set<std::string>& referenced) {
+                if (!db.find_referenced_images(paths, referenced)) {
+                    return false;
+                }
+                for (const auto& path : paths) {
+                    if (pending.count(path)) {
+                        referenced.insert(path);
+                    }
+                }
+                return true;
+            });
+    });
+    if (removed > 0) {
+        std::cout << "已清理无人引用的上传文件: " << removed << std::endl;
+    }
+}
+
+} // namespace
 
 
 
@@ -22,9 +155,27 @@ void print_usage(const char* program_name) {
               << "  -a, --address ADDRESS   设置监听地址 (默认: 0.0.0.0)\n"
               << "  -d, --db-conn CONN      设置数据库连接字符串\n"
               << "                          (默认: host=localhost dbname=commentfree user=postgres)\n"
+              << "  --header-timeout SEC    新连接读取请求头的超时秒数 (默认: 10)\n"
+              << "  --body-timeout SEC      读取请求体/写入响应的超时秒数 (默认: 30)\n"
+              << "  --idle-timeout SEC      keep-alive空闲连接的超时秒数 (默认: 60)\n"
+              << "  --max-connections N     最大连接数，超出时回收最久未活动的空闲连接 (默认: 10000)\n"
+              << "  --no-rate-limit         关闭按IP限流（压测时使用）\n"
+              << "  --server-timing         在响应中输出Server-Timing分段耗时\n"
+              << "  --trace-file PATH       把采样请求的分段耗时按JSON行写入文件\n"
+              << "  --trace-sample RATE     追踪采样率 (默认: 0.01)\n"
+              << "  --snapshot-interval SEC 热启动快照的保存间隔秒数，0为关闭 (默认: 60)\n"
+              << "  --submit-log            评论先写入data/submit_log本地日志即确认，后台入库\n"
+              << "  --change-feed           多实例部署：经PostgreSQL LISTEN/NOTIFY同步各实例的缓存和计数\n"
+              << "  --db-threads N          处理请求的数据库线程数（各自独立连接），0为在网络线程上查询 (默认: 2)\n"
+              << "  --query-timeout MS      数据库线程上单条语句的超时毫秒数 (默认: 5000)\n"
+              << "  --tls-port PORT         另开HTTPS端口（需同时指定证书和私钥）\n"
+              << "  --tls-cert FILE         PEM证书链文件\n"
+              << "  --tls-key FILE          PEM私钥文件\n"
+              << "  --tls-ticket-key FILE   80字节会话票据密钥，多实例共享以便跨实例复用会话\n"
               << "\n示例:\n"
               << "  " << program_name << " -p 9000 -a 127.0.0.1\n"
-              << "  " << program_name << " -d \"host=localhost dbname=mydb user=myuser password=mypass\"\n";
+              << "  " << program_name << " -d \"host=localhost dbname=mydb user=myuser password=mypass\"\n"
+              << "  " << program_name << " --tls-port 8443 --tls-cert cert.pem --tls-key key.pem\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -33,17 +184,42 @@ int main(int argc, char* argv[]) {
     unsigned short port = 8080;
     std::string db_connection = "host=47.108.220.87 dbname=commentfree user=commentfree_user";
     std::string doc_root = "../frontend";
+    server::SessionLimits session_limits;
+    bool rate_limit = true;
+    bool server_timing = false;
+    std::string trace_file;
+    double trace_sample = 0.01;
+    int snapshot_interval = 60;
+    bool submit_log = false;
+    bool change_feed = false;
+    int db_threads = 2;
+    int query_timeout_ms = 5000;
+    unsigned short tls_port = 0;
+    tls::Options tls_options;
     
     // 解析命令行参数
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         
+        // 读取下一个整数参数，格式错误或超出范围时提示并返回空
+        auto int_arg = [&](int64_t min, int64_t max) {
+            auto value = utils::StringUtils::parse_int(argv[++i], min, max);
+            if (!value) {
+                std::cerr << "错误: " << arg << " 须为" << min << "到" << max << "之间的整数" << std::endl;
+            }
+            return value;
+        };
+        
         if (arg == "-h" || arg == "--help") {
             print_usage(argv[0]);
             return 0;
         } else if (arg == "--port") {
             if (i + 1 < argc) {
-                port = static_cast<unsigned short>(std::stoi(argv[++i]));
+                auto value = int_arg(1, 65535);
+                if (!value) {
+                    return 1;
+                }
+                port = static_cast<unsigned short>(*value);
             } else {
                 std::cerr << "错误: 端口参数缺少值" << std::endl;
                 return 1;
@@ -69,6 +245,122 @@ int main(int argc, char* argv[]) {
                 std::cerr << "错误: 数据库连接参数缺少值" << std::endl;
                 return 1;
             }
+        } else if (arg == "--header-timeout" || arg == "--body-timeout" || arg == "--idle-timeout") {
+            if (i + 1 < argc) {
+                auto value = int_arg(1, 3600);
+                if (!value) {
+                    return 1;
+                }
+                std::chrono::seconds timeout(*value);
+                if (arg == "--header-timeout") {
+                    session_limits.read_header_timeout = timeout;
+                } else if (arg == "--body-timeout") {
+                    session_limits.read_body_timeout = timeout;
+                } else {
+                    session_limits.idle_timeout = timeout;
+                }
+            } else {
+                std::cerr << "错误: 超时参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--max-connections") {
+            if (i + 1 < argc) {
+                auto value = int_arg(1, 1000000);
+                if (!value) {
+                    return 1;
+                }
+                session_limits.max_connections = static_cast<size_t>(*value);
+            } else {
+                std::cerr << "错误: 最大连接数参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-rate-limit") {
+            rate_limit = false;
+        } else if (arg == "--server-timing") {
+            server_timing = true;
+        } else if (arg == "--trace-file") {
+            if (i + 1 < argc) {
+                trace_file = argv[++i];
+            } else {
+                std::cerr << "错误: 追踪文件参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace-sample") {
+            if (i + 1 < argc) {
+                trace_sample = std::stod(argv[++i]);
+            } else {
+                std::cerr << "错误: 采样率参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--snapshot-interval") {
+            if (i + 1 < argc) {
+                auto value = int_arg(0, 86400);
+                if (!value) {
+                    return 1;
+                }
+                snapshot_interval = static_cast<int>(*value);
+            } else {
+                std::cerr << "错误: 快照间隔参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--submit-log") {
+            submit_log = true;
+        } else if (arg == "--change-feed") {
+            change_feed = true;
+        } else if (arg == "--db-threads") {
+            if (i + 1 < argc) {
+                auto value = int_arg(0, 64);
+                if (!value) {
+                    return 1;
+                }
+                db_threads = static_cast<int>(*value);
+            } else {
+                std::cerr << "错误: 数据库线程数参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--query-timeout") {
+            if (i + 1 < argc) {
+                auto value = int_arg(0, 3600000);
+                if (!value) {
+                    return 1;
+                }
+                query_timeout_ms = static_cast<int>(*value);
+            } else {
+                std::cerr << "错误: 查询超时参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--tls-port") {
+            if (i + 1 < argc) {
+                auto value = int_arg(1, 65535);
+                if (!value) {
+                    return 1;
+                }
+                tls_port = static_cast<unsigned short>(*value);
+            } else {
+                std::cerr << "错误: HTTPS端口参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--tls-cert") {
+            if (i + 1 < argc) {
+                tls_options.certificate_file = argv[++i];
+            } else {
+                std::cerr << "错误: 证书参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--tls-key") {
+            if (i + 1 < argc) {
+                tls_options.private_key_file = argv[++i];
+            } else {
+                std::cerr << "错误: 私钥参数缺少值" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--tls-ticket-key") {
+            if (i + 1 < argc) {
+                tls_options.ticket_key_file = argv[++i];
+            } else {
+                std::cerr << "错误: 票据密钥参数缺少值" << std::endl;
+                return 1;
+            }
         }
         
         else {
@@ -96,9 +388,9 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
-    // 初始化数据库连接
-    server::g_db_manager = std::make_shared<db::DatabaseManager>(db_connection);
-    if (!server::g_db_manager->connect()) {
+        // 初始化数据库连接
+        server::g_db_manager = std::make_shared<db::DatabaseManager>(db_connection);
+        if (!server::g_db_manager->connect()) {
             std::cerr << "错误: 数据库连接失败" << std::endl;
             std::cerr << "请确保PostgreSQL服务正在运行，并且数据库存在" << std::endl;
             std::cerr << "可以使用以下命令创建数据库:" << std::endl;
@@ -108,8 +400,304 @@ int main(int argc, char* argv[]) {
         
         std::cout << "数据库连接成功！" << std::endl;
         
+        // 多实例时本实例的写操作发布变更通知，带上实例ID以便忽略自己的通知
+        const std::string instance_id = feed::make_instance_id();
+        if (change_feed) {
+            server::g_db_manager->enable_change_events(instance_id);
+            std::cout << "变更通知已开启，实例ID: " << instance_id << std::endl;
+        }
+        
+        // 请求处理的查询交给数据库线程，协程等待结果期间网络线程继续处理其他连接
+        // 连接失败时退回在网络线程上用主连接查询
+        if (db_threads > 0) {
+            db::g_async_db = std::make_shared<db::AsyncDatabase>(db_connection, static_cast<size_t>(db_threads),
+                                                                 query_timeout_ms);
+            if (change_feed) {
+                db::g_async_db->enable_change_events(instance_id);
+            }
+            if (db::g_async_db->open()) {
+                std::cout << "数据库线程: " << db_threads << " (语句超时 " << query_timeout_ms << "ms)" << std::endl;
+            } else {
+                std::cerr << "数据库线程连接失败，请求处理将在网络线程上查询" << std::endl;
+                db::g_async_db.reset();
+            }
+        }
+        
+        // 热启动快照：上次退出（或最近一次定期保存）时的缓存、草图和过滤器，
+        // 各模块能从快照恢复就不再冷启动重建；快照缺失、损坏或参数不符时退回原流程
+        const std::string snapshot_path = "data/warm_state.snap";
+        std::unique_ptr<snapshot::MappedSnapshot> warm_state;
+        if (snapshot_interval > 0) {
+            warm_state = snapshot::MappedSnapshot::open(snapshot_path);
+        }
+        auto restore = [&warm_state](snapshot::Section section, const auto& load) {
+            if (!warm_state) {
+                return false;
+            }
+            auto reader = warm_state->section(section);
+            return reader && load(*reader);
+        };
+        
+        // 初始化评论缓存
+        server::g_post_cache = std::make_shared<cache::PostCache>(1024);
+        if (restore(snapshot::Section::post_cache, [](snapshot::Reader& in) { return server::g_post_cache->load(in); })) {
+            std::cout << "评论缓存已从快照恢复: " << server::g_post_cache->size() << " 条" << std::endl;
+        }
+        
+        // 热门索引：优先从快照恢复，否则从数据库重建
+        server::g_trending = std::make_shared<trending::TrendingIndex>();
+        std::vector<std::pair<std::string, db::PostCounters>> top_posts;
+        if (restore(snapshot::Section::trending, [](snapshot::Reader& in) { return server::g_trending->load(in); })) {
+            std::cout << "热门索引已从快照恢复" << std::endl;
+        } else if (server::g_db_manager->get_top_posts(static_cast<int>(server::g_trending->max_entries()) * 2, top_posts)) {
+            for (const auto& [id, counters] : top_posts) {
+                server::g_trending->seed(id, counters.view_count, counters.like_count);
+            }
+            std::cout << "热门索引已重建: " << top_posts.size() << " 条候选" << std::endl;
+        }
+        
+        // 全文搜索索引：按发布时间正序扫描全部评论内容建立
+        search::g_search_index = std::make_shared<search::SearchIndex>();
+        if (server::g_db_manager->scan_post_contents([](const std::string& id, const std::string& content) {
+                search::g_search_index->add(id, content);
+            })) {
+            std::cout << "搜索索引已建立: " << search::g_search_index->document_count() << " 条评论, "
+                      << search::g_search_index->memory_bytes() / 1024 << " KB" << std::endl;
+        }
+        
+        // 初始化站点统计（启动时还未开始服务，直接查询）
+        server::g_site_stats = std::make_shared<stats::SiteStats>();
+        db::SiteTotals initial_totals;
+        if (server::g_db_manager->get_site_totals(initial_totals)) {
+            server::g_site_stats->reconcile(initial_totals);
+        }
+        
+        // 请求分段追踪
+        tracing::configure(server_timing, trace_file, trace_sample);
+        
         // 创建并启动HTTP服务器
-        server::HttpServer http_server(address, port, doc_root);
+        server::HttpServer http_server(address, port, doc_root, session_limits);
+        
+        // HTTPS直接在本进程终止，省去前置代理的一跳；内核支持时握手后由kTLS加解密
+        std::shared_ptr<tls::Context> tls_context;
+        if (tls_port != 0) {
+            if (tls_options.certificate_file.empty() || tls_options.private_key_file.empty()) {
+                std::cerr << "错误: --tls-port 需要同时指定 --tls-cert 和 --tls-key" << std::endl;
+                return 1;
+            }
+            tls_context = tls::Context::create(tls_options);
+            if (!tls_context || !http_server.listen_tls(address, tls_port, tls_context)) {
+                std::cerr << "错误: HTTPS端口启动失败" << std::endl;
+                return 1;
+            }
+            std::cout << "内核TLS(kTLS): " << (tls::Context::kernel_supports_ktls() ? "可用" : "不可用，使用用户态加密")
+                      << std::endl;
+        }
+        
+        // 每5分钟用数据库校准一次站点统计
+        http_server.add_periodic_task(std::chrono::minutes(5), [&http_server] {
+            spawn_background(http_server.executor(), reconcile_stats());
+        });
+        
+        // 每小时清理一次无人引用的上传文件（只处理24小时内没有写入或复用过的）
+        http_server.add_periodic_task(std::chrono::hours(1), [&http_server] {
+            spawn_background(http_server.executor(), sweep_uploads());
+        });
+        
+        // 独立访客草图：按需从数据库载入，每分钟持久化一次变化；内存中最多保留20000个（稠密草图每个4KB）
+        server::g_unique_views = std::make_shared<hll::UniqueViewTracker>(20000);
+        restore(snapshot::Section::viewer_sketches, [](snapshot::Reader& in) {
+            return server::g_unique_views->load_snapshot(in);
+        });
+        http_server.add_periodic_task(std::chrono::minutes(1), [&http_server] {
+            spawn_background(http_server.executor(), persist_sketches());
+        });
+        
+        // 点赞去重：24小时窗口
+        server::g_like_filter = std::make_shared<filter::LikeFilter>();
+        if (restore(snapshot::Section::like_filter, [](snapshot::Reader& in) { return server::g_like_filter->load(in); })) {
+            std::cout << "点赞去重过滤器已从快照恢复" << std::endl;
+        }
+        warm_state.reset();
+        
+        // 按客户端IP限流，每分钟清理10分钟未活动的客户端
+        if (rate_limit) {
+            server::g_rate_limiter = std::make_shared<server::RateLimiter>();
+            http_server.add_periodic_task(std::chrono::minutes(1), [] {
+                server::g_rate_limiter->evict_idle(std::chrono::minutes(10));
+            });
+        }
+        
+        // 过载保护：按排队时延自适应调整在途请求上限
+        server::g_load_shedder = std::make_shared<server::LoadShedder>();
+        
+        // 上传写盘和静态文件读取不占用网络线程
+        fileio::g_file_io = std::make_shared<fileio::FileIo>(http_server.executor());
+        std::cout << "文件I/O后端: " << fileio::g_file_io->backend_name() << std::endl;
+        
+        // 本地提交日志：独立的数据库连接在后台入库，入库后再生成缩略图
+        if (submit_log) {
+            wal::g_submit_log = std::make_shared<wal::SubmitLog>("data/submit_log", db_connection, http_server.executor(),
+                [](const std::vector<db::PostWrite>& drained) {
+                    // 启动时回放的记录不在数据库扫描结果里，入库后补进搜索索引（已有的会被忽略）
+                    for (const auto& write : drained) {
+                        search::g_search_index->add(write.post.id, write.post.content);
+                    }
+                    if (!media::g_thumbnailer) {
+                        return;
+                    }
+                    for (const auto& write : drained) {
+                        for (const auto& image : write.images) {
+                            media::g_thumbnailer->enqueue(image.path, image.mime_type);
+                        }
+                    }
+                });
+            if (change_feed) {
+                wal::g_submit_log->enable_change_events(instance_id);
+            }
+            if (!wal::g_submit_log->open()) {
+                std::cerr << "提交日志不可用，评论直接写数据库" << std::endl;
+                wal::g_submit_log.reset();
+            }
+        }
+        
+        // 后台生成缩略图/中图，完成后回到io线程写库并使缓存失效
+        if (media::Thumbnailer::available()) {
+            media::g_thumbnailer = std::make_shared<media::Thumbnailer>(2, 256,
+                [&http_server](const media::VariantResult& result) {
+                    http_server.post([&http_server, result] {
+                        spawn_background(http_server.executor(), apply_image_variants(result));
+                    });
+                });
+        } else {
+            std::cout << "未编译图片解码库，不生成缩略图" << std::endl;
+        }
+        
+        // 在io线程上编码快照（各模块持锁时间只有一次拷贝），写盘交给文件I/O
+        auto capture_warm_state = [] {
+            snapshot::Builder builder;
+            server::g_post_cache->save(builder.begin(snapshot::Section::post_cache));
+            server::g_unique_views->save(builder.begin(snapshot::Section::viewer_sketches));
+            server::g_like_filter->save(builder.begin(snapshot::Section::like_filter));
+            server::g_trending->save(builder.begin(snapshot::Section::trending));
+            return builder.finish();
+        };
+        if (snapshot_interval > 0) {
+            auto writing = std::make_shared<bool>(false);
+            http_server.add_periodic_task(std::chrono::seconds(snapshot_interval),
+                [capture_warm_state, snapshot_path, writing] {
+                    if (*writing) {
+                        return;     // 上一次还没写完
+                    }
+                    auto bytes = std::make_shared<const std::string>(capture_warm_state());
+                    *writing = true;
+                    fileio::g_file_io->async_replace_file(snapshot_path, bytes, [writing](std::error_code ec) {
+                        *writing = false;
+                        if (ec) {
+                            std::cerr << "保存热启动快照失败: " << ec.message() << std::endl;
+                        }
+                    });
+                });
+        }
+        
+        // 实时计数推送：每250ms合并广播一次
+        server::g_live_hub = std::make_shared<server::LiveHub>();
+        http_server.add_periodic_task(std::chrono::milliseconds(250), [] {
+            server::g_live_hub->flush();
+        });
+        
+        // 其他实例的变更：在io线程上应用到本地缓存、热门索引、站点统计和实时推送
+        std::unique_ptr<feed::ChangeListener> change_listener;
+        if (change_feed) {
+            change_listener = std::make_unique<feed::ChangeListener>(db_connection, instance_id, http_server.executor(),
+                [&http_server](const feed::ChangeEvent& event) {
+                    using Kind = feed::ChangeEvent::Kind;
+                    switch (event.kind) {
+                        case Kind::post_created:
+                            server::g_site_stats->record_post(static_cast<size_t>(event.amount),
+                                                              static_cast<size_t>(event.images));
+                            spawn_background(http_server.executor(), index_remote_post(event.post_id));
+                            break;
+                        case Kind::post_changed:
+                            server::g_post_cache->erase(event.post_id);
+                            break;
+                        case Kind::viewed:
+                        case Kind::liked:
+                            if (event.kind == Kind::viewed) {
+                                server::g_trending->record_view(event.post_id);
+                                server::g_site_stats->record_views(event.amount);
+                            } else {
+                                server::g_trending->record_like(event.post_id);
+                                server::g_site_stats->record_like();
+                            }
+                            server::g_live_hub->publish(event.post_id,
+                                                        db::PostCounters{event.view_count, event.like_count});
+                            break;
+                        case Kind::resync:
+                            // 断线期间可能漏掉了变更：清空评论缓存，站点统计以数据库为准
+                            server::g_post_cache->clear();
+                            spawn_background(http_server.executor(), reconcile_stats());
+                            break;
+                    }
+                });
+            change_listener->start();
+        }
+        
+        // /metrics抓取时求值的指标
+        metrics::add_gauge("commentfree_db_connected", "Whether the database connection is open.", [] {
+            return server::g_db_manager && server::g_db_manager->is_connected() ? 1.0 : 0.0;
+        });
+        metrics::add_gauge("commentfree_db_threads", "Database threads serving request queries.", [] {
+            return db::g_async_db ? static_cast<double>(db::g_async_db->size()) : 0.0;
+        });
+        metrics::add_gauge("commentfree_http_connections", "Open HTTP connections.", [&http_server] {
+            return static_cast<double>(http_server.connection_count());
+        });
+        metrics::add_gauge("commentfree_post_cache_entries", "Posts held in the LRU cache.", [] {
+            return server::g_post_cache ? static_cast<double>(server::g_post_cache->size()) : 0.0;
+        });
+        metrics::add_gauge("commentfree_live_subscribers", "WebSocket live counter subscribers.", [] {
+            return server::g_live_hub ? static_cast<double>(server::g_live_hub->subscriber_count()) : 0.0;
+        });
+        metrics::add_gauge("commentfree_rate_limiter_clients", "Client IPs tracked by the rate limiter.", [] {
+            return server::g_rate_limiter ? static_cast<double>(server::g_rate_limiter->client_count()) : 0.0;
+        });
+        metrics::add_gauge("commentfree_requests_in_flight", "Admitted requests not yet answered.", [] {
+            return server::g_load_shedder ? static_cast<double>(server::g_load_shedder->snapshot().in_flight) : 0.0;
+        });
+        metrics::add_gauge("commentfree_requests_in_flight_limit", "Current adaptive in-flight limit.", [] {
+            return server::g_load_shedder ? static_cast<double>(server::g_load_shedder->snapshot().limit) : 0.0;
+        });
+        metrics::add_gauge("commentfree_queue_delay_seconds", "Minimum event loop queue delay in the last window.", [] {
+            return server::g_load_shedder ? server::g_load_shedder->snapshot().queue_delay_ms / 1000.0 : 0.0;
+        });
+        metrics::add_gauge("commentfree_submit_log_backlog", "Acknowledged posts not yet written to the database.", [] {
+            return wal::g_submit_log ? static_cast<double>(wal::g_submit_log->backlog()) : 0.0;
+        });
+        metrics::add_gauge("commentfree_search_documents", "Posts in the full-text search index.", [] {
+            return static_cast<double>(search::g_search_index->document_count());
+        });
+        metrics::add_gauge("commentfree_search_index_bytes", "Approximate memory held by search posting lists.", [] {
+            return static_cast<double>(search::g_search_index->memory_bytes());
+        });
+        metrics::add_gauge("commentfree_rejected_requests", "Requests rejected by load shedding since start.", [] {
+            return server::g_load_shedder ? static_cast<double>(server::g_load_shedder->snapshot().rejected_requests) : 0.0;
+        });
+        if (tls_context) {
+            tls::Stats& tls_stats = tls_context->stats();
+            metrics::add_gauge("commentfree_tls_handshakes", "Completed TLS handshakes since start.", [&tls_stats] {
+                return static_cast<double>(tls_stats.handshakes.load());
+            });
+            metrics::add_gauge("commentfree_tls_resumed", "TLS handshakes that resumed a session.", [&tls_stats] {
+                return static_cast<double>(tls_stats.resumed.load());
+            });
+            metrics::add_gauge("commentfree_tls_failed", "Failed TLS handshakes since start.", [&tls_stats] {
+                return static_cast<double>(tls_stats.failed.load());
+            });
+            metrics::add_gauge("commentfree_tls_ktls_send", "TLS connections with kernel TLS transmit offload.", [&tls_stats] {
+                return static_cast<double>(tls_stats.ktls_send.load());
+            });
+        }
         
         std::cout << "服务器启动成功！" << std::endl;
         std::cout << "访问地址: http://" << address << ":" << port << std::endl;
@@ -135,8 +723,35 @@ int main(int argc, char* argv[]) {
         // 运行服务器
         http_server.run();
         
+        // 工作线程会引用http_server，必须在它析构前停下
+        change_listener.reset();
+        if (db::g_async_db) {
+            db::g_async_db->stop();
+            db::g_async_db.reset();
+        }
+        wal::g_submit_log.reset();
+        media::g_thumbnailer.reset();
+        fileio::g_file_io.reset();
+        
+        // 退出前保存未持久化的访客草图（事件循环和数据库线程已停止，用主连接同步写）
+        auto dirty = server::g_unique_views->take_dirty();
+        server::g_db_manager->save_viewer_sketches(dirty);
+        
+        // 事件循环已停止，同步写出最后一份快照供下次启动使用
+        if (snapshot_interval > 0) {
+            if (snapshot::write_file(snapshot_path, capture_warm_state())) {
+                std::cout << "热启动快照已保存: " << snapshot_path << std::endl;
+            } else {
+                std::cerr << "保存热启动快照失败: " << snapshot_path << std::endl;
+            }
+        }
+        
     } catch (const std::exception& e) {
         std::cerr << "服务器异常: " << e.what() << std::endl;
+        db::g_async_db.reset();
+        wal::g_submit_log.reset();
+        media::g_thumbnailer.reset();
+        fileio::g_file_io.reset();
         return 1;
     }
     
@@ -145,6 +760,15 @@ int main(int argc, char* argv[]) {
         server::g_db_manager->disconnect();
         server::g_db_manager.reset();
     }
+    server::g_post_cache.reset();
+    server::g_trending.reset();
+    server::g_site_stats.reset();
+    server::g_live_hub.reset();
+    server::g_unique_views.reset();
+    server::g_like_filter.reset();
+    server::g_rate_limiter.reset();
+    server::g_load_shedder.reset();
+    search::g_search_index.reset();
     
     std::cout << "服务器已关闭" << std::endl;
     return 0;
@@ -0,0 +1,55 @@
+#include "async_db.hpp"
+
+namespace db {
+
+AsyncDatabase::AsyncDatabase(const std::string& connection_string, size_t threads, int statement_timeout_ms)
+    : statement_timeout_ms(statement_timeout_ms) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>(connection_string));
+    }
+}
+
+AsyncDatabase::~AsyncDatabase() {
+    stop();
+}
+
+bool AsyncDatabase::open() {
+    if (workers.empty()) {
+        return false;
+    }
+    for (auto& worker : workers) {
+        if (!worker->db.connect()) {
+            return false;
+        }
+        worker->db.set_statement_timeout(statement_timeout_ms);
+    }
+    return true;
+}
+
+void AsyncDatabase::enable_change_events(const std::string& instance_id) {
+    for (auto& worker : workers) {
+        worker->db.enable_change_events(instance_id);
+    }
+}
+
+void AsyncDatabase::stop() {
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+bool AsyncDatabase::ensure_connected(Worker& worker) {
+    if (worker.db.is_connected()) {
+        return true;
+    }
+    
+    // 失败时本次查询直接返回失败，下一次查询再试
+    std::cerr << "数据库线程连接已断开，正在重连" << std::endl;
+    if (!worker.db.connect()) {
+        return false;
+    }
+    worker.db.set_statement_timeout(statement_timeout_ms);
+    return true;
+}
+
+} // namespace db
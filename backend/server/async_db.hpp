@@ -0,0 +1,100 @@
+#pragma once
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "coro.hpp"
+#include "db.hpp"
+#include "tracing.hpp"
+
+namespace db {
+
+// 请求处理用的数据库线程：每个线程持有独立连接，按轮转分配查询
+// 协程co_await查询期间io线程继续处理其他连接，查询在数据库线程上执行完后回到协程的执行器
+class AsyncDatabase {
+private:
+    struct Worker {
+        DatabaseManager db;
+        boost::asio::thread_pool thread{1};
+        
+        explicit Worker(const std::string& connection_string) : db(connection_string) {}
+    };
+    
+    std::vector<std::unique_ptr<Worker>> workers;
+    int statement_timeout_ms;
+    size_t next_worker = 0;     // 只在io线程上轮转
+
+public:
+    AsyncDatabase(const std::string& connection_string, size_t threads, int statement_timeout_ms);
+    ~AsyncDatabase();
+    AsyncDatabase(const AsyncDatabase&) = delete;
+    AsyncDatabase& operator=(const AsyncDatabase&) = delete;
+    
+    // 建立所有连接（启动时同步执行），任一失败返回false
+    bool open();
+    
+    // 写事务同时发布变更通知（须在open之前调用）
+    void enable_change_events(const std::string& instance_id);
+    
+    // 等待已提交的查询执行完并停止数据库线程
+    void stop();
+    
+    size_t size() const { return workers.size(); }
+    
+    // 在数据库线程上执行f(DatabaseManager&)并co_await其结果
+    // f抛出异常时返回值初始化的结果（false/nullopt），与DatabaseManager各方法的失败返回一致
+    // f在协程挂起期间执行，可以按引用捕获协程内的局部变量
+    template<class F>
+    boost::asio::awaitable<std::invoke_result_t<F&, DatabaseManager&>> run(F f);
+
+private:
+    // 连接断开后在数据库线程上重连
+    bool ensure_connected(Worker& worker);
+};
+
+template<class F>
+boost::asio::awaitable<std::invoke_result_t<F&, DatabaseManager&>> AsyncDatabase::run(F f) {
+    using Result = std::invoke_result_t<F&, DatabaseManager&>;
+    
+    Worker& worker = *workers[next_worker++ % workers.size()];
+    auto executor = co_await boost::asio::this_coro::executor;
+    
+    // 等待期间io线程会运行其他请求：追踪上下文交给数据库线程，查询的分段仍记在本请求下
+    auto* trace = tracing::RequestTrace::current();
+    if (trace) {
+        trace->suspend();
+    }
+    Result result = co_await coro::from_callback<void(Result)>([this, &worker, &f, trace, executor](auto done) {
+        boost::asio::post(worker.thread, [this, &worker, &f, trace, executor, done]() mutable {
+            Result result{};
+            {
+                tracing::ResumeScope scope(trace);
+                try {
+                    if (ensure_connected(worker)) {
+                        result = f(worker.db);
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "数据库线程查询异常: " << e.what() << std::endl;
+                }
+            }
+            boost::asio::post(executor, [done, result = std::move(result)]() mutable {
+                done(std::move(result));
+            });
+        });
+    });
+    if (trace) {
+        trace->resume();
+    }
+    co_return result;
+}
+
+// 全局数据库线程（定义于main.cpp，为空时请求处理在io线程上直接查询）
+extern std::shared_ptr<AsyncDatabase> g_async_db;
+
+} // namespace db
@@ -0,0 +1,167 @@
+#include "change_feed.hpp"
+#include <boost/asio/post.hpp>
+#include <pqxx/pqxx>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace net = boost::asio;
+
+namespace feed {
+
+namespace {
+
+// LISTEN连接上的通知接收器，收到的载荷交给监听器解析
+class Receiver : public pqxx::notification_receiver {
+private:
+    ChangeListener& owner;
+
+public:
+    Receiver(pqxx::connection& conn, ChangeListener& owner)
+        : pqxx::notification_receiver(conn, channel), owner(owner) {}
+    
+    void operator()(const std::string& payload, int) override {
+        owner.dispatch(payload);
+    }
+};
+
+} // namespace
+
+std::string encode(const std::string& source, const ChangeEvent& event) {
+    std::string out = source;
+    out += ' ';
+    out += static_cast<char>(event.kind);
+    out += ' ';
+    out += event.post_id;
+    
+    switch (event.kind) {
+        case ChangeEvent::Kind::post_created:
+            out += ' ' + std::to_string(event.amount) + ' ' + std::to_string(event.images);
+            break;
+        case ChangeEvent::Kind::viewed:
+        case ChangeEvent::Kind::liked:
+            out += ' ' + std::to_string(event.view_count) + ' ' + std::to_string(event.like_count) +
+                   ' ' + std::to_string(event.amount);
+            break;
+        default:
+            break;
+    }
+    return out;
+}
+
+std::optional<ChangeEvent> decode(const std::string& payload, std::string& source) {
+    std::istringstream in(payload);
+    char kind = 0;
+    ChangeEvent event;
+    if (!(in >> source >> kind >> event.post_id)) {
+        return std::nullopt;
+    }
+    
+    event.kind = static_cast<ChangeEvent::Kind>(kind);
+    switch (event.kind) {
+        case ChangeEvent::Kind::post_created:
+            if (!(in >> event.amount >> event.images)) {
+                return std::nullopt;
+            }
+            break;
+        case ChangeEvent::Kind::viewed:
+        case ChangeEvent::Kind::liked:
+            if (!(in >> event.view_count >> event.like_count >> event.amount)) {
+                return std::nullopt;
+            }
+            break;
+        case ChangeEvent::Kind::post_changed:
+            break;
+        default:
+            return std::nullopt;
+    }
+    return event;
+}
+
+std::string make_instance_id() {
+    std::random_device device;
+    uint64_t value = (static_cast<uint64_t>(device()) << 32) ^ device();
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << value;
+    return out.str();
+}
+
+ChangeListener::ChangeListener(const std::string& connection_string, const std::string& instance_id,
+                               net::any_io_executor executor, Handler handler)
+    : connection_string(connection_string), instance_id(instance_id),
+      executor(executor), handler(std::move(handler)) {
+}
+
+ChangeListener::~ChangeListener() {
+    stop();
+}
+
+void ChangeListener::start() {
+    worker = std::thread([this] { run(); });
+}
+
+void ChangeListener::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stop_cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void ChangeListener::dispatch(const std::string& payload) {
+    std::string source;
+    auto event = decode(payload, source);
+    if (!event) {
+        std::cerr << "无法解析变更通知: " << payload << std::endl;
+        return;
+    }
+    // 自己发出的通知在本地已经处理过
+    if (source == instance_id) {
+        return;
+    }
+    net::post(executor, [handler = handler, event = std::move(*event)] {
+        handler(event);
+    });
+}
+
+void ChangeListener::run() {
+    auto backoff = std::chrono::seconds(1);
+    constexpr auto max_backoff = std::chrono::seconds(30);
+    bool connected_before = false;
+    
+    while (!stopping) {
+        try {
+            pqxx::connection conn(connection_string);
+            Receiver receiver(conn, *this);
+            
+            // 断线期间的通知已经丢失，让本地状态整体重新校准一次
+            if (connected_before) {
+                std::cerr << "变更通知连接已恢复" << std::endl;
+                ChangeEvent resync;
+                resync.kind = ChangeEvent::Kind::resync;
+                net::post(executor, [handler = handler, resync] {
+                    handler(resync);
+                });
+            }
+            connected_before = true;
+            backoff = std::chrono::seconds(1);
+            
+            // 每秒醒来一次检查是否需要退出
+            while (!stopping) {
+                conn.await_notification(1, 0);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "变更通知连接失败: " << e.what() << std::endl;
+            std::unique_lock<std::mutex> lock(mutex);
+            stop_cv.wait_for(lock, backoff, [this] { return stopping.load(); });
+            backoff = std::min<std::chrono::seconds>(backoff * 2, max_backoff);
+        }
+    }
+}
+
+} // namespace feed
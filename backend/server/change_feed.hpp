@@ -0,0 +1,78 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace feed {
+
+// 多实例之间的变更通知，经PostgreSQL LISTEN/NOTIFY传递（通知随事务提交才发出）
+constexpr const char* channel = "commentfree_changes";
+
+// 变更事件，编码为空格分隔的短文本：<来源实例> <类型> <评论ID> [数值...]
+struct ChangeEvent {
+    enum class Kind : char {
+        post_created = 'n',     // 新评论：amount=内容字数，images=图片数
+        post_changed = 'i',     // 评论的不可变部分变化（缩略图生成完毕），需要丢弃缓存
+        viewed = 'v',           // 浏览数增加：amount=增量，附最新计数
+        liked = 'l',            // 点赞数增加，附最新计数
+        resync = 'r'            // 本地合成：监听连接断开过，期间的通知可能丢失
+    };
+    
+    Kind kind = Kind::post_changed;
+    std::string post_id;
+    int view_count = 0;
+    int like_count = 0;
+    int64_t amount = 0;
+    int64_t images = 0;
+};
+
+std::string encode(const std::string& source, const ChangeEvent& event);
+
+// 解析通知载荷，格式错误时返回nullopt；source为发出事件的实例ID
+std::optional<ChangeEvent> decode(const std::string& payload, std::string& source);
+
+// 随机生成的实例ID，用于忽略自己发出的通知
+std::string make_instance_id();
+
+// 独立连接上的通知监听线程，收到其他实例的事件后投递到io线程处理
+class ChangeListener {
+public:
+    using Handler = std::function<void(const ChangeEvent& event)>;
+
+private:
+    std::string connection_string;
+    std::string instance_id;
+    boost::asio::any_io_executor executor;
+    Handler handler;
+    
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable stop_cv;
+    std::thread worker;
+
+public:
+    ChangeListener(const std::string& connection_string, const std::string& instance_id,
+                   boost::asio::any_io_executor executor, Handler handler);
+    ~ChangeListener();
+    ChangeListener(const ChangeListener&) = delete;
+    ChangeListener& operator=(const ChangeListener&) = delete;
+    
+    void start();
+    void stop();
+    
+    // 收到一条通知（监听线程上调用）
+    void dispatch(const std::string& payload);
+
+private:
+    void run();
+};
+
+} // namespace feed
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <memory>
+#include <utility>
+
+namespace coro {
+
+// 把回调式异步接口（FileIo、SubmitLog等）包装成可co_await的操作
+// Signature为回调签名，如void(std::error_code, std::string)；单个参数时co_await得到该值，多个参数时得到std::tuple
+// start收到一个可复制的回调并发起操作；回调须在协程所在的io线程上调用，协程在回调里直接恢复
+template<class Signature, class Start>
+auto from_callback(Start start) {
+    return boost::asio::async_initiate<const boost::asio::use_awaitable_t<>&, Signature>(
+        [start = std::move(start)](auto handler) mutable {
+            auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+            start([shared](auto&&... args) {
+                std::move(*shared)(std::forward<decltype(args)>(args)...);
+            });
+        },
+        boost::asio::use_awaitable);
+}
+
+// 协程之间的唤醒信号：wait挂起直到另一方对同一定时器调用cancel()
+// 只在单个io线程上使用，调用方在wait前检查条件，不会丢失唤醒
+inline boost::asio::awaitable<void> wait(boost::asio::steady_timer& signal) {
+    signal.expires_at(boost::asio::steady_timer::time_point::max());
+    boost::system::error_code ec;
+    co_await signal.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+}
+
+} // namespace coro
@@ -1,9 +1,26 @@
 #include "db.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include "unique_views.hpp"
+#include "utils.hpp"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
 
 namespace db {
 
+namespace {
+
+// 追加一张图片及其变体路径（变体列为NULL表示尚未生成）
+void append_image(Post& post, const pqxx::row& row) {
+    post.image_paths.push_back(row["path"].as<std::string>());
+    post.image_variants.push_back(PostImageVariants{row["thumbnail_path"].as<std::string>(""),
+                                                    row["medium_path"].as<std::string>("")});
+}
+
+} // namespace
+
 DatabaseManager::DatabaseManager(const std::string& conn_str) 
     : connection_string(conn_str) {
 }
@@ -37,24 +54,77 @@ bool DatabaseManager::is_connected() const {
     return conn && conn->is_open();
 }
 
-bool DatabaseManager::save_post(const Post& post) {
+bool DatabaseManager::set_statement_timeout(int milliseconds) {
+    // 事务提交后SET对整个会话生效
+    return execute_query("SET statement_timeout = " + std::to_string(milliseconds));
+}
+
+void DatabaseManager::publish_changes(pqxx::work& txn, const std::vector<feed::ChangeEvent>& events) {
+    if (change_source.empty() || events.empty()) {
+        return;
+    }
+    
+    std::vector<std::string> payloads;
+    payloads.reserve(events.size());
+    for (const auto& event : events) {
+        payloads.push_back(feed::encode(change_source, event));
+    }
+    txn.exec_params("SELECT pg_notify($1, payload) FROM unnest($2::text[]) AS payload",
+                    std::string(feed::channel), payloads);
+}
+
+namespace {
+
+feed::ChangeEvent created_event(const Post& post, size_t image_count) {
+    feed::ChangeEvent event;
+    event.kind = feed::ChangeEvent::Kind::post_created;
+    event.post_id = post.id;
+    event.amount = static_cast<int64_t>(utils::StringUtils::utf8_length(post.content));
+    event.images = static_cast<int64_t>(image_count);
+    return event;
+}
+
+feed::ChangeEvent counter_event(feed::ChangeEvent::Kind kind, const std::string& id,
+                                const PostCounters& counters, int64_t amount) {
+    feed::ChangeEvent event;
+    event.kind = kind;
+    event.post_id = id;
+    event.view_count = counters.view_count;
+    event.like_count = counters.like_count;
+    event.amount = amount;
+    return event;
+}
+
+} // namespace
+
+bool DatabaseManager::save_post(const Post& post, const std::vector<PostImage>& images) {
     if (!is_connected()) {
         return false;
     }
     
     try {
+        metrics::DbTimer timer(metrics::DbStatement::save_post);
         pqxx::work txn(*conn);
         
-        // 插入评论主体
-        std::string query = "INSERT INTO posts (id, content, created_at) VALUES ($1, $2, NOW())";
+        // 插入评论主体；created_at统一存UTC，与提交日志生成的时间一致
+        std::string query = "INSERT INTO posts (id, content, created_at) VALUES ($1, $2, NOW() AT TIME ZONE 'UTC')";
         txn.exec_params(query, post.id, post.content);
         
-        // 插入图片路径
-        for (const auto& image_path : post.image_paths) {
-            std::string img_query = "INSERT INTO post_images (post_id, path) VALUES ($1, $2)";
-            txn.exec_params(img_query, post.id, image_path);
+        // 插入图片路径和元数据；内容相同的图片共用一个文件，引用数即post_images中的行数
+        if (!images.empty()) {
+            for (const auto& image : images) {
+                std::string img_query = "INSERT INTO post_images (post_id, path, filename, file_size, mime_type) "
+                                        "VALUES ($1, $2, $3, $4, $5)";
+                txn.exec_params(img_query, post.id, image.path, image.filename, image.file_size, image.mime_type);
+            }
+        } else {
+            for (const auto& image_path : post.image_paths) {
+                std::string img_query = "INSERT INTO post_images (post_id, path) VALUES ($1, $2)";
+                txn.exec_params(img_query, post.id, image_path);
+            }
         }
         
+        publish_changes(txn, {created_event(post, images.empty() ? post.image_paths.size() : images.size())});
         txn.commit();
         return true;
     } catch (const std::exception& e) {
@@ -63,17 +133,85 @@ bool DatabaseManager::save_post(const Post& post) {
     }
 }
 
+bool DatabaseManager::save_posts(const std::vector<PostWrite>& posts, std::vector<size_t>& rejected) {
+    rejected.clear();
+    if (!is_connected()) {
+        return false;
+    }
+    if (posts.empty()) {
+        return true;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::save_posts);
+        pqxx::work txn(*conn);
+        std::vector<feed::ChangeEvent> events;
+        
+        for (size_t i = 0; i < posts.size(); ++i) {
+            const Post& post = posts[i].post;
+            try {
+                // 单条记录出错只回滚到它自己的保存点，否则一条坏记录会让整批永远重试
+                pqxx::subtransaction record(txn);
+                pqxx::result inserted = record.exec_params(
+                    "INSERT INTO posts (id, content, created_at) VALUES ($1, $2, $3::timestamp) "
+                    "ON CONFLICT (id) DO NOTHING RETURNING id",
+                    post.id, post.content, post.created_at);
+                
+                if (inserted.empty()) {
+                    // 上次入库后没来得及记检查点的重放，或者ID撞上了其他评论
+                    pqxx::result same = record.exec_params(
+                        "SELECT 1 FROM posts WHERE id = $1 AND content = $2 AND created_at = $3::timestamp",
+                        post.id, post.content, post.created_at);
+                    if (same.empty()) {
+                        rejected.push_back(i);
+                    }
+                    record.commit();
+                    continue;
+                }
+                
+                for (const auto& image : posts[i].images) {
+                    record.exec_params("INSERT INTO post_images (post_id, path, filename, file_size, mime_type) "
+                                       "VALUES ($1, $2, $3, $4, $5)",
+                                       post.id, image.path, image.filename, image.file_size, image.mime_type);
+                }
+                record.commit();
+            } catch (const pqxx::broken_connection&) {
+                throw;
+            } catch (const pqxx::in_doubt_error&) {
+                throw;
+            } catch (const std::exception& e) {
+                std::cerr << "评论 " << post.id << " 被数据库拒绝: " << e.what() << std::endl;
+                rejected.push_back(i);
+                continue;
+            }
+            events.push_back(created_event(post, posts[i].images.size()));
+        }
+        
+        publish_changes(txn, events);
+        txn.commit();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "批量保存评论失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
 std::optional<Post> DatabaseManager::get_post(const std::string& id) {
     if (!is_connected()) {
         return std::nullopt;
     }
     
     try {
+        metrics::DbTimer timer(metrics::DbStatement::get_post);
         pqxx::nontransaction txn(*conn);
         
         // 获取评论主体
         std::string query = "SELECT id, content, created_at, view_count, like_count FROM posts WHERE id = $1";
-        pqxx::result result = txn.exec_params(query, id);
+        pqxx::result result;
+        {
+            tracing::Span span("select_post");
+            result = txn.exec_params(query, id);
+        }
         
         if (result.empty()) {
             return std::nullopt;
@@ -88,11 +226,13 @@ std::optional<Post> DatabaseManager::get_post(const std::string& id) {
         post.like_count = row["like_count"].as<int>(0);
         
         // 获取图片路径
-        std::string img_query = "SELECT path FROM post_images WHERE post_id = $1 ORDER BY id";
+        std::string img_query = "SELECT path, thumbnail_path, medium_path FROM post_images "
+                                "WHERE post_id = $1 ORDER BY id";
+        tracing::Span span("select_images");
         pqxx::result img_result = txn.exec_params(img_query, id);
         
         for (const auto& img_row : img_result) {
-            post.image_paths.push_back(img_row["path"].as<std::string>());
+            append_image(post, img_row);
         }
         
         return post;
@@ -102,36 +242,502 @@ std::optional<Post> DatabaseManager::get_post(const std::string& id) {
     }
 }
 
-bool DatabaseManager::increment_view_count(const std::string& id) {
+bool DatabaseManager::get_posts(const std::vector<std::string>& ids, std::vector<Post>& posts) {
+    if (!is_connected()) {
+        return false;
+    }
+    if (ids.empty()) {
+        return true;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::get_posts);
+        pqxx::nontransaction txn(*conn);
+        
+        std::string query = "SELECT id, content, created_at, view_count, like_count FROM posts WHERE id = ANY($1)";
+        pqxx::result result = txn.exec_params(query, ids);
+        
+        std::unordered_map<std::string, size_t> index_of;
+        size_t first = posts.size();
+        
+        for (const auto& row : result) {
+            Post post;
+            post.id = row["id"].as<std::string>();
+            post.content = row["content"].as<std::string>();
+            post.created_at = row["created_at"].as<std::string>();
+            post.view_count = row["view_count"].as<int>(0);
+            post.like_count = row["like_count"].as<int>(0);
+            index_of.emplace(post.id, posts.size());
+            posts.push_back(std::move(post));
+        }
+        
+        if (posts.size() > first) {
+            std::string img_query = "SELECT post_id, path, thumbnail_path, medium_path FROM post_images "
+                                    "WHERE post_id = ANY($1) ORDER BY id";
+            pqxx::result img_result = txn.exec_params(img_query, ids);
+            
+            for (const auto& img_row : img_result) {
+                auto it = index_of.find(img_row["post_id"].as<std::string>());
+                if (it != index_of.end()) {
+                    append_image(posts[it->second], img_row);
+                }
+            }
+        }
+        
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "批量获取评论失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::list_posts(const std::optional<PostCursor>& after, int limit,
+                                 const std::function<void(const Post&)>& on_post) {
+    if (!is_connected()) {
+        return false;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::list_posts);
+        pqxx::nontransaction txn(*conn);
+        
+        // 行比较 (created_at, id) < (...) 可以直接走 idx_posts_created_at_id 索引
+        pqxx::result result;
+        if (after) {
+            std::string query = "SELECT id, content, created_at, view_count, like_count FROM posts "
+                                "WHERE (created_at, id) < ($1::timestamp, $2) "
+                                "ORDER BY created_at DESC, id DESC LIMIT $3";
+            result = txn.exec_params(query, after->created_at, after->id, limit);
+        } else {
+            std::string query = "SELECT id, content, created_at, view_count, like_count FROM posts "
+                                "ORDER BY created_at DESC, id DESC LIMIT $1";
+            result = txn.exec_params(query, limit);
+        }
+        
+        std::vector<Post> page;
+        page.reserve(result.size());
+        std::vector<std::string> ids;
+        ids.reserve(result.size());
+        std::unordered_map<std::string, size_t> index_of;
+        
+        for (const auto& row : result) {
+            Post post;
+            post.id = row["id"].as<std::string>();
+            post.content = row["content"].as<std::string>();
+            post.created_at = row["created_at"].as<std::string>();
+            post.view_count = row["view_count"].as<int>(0);
+            post.like_count = row["like_count"].as<int>(0);
+            index_of.emplace(post.id, page.size());
+            ids.push_back(post.id);
+            page.push_back(std::move(post));
+        }
+        
+        // 整页图片一次取回
+        if (!ids.empty()) {
+            std::string img_query = "SELECT post_id, path, thumbnail_path, medium_path FROM post_images "
+                                    "WHERE post_id = ANY($1) ORDER BY id";
+            pqxx::result img_result = txn.exec_params(img_query, ids);
+            
+            for (const auto& img_row : img_result) {
+                auto it = index_of.find(img_row["post_id"].as<std::string>());
+                if (it != index_of.end()) {
+                    append_image(page[it->second], img_row);
+                }
+            }
+        }
+        
+        for (const auto& post : page) {
+            on_post(post);
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "列出评论失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::scan_post_contents(
+    const std::function<void(const std::string& id, const std::string& content)>& on_post) {
+    if (!is_connected()) {
+        return false;
+    }
+    
+    constexpr int batch_size = 5000;
+    try {
+        std::optional<PostCursor> after;
+        while (true) {
+            metrics::DbTimer timer(metrics::DbStatement::scan_post_contents);
+            pqxx::nontransaction txn(*conn);
+            
+            // 每批一条keyset查询，避免一次把整张表的内容读进内存
+            pqxx::result result;
+            if (after) {
+                std::string query = "SELECT id, content, created_at FROM posts "
+                                    "WHERE (created_at, id) > ($1::timestamp, $2) "
+                                    "ORDER BY created_at, id LIMIT $3";
+                result = txn.exec_params(query, after->created_at, after->id, batch_size);
+            } else {
+                std::string query = "SELECT id, content, created_at FROM posts "
+                                    "ORDER BY created_at, id LIMIT $1";
+                result = txn.exec_params(query, batch_size);
+            }
+            
+            for (const auto& row : result) {
+                on_post(row["id"].as<std::string>(), row["content"].as<std::string>());
+            }
+            if (result.size() < static_cast<size_t>(batch_size)) {
+                return true;
+            }
+            const auto& last = result[result.size() - 1];
+            after = PostCursor{last["created_at"].as<std::string>(), last["id"].as<std::string>()};
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "扫描评论内容失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::get_top_posts(int limit, std::vector<std::pair<std::string, PostCounters>>& posts) {
+    if (!is_connected()) {
+        return false;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::get_top_posts);
+        pqxx::nontransaction txn(*conn);
+        // 计数列可为NULL，DESC默认把NULL排在最前，须显式NULLS LAST（与索引顺序一致）
+        std::string query = "(SELECT id, view_count, like_count FROM posts ORDER BY view_count DESC NULLS LAST LIMIT $1) "
+                            "UNION "
+                            "(SELECT id, view_count, like_count FROM posts ORDER BY like_count DESC NULLS LAST LIMIT $1)";
+        pqxx::result result = txn.exec_params(query, limit);
+        
+        for (const auto& row : result) {
+            PostCounters c;
+            c.view_count = row["view_count"].as<int>(0);
+            c.like_count = row["like_count"].as<int>(0);
+            posts.emplace_back(row["id"].as<std::string>(), c);
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "获取热门评论失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::get_site_totals(SiteTotals& totals) {
+    if (!is_connected()) {
+        return false;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::get_site_totals);
+        pqxx::nontransaction txn(*conn);
+        std::string query = R"(
+            SELECT COUNT(*) AS total_posts,
+                   (SELECT COUNT(*) FROM post_images) AS total_images,
+                   COALESCE(SUM(view_count), 0) AS total_views,
+                   COALESCE(SUM(like_count), 0) AS total_likes,
+                   COALESCE(AVG(LENGTH(content)), 0) AS avg_length,
+                   COALESCE(VAR_POP(LENGTH(content)), 0) AS var_length
+            FROM posts
+        )";
+        pqxx::result result = txn.exec(query);
+        
+        auto row = result[0];
+        totals.total_posts = row["total_posts"].as<int64_t>(0);
+        totals.total_images = row["total_images"].as<int64_t>(0);
+        totals.total_views = row["total_views"].as<int64_t>(0);
+        totals.total_likes = row["total_likes"].as<int64_t>(0);
+        totals.avg_content_length = row["avg_length"].as<double>(0.0);
+        totals.var_content_length = row["var_length"].as<double>(0.0);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "获取统计信息失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::get_post_counters(const std::vector<std::string>& ids,
+                                        std::unordered_map<std::string, PostCounters>& counters) {
+    if (!is_connected()) {
+        return false;
+    }
+    if (ids.empty()) {
+        return true;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::get_post_counters);
+        pqxx::nontransaction txn(*conn);
+        std::string query = "SELECT id, view_count, like_count FROM posts WHERE id = ANY($1)";
+        pqxx::result result = txn.exec_params(query, ids);
+        
+        for (const auto& row : result) {
+            PostCounters c;
+            c.view_count = row["view_count"].as<int>(0);
+            c.like_count = row["like_count"].as<int>(0);
+            counters[row["id"].as<std::string>()] = c;
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "获取评论计数失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::increment_view_count(const std::string& id, int amount) {
     if (!is_connected()) {
         return false;
     }
     
     try {
+        metrics::DbTimer timer(metrics::DbStatement::increment_view_count);
         pqxx::work txn(*conn);
-        std::string query = "UPDATE posts SET view_count = COALESCE(view_count, 0) + 1 WHERE id = $1";
-        auto result = txn.exec_params(query, id);
+        std::string query = "UPDATE posts SET view_count = COALESCE(view_count, 0) + $2 WHERE id = $1 "
+                            "RETURNING view_count, like_count";
+        auto result = txn.exec_params(query, id, amount);
+        if (result.empty()) {
+            return false;
+        }
+        
+        PostCounters c{result[0]["view_count"].as<int>(0), result[0]["like_count"].as<int>(0)};
+        publish_changes(txn, {counter_event(feed::ChangeEvent::Kind::viewed, id, c, amount)});
         txn.commit();
-        return result.affected_rows() > 0;
+        return true;
     } catch (const std::exception& e) {
         std::cerr << "增加浏览次数失败: " << e.what() << std::endl;
         return false;
     }
 }
 
-bool DatabaseManager::increment_like_count(const std::string& id) {
+bool DatabaseManager::increment_view_counts(const std::vector<std::string>& ids, const std::vector<int>& amounts,
+                                            std::unordered_map<std::string, PostCounters>& counters) {
     if (!is_connected()) {
         return false;
     }
+    if (ids.empty()) {
+        return true;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::increment_view_counts);
+        pqxx::work txn(*conn);
+        std::string query = "UPDATE posts AS p SET view_count = COALESCE(p.view_count, 0) + d.amount "
+                            "FROM unnest($1::varchar[], $2::int[]) AS d(id, amount) "
+                            "WHERE p.id = d.id "
+                            "RETURNING p.id, p.view_count, p.like_count";
+        pqxx::result result = txn.exec_params(query, ids, amounts);
+        
+        std::vector<feed::ChangeEvent> events;
+        for (const auto& row : result) {
+            PostCounters c;
+            c.view_count = row["view_count"].as<int>(0);
+            c.like_count = row["like_count"].as<int>(0);
+            std::string id = row["id"].as<std::string>();
+            if (!change_source.empty()) {
+                size_t i = static_cast<size_t>(std::find(ids.begin(), ids.end(), id) - ids.begin());
+                events.push_back(counter_event(feed::ChangeEvent::Kind::viewed, id, c, i < amounts.size() ? amounts[i] : 0));
+            }
+            counters[id] = c;
+        }
+        
+        publish_changes(txn, events);
+        txn.commit();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "批量增加浏览次数失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::load_viewer_sketches(const std::vector<std::string>& ids,
+                                           std::unordered_map<std::string, std::string>& sketches) {
+    if (!is_connected()) {
+        return false;
+    }
+    if (ids.empty()) {
+        return true;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::load_viewer_sketches);
+        pqxx::nontransaction txn(*conn);
+        std::string query = "SELECT post_id, encode(registers, 'hex') AS registers "
+                            "FROM post_viewer_sketches WHERE post_id = ANY($1)";
+        pqxx::result result = txn.exec_params(query, ids);
+        
+        for (const auto& row : result) {
+            sketches[row["post_id"].as<std::string>()] = row["registers"].as<std::string>();
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "读取访客草图失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::save_viewer_sketches(const std::vector<std::pair<std::string, std::string>>& sketches) {
+    if (!is_connected()) {
+        return false;
+    }
+    if (sketches.empty()) {
+        return true;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::save_viewer_sketches);
+        // 按post_id排序，多个实例加锁顺序一致，避免死锁
+        std::vector<std::pair<std::string, std::string>> sorted(sketches.begin(), sketches.end());
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<std::string> ids;
+        std::vector<std::string> registers;
+        ids.reserve(sorted.size());
+        registers.reserve(sorted.size());
+        for (const auto& [id, hex] : sorted) {
+            ids.push_back(id);
+            registers.push_back(hex);
+        }
+        
+        pqxx::work txn(*conn);
+        // 库中还没有的直接插入；已被删除的评论跳过，避免外键错误导致整批失败
+        // 并发插入同一行时ON CONFLICT等对方提交后放弃插入，下面再合并
+        std::string insert_query = R"(
+            INSERT INTO post_viewer_sketches (post_id, registers, updated_at)
+            SELECT d.post_id, decode(d.registers, 'hex'), NOW()
+            FROM unnest($1::varchar[], $2::text[]) AS d(post_id, registers)
+            WHERE EXISTS (SELECT 1 FROM posts WHERE id = d.post_id)
+            ON CONFLICT (post_id) DO NOTHING
+            RETURNING post_id
+        )";
+        pqxx::result inserted = txn.exec_params(insert_query, ids, registers);
+        std::unordered_set<std::string> done;
+        for (const auto& row : inserted) {
+            done.insert(row["post_id"].as<std::string>());
+        }
+        
+        // 其余的锁住库中的行，按寄存器取最大值合并后写回
+        std::vector<std::string> existing_ids;
+        for (const auto& id : ids) {
+            if (!done.count(id)) {
+                existing_ids.push_back(id);
+            }
+        }
+        if (!existing_ids.empty()) {
+            pqxx::result stored = txn.exec_params(
+                "SELECT post_id, encode(registers, 'hex') AS registers FROM post_viewer_sketches "
+                "WHERE post_id = ANY($1) ORDER BY post_id FOR UPDATE",
+                existing_ids);
+            
+            std::unordered_map<std::string, const std::string*> local;
+            for (const auto& [id, hex] : sorted) {
+                local[id] = &hex;
+            }
+            std::vector<std::string> merged_ids;
+            std::vector<std::string> merged_registers;
+            for (const auto& row : stored) {
+                std::string id = row["post_id"].as<std::string>();
+                hll::HyperLogLog sketch;
+                hll::HyperLogLog mine;
+                sketch.from_hex(row["registers"].as<std::string>());
+                if (!mine.from_hex(*local[id]) || !sketch.merge(mine)) {
+                    continue;   // 库中已包含全部访客
+                }
+                merged_ids.push_back(std::move(id));
+                merged_registers.push_back(sketch.to_hex());
+            }
+            if (!merged_ids.empty()) {
+                txn.exec_params("UPDATE post_viewer_sketches AS s "
+                                "SET registers = decode(d.registers, 'hex'), updated_at = NOW() "
+                                "FROM unnest($1::varchar[], $2::text[]) AS d(post_id, registers) "
+                                "WHERE s.post_id = d.post_id",
+                                merged_ids, merged_registers);
+            }
+        }
+        txn.commit();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "保存访客草图失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::optional<PostCounters> DatabaseManager::increment_like_count(const std::string& id) {
+    if (!is_connected()) {
+        return std::nullopt;
+    }
     
     try {
+        metrics::DbTimer timer(metrics::DbStatement::increment_like_count);
         pqxx::work txn(*conn);
-        std::string query = "UPDATE posts SET like_count = COALESCE(like_count, 0) + 1 WHERE id = $1";
+        std::string query = "UPDATE posts SET like_count = COALESCE(like_count, 0) + 1 WHERE id = $1 "
+                            "RETURNING view_count, like_count";
         auto result = txn.exec_params(query, id);
+        
+        if (result.empty()) {
+            return std::nullopt;
+        }
+        
+        PostCounters c;
+        c.view_count = result[0]["view_count"].as<int>(0);
+        c.like_count = result[0]["like_count"].as<int>(0);
+        publish_changes(txn, {counter_event(feed::ChangeEvent::Kind::liked, id, c, 1)});
         txn.commit();
-        return result.affected_rows() > 0;
+        return c;
     } catch (const std::exception& e) {
         std::cerr << "增加点赞次数失败: " << e.what() << std::endl;
+        return std::nullopt;
+    }
+}
+
+bool DatabaseManager::set_image_variants(const std::string& path, const std::string& thumbnail_path,
+                                         const std::string& medium_path, std::vector<std::string>& post_ids) {
+    if (!is_connected()) {
+        return false;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::set_image_variants);
+        pqxx::work txn(*conn);
+        
+        // 空字符串写为NULL，保留"未生成"的语义
+        std::string query = "UPDATE post_images SET thumbnail_path = NULLIF($2, ''), medium_path = NULLIF($3, '') "
+                            "WHERE path = $1 RETURNING post_id";
+        auto result = txn.exec_params(query, path, thumbnail_path, medium_path);
+        
+        std::vector<feed::ChangeEvent> events;
+        for (const auto& row : result) {
+            post_ids.push_back(row["post_id"].as<std::string>());
+            events.push_back(feed::ChangeEvent{feed::ChangeEvent::Kind::post_changed, post_ids.back()});
+        }
+        
+        publish_changes(txn, events);
+        txn.commit();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "记录图片变体失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DatabaseManager::find_referenced_images(const std::vector<std::string>& paths,
+                                             std::unordered_set<std::string>& referenced) {
+    if (!is_connected()) {
+        return false;
+    }
+    if (paths.empty()) {
+        return true;
+    }
+    
+    try {
+        metrics::DbTimer timer(metrics::DbStatement::find_referenced_images);
+        pqxx::nontransaction txn(*conn);
+        pqxx::result result = txn.exec_params("SELECT DISTINCT path FROM post_images WHERE path = ANY($1)", paths);
+        for (const auto& row : result) {
+            referenced.insert(row["path"].as<std::string>());
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "查询图片引用失败: " << e.what() << std::endl;
         return false;
     }
 }
@@ -149,7 +755,7 @@ bool DatabaseManager::initialize_tables() {
             CREATE TABLE IF NOT EXISTS posts (
                 id VARCHAR(16) PRIMARY KEY,
                 content TEXT NOT NULL,
-                created_at TIMESTAMP DEFAULT NOW(),
+                created_at TIMESTAMP DEFAULT (NOW() AT TIME ZONE 'UTC'),
                 view_count INTEGER DEFAULT 0,
                 like_count INTEGER DEFAULT 0
             )
@@ -166,9 +772,45 @@ bool DatabaseManager::initialize_tables() {
         )";
         txn.exec(create_images);
         
+        // 旧库补齐图片元数据列
+        txn.exec(R"(
+            ALTER TABLE post_images
+                ADD COLUMN IF NOT EXISTS filename TEXT,
+                ADD COLUMN IF NOT EXISTS file_size INTEGER,
+                ADD COLUMN IF NOT EXISTS mime_type VARCHAR(100),
+                ADD COLUMN IF NOT EXISTS thumbnail_path TEXT,
+                ADD COLUMN IF NOT EXISTS medium_path TEXT
+        )");
+        
+        // 创建post_viewer_sketches表（每条评论的独立访客HLL草图）
+        std::string create_sketches = R"(
+            CREATE TABLE IF NOT EXISTS post_viewer_sketches (
+                post_id VARCHAR(16) PRIMARY KEY REFERENCES posts(id) ON DELETE CASCADE,
+                registers BYTEA NOT NULL,
+                updated_at TIMESTAMP DEFAULT NOW()
+            )
+        )";
+        txn.exec(create_sketches);
+        
         // 创建索引以提高查询性能
         txn.exec("CREATE INDEX IF NOT EXISTS idx_posts_created_at ON posts(created_at)");
+        txn.exec("CREATE INDEX IF NOT EXISTS idx_posts_created_at_id ON posts(created_at DESC, id DESC)");
+        // 旧版本的计数索引是 DESC（NULLS FIRST），与热门查询的排序不一致，重建一次
+        txn.exec(R"(
+            DO $$
+            DECLARE idx TEXT;
+            BEGIN
+                FOREACH idx IN ARRAY ARRAY['idx_posts_view_count', 'idx_posts_like_count'] LOOP
+                    IF EXISTS (SELECT 1 FROM pg_indexes WHERE indexname = idx AND indexdef NOT LIKE '%NULLS LAST%') THEN
+                        EXECUTE format('DROP INDEX %I', idx);
+                    END IF;
+                END LOOP;
+            END $$
+        )");
+        txn.exec("CREATE INDEX IF NOT EXISTS idx_posts_view_count ON posts(view_count DESC NULLS LAST)");
+        txn.exec("CREATE INDEX IF NOT EXISTS idx_posts_like_count ON posts(like_count DESC NULLS LAST)");
         txn.exec("CREATE INDEX IF NOT EXISTS idx_post_images_post_id ON post_images(post_id)");
+        txn.exec("CREATE INDEX IF NOT EXISTS idx_post_images_path ON post_images(path)");
         
         txn.commit();
         std::cout << "数据库表初始化成功" << std::endl;
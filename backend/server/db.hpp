@@ -4,18 +4,67 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
 #include <pqxx/pqxx>
+#include "change_feed.hpp"
 
 namespace db {
 
+// 图片的缩略图/中图路径（后台生成，尚未生成时为空）
+struct PostImageVariants {
+    std::string thumbnail;
+    std::string medium;
+};
+
 // 评论数据结构
 struct Post {
     std::string id;
     std::string content;
     std::vector<std::string> image_paths;
+    std::vector<PostImageVariants> image_variants;   // 与image_paths一一对应
     std::string created_at;
     int view_count = 0;
     int like_count = 0;
+    std::optional<uint64_t> unique_views;   // 独立访客估计（来自内存HLL，不对应数据库列）
+};
+
+// 图片元数据（保存评论时写入post_images）
+struct PostImage {
+    std::string path;
+    std::string filename;
+    std::string mime_type;
+    int64_t file_size = 0;
+};
+
+// 一次待写入的评论（本地提交日志中的记录）
+struct PostWrite {
+    Post post;
+    std::vector<PostImage> images;
+};
+
+// 评论计数器
+struct PostCounters {
+    int view_count = 0;
+    int like_count = 0;
+};
+
+// 全站汇总数据（内容长度按字符计）
+struct SiteTotals {
+    int64_t total_posts = 0;
+    int64_t total_images = 0;
+    int64_t total_views = 0;
+    int64_t total_likes = 0;
+    double avg_content_length = 0.0;
+    double var_content_length = 0.0;   // 总体方差
+};
+
+// 分页游标：上一页最后一条评论的 (created_at, id)
+struct PostCursor {
+    std::string created_at;
+    std::string id;
 };
 
 // 数据库连接管理器
@@ -23,6 +72,7 @@ class DatabaseManager {
 private:
     std::string connection_string;
     std::unique_ptr<pqxx::connection> conn;
+    std::string change_source;      // 非空时写事务里同时发布变更通知（值为本实例ID）
     
 public:
     DatabaseManager(const std::string& conn_str);
@@ -37,17 +87,70 @@ public:
     // 检查连接状态
     bool is_connected() const;
     
+    // 本连接上单条语句的最长执行时间（毫秒，0为不限制），超时的语句由服务端取消并报错
+    bool set_statement_timeout(int milliseconds);
+    
+    // 在保存评论、增加计数、更新图片变体的事务中发布变更通知，供其他实例更新本地缓存
+    void enable_change_events(const std::string& instance_id) { change_source = instance_id; }
+    
     // 保存评论
-    bool save_post(const Post& post);
+    // images为空时只按post.image_paths写入路径
+    bool save_post(const Post& post, const std::vector<PostImage>& images = {});
+    
+    // 一个事务批量保存（提交日志入库用），created_at取记录中的时间
+    // 同ID同内容的评论已存在时视为已入库（日志重放幂等）
+    // 每条记录在各自的保存点内写入：ID被其他评论占用或数据被数据库拒绝的下标写入rejected，不影响同批其他记录；
+    // 只有连接或事务本身失败时返回false
+    bool save_posts(const std::vector<PostWrite>& posts, std::vector<size_t>& rejected);
     
     // 获取评论
     std::optional<Post> get_post(const std::string& id);
     
+    // 按 (created_at, id) 倒序分页列出评论（keyset分页，深翻页与首页代价相同）
+    // 整页图片通过一次 post_id = ANY($1) 查询取回，结果逐条交给回调
+    bool list_posts(const std::optional<PostCursor>& after, int limit,
+                    const std::function<void(const Post&)>& on_post);
+    
+    // 按 (created_at, id) 正序分批扫描全部评论的ID和内容（启动时建立搜索索引用）
+    bool scan_post_contents(const std::function<void(const std::string& id, const std::string& content)>& on_post);
+    
+    // 批量获取评论（一次主体查询 + 一次图片查询），不存在的ID会被忽略
+    bool get_posts(const std::vector<std::string>& ids, std::vector<Post>& posts);
+    
+    // 按浏览数、点赞数各取前limit条（走 idx_posts_view_count / idx_posts_like_count），用于重建热门索引
+    bool get_top_posts(int limit, std::vector<std::pair<std::string, PostCounters>>& posts);
+    
+    // 全站汇总（用于校准内存中的站点统计，posts与post_images分别聚合，避免JOIN放大）
+    bool get_site_totals(SiteTotals& totals);
+    
+    // 批量获取计数（同时用于确认哪些评论存在）
+    bool get_post_counters(const std::vector<std::string>& ids,
+                           std::unordered_map<std::string, PostCounters>& counters);
+    
     // 增加浏览次数
-    bool increment_view_count(const std::string& id);
+    bool increment_view_count(const std::string& id, int amount = 1);
+    
+    // 批量增加浏览次数（单条UPDATE，每条评论各自的增量），返回实际存在的评论的最新计数
+    bool increment_view_counts(const std::vector<std::string>& ids, const std::vector<int>& amounts,
+                               std::unordered_map<std::string, PostCounters>& counters);
+    
+    // 读取独立访客草图（post_id -> 十六进制编码的HLL寄存器）
+    bool load_viewer_sketches(const std::vector<std::string>& ids,
+                              std::unordered_map<std::string, std::string>& sketches);
+    
+    // 批量保存独立访客草图：与库中已有的草图按寄存器取最大值合并后写回，
+    // 多个实例各自持久化时不会互相覆盖对方记录的访客
+    bool save_viewer_sketches(const std::vector<std::pair<std::string, std::string>>& sketches);
     
-    // 增加点赞次数
-    bool increment_like_count(const std::string& id);
+    // 增加点赞次数，返回最新计数（评论不存在时为空）
+    std::optional<PostCounters> increment_like_count(const std::string& id);
+    
+    // 记录某张原图的缩略图/中图路径（同一内容的所有引用一起更新），返回受影响的评论ID
+    bool set_image_variants(const std::string& path, const std::string& thumbnail_path,
+                            const std::string& medium_path, std::vector<std::string>& post_ids);
+    
+    // 找出仍被post_images引用的路径（走 idx_post_images_path），用于清理无人引用的上传文件
+    bool find_referenced_images(const std::vector<std::string>& paths, std::unordered_set<std::string>& referenced);
     
     // 初始化数据库表
     bool initialize_tables();
@@ -58,6 +161,9 @@ private:
     
     // 检查表是否存在
     bool table_exists(const std::string& table_name);
+    
+    // 在事务内NOTIFY（一条语句发出全部事件），随事务提交才送达
+    void publish_changes(pqxx::work& txn, const std::vector<feed::ChangeEvent>& events);
 };
 
 } // namespace db
\ No newline at end of file
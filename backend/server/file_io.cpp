@@ -0,0 +1,563 @@
+#include "file_io.hpp"
+#include "coro.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef COMMENTFREE_HAVE_LIBURING
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <liburing.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace net = boost::asio;
+
+namespace fileio {
+
+namespace {
+
+#ifdef _WIN32
+constexpr int read_flags = _O_RDONLY | _O_BINARY;
+constexpr int create_flags = _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY;
+constexpr int create_mode = _S_IREAD | _S_IWRITE;
+
+int sys_open(const char* path, int flags, int mode) { return ::_open(path, flags, mode); }
+int sys_fsync(int fd) { return ::_commit(fd); }
+int sys_close(int fd) { return ::_close(fd); }
+
+// Windows没有pread/pwrite；同一个fd上的读写由调用方串行发起，先定位再读写即可
+int64_t sys_pread(int fd, char* buffer, size_t length, uint64_t offset) {
+    if (::_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) {
+        return -1;
+    }
+    return ::_read(fd, buffer, static_cast<unsigned>(std::min<size_t>(length, INT_MAX)));
+}
+
+int64_t sys_pwrite(int fd, const char* buffer, size_t length, uint64_t offset) {
+    if (::_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) {
+        return -1;
+    }
+    return ::_write(fd, buffer, static_cast<unsigned>(std::min<size_t>(length, INT_MAX)));
+}
+#else
+constexpr int read_flags = O_RDONLY | O_CLOEXEC;
+constexpr int create_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+constexpr int create_mode = 0644;
+
+int sys_open(const char* path, int flags, int mode) { return ::open(path, flags, mode); }
+int sys_fsync(int fd) { return ::fsync(fd); }
+int sys_close(int fd) { return ::close(fd); }
+int64_t sys_pread(int fd, char* buffer, size_t length, uint64_t offset) {
+    return ::pread(fd, buffer, length, static_cast<off_t>(offset));
+}
+int64_t sys_pwrite(int fd, const char* buffer, size_t length, uint64_t offset) {
+    return ::pwrite(fd, buffer, length, static_cast<off_t>(offset));
+}
+#endif
+
+// 系统调用返回值转为 >=0 / -errno
+int64_t result_of(int64_t rc) {
+    return rc < 0 ? -static_cast<int64_t>(errno) : rc;
+}
+
+int64_t result_of(const std::error_code& ec) {
+    return ec ? -static_cast<int64_t>(ec.value() ? ec.value() : EIO) : 0;
+}
+
+std::error_code error_of(int64_t result) {
+    return std::error_code(static_cast<int>(-result), std::generic_category());
+}
+
+// 线程池后端：每个操作在池线程上执行阻塞调用，结果投递回io线程
+class PoolBackend : public Backend {
+private:
+    net::any_io_executor executor;
+    net::thread_pool pool;
+
+public:
+    PoolBackend(net::any_io_executor executor, size_t threads)
+        : executor(std::move(executor)), pool(threads) {
+    }
+    
+    // 等待已提交的写入完成再退出
+    ~PoolBackend() override {
+        pool.join();
+    }
+    
+    const char* name() const override { return "thread_pool"; }
+    
+    void run_blocking(std::function<int64_t()> task, Completion completion) override {
+        // 操作未完成前io_context视为有未完成的工作
+        auto work = net::prefer(executor, net::execution::outstanding_work.tracked);
+        net::post(pool, [work = std::move(work), task = std::move(task), completion = std::move(completion)]() mutable {
+            int64_t result = task();
+            net::post(work, [completion = std::move(completion), result] {
+                completion(result);
+            });
+        });
+    }
+    
+    void stat_size(const std::string& path, Completion completion) override {
+        run_blocking([path] {
+            std::error_code ec;
+            auto status = std::filesystem::status(path, ec);
+            if (status.type() == std::filesystem::file_type::not_found) {
+                return -static_cast<int64_t>(ENOENT);
+            }
+            if (ec) {
+                return result_of(ec);
+            }
+            if (!std::filesystem::is_regular_file(status)) {
+                return -static_cast<int64_t>(EISDIR);
+            }
+            auto size = std::filesystem::file_size(path, ec);
+            return ec ? result_of(ec) : static_cast<int64_t>(size);
+        }, std::move(completion));
+    }
+    
+    void open(const std::string& path, int flags, int mode, Completion completion) override {
+        run_blocking([path, flags, mode] {
+            return result_of(sys_open(path.c_str(), flags, mode));
+        }, std::move(completion));
+    }
+    
+    void read(int fd, char* buffer, size_t length, uint64_t offset, Completion completion) override {
+        run_blocking([fd, buffer, length, offset] {
+            return result_of(sys_pread(fd, buffer, length, offset));
+        }, std::move(completion));
+    }
+    
+    void write(int fd, const char* buffer, size_t length, uint64_t offset, Completion completion) override {
+        run_blocking([fd, buffer, length, offset] {
+            return result_of(sys_pwrite(fd, buffer, length, offset));
+        }, std::move(completion));
+    }
+    
+    void fsync(int fd, Completion completion) override {
+        run_blocking([fd] {
+            return result_of(sys_fsync(fd));
+        }, std::move(completion));
+    }
+    
+    void close(int fd, Completion completion) override {
+        run_blocking([fd] {
+            return result_of(sys_close(fd));
+        }, std::move(completion));
+    }
+};
+
+#ifdef COMMENTFREE_HAVE_LIBURING
+// io_uring后端：提交和收割都在io线程上，内核完成后通过注册的eventfd唤醒Asio
+// 须在事件循环停止后析构
+class UringBackend : public Backend {
+private:
+    struct Request {
+        Completion completion;
+        std::string path;               // openat/statx期间路径须保持有效
+        struct statx stat_buffer{};
+        bool want_size = false;
+    };
+    
+    static constexpr unsigned queue_depth = 256;
+    
+    io_uring ring{};
+    net::posix::stream_descriptor notifier;
+    PoolBackend blocking;
+    bool ready = false;
+
+public:
+    UringBackend(net::any_io_executor executor, size_t blocking_threads)
+        : notifier(executor), blocking(executor, blocking_threads) {
+        int rc = io_uring_queue_init(queue_depth, &ring, 0);
+        if (rc < 0) {
+            std::cerr << "io_uring初始化失败: " << std::strerror(-rc) << std::endl;
+            return;
+        }
+        
+        int event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd < 0 || io_uring_register_eventfd(&ring, event_fd) < 0) {
+            std::cerr << "io_uring注册eventfd失败" << std::endl;
+            if (event_fd >= 0) {
+                ::close(event_fd);
+            }
+            io_uring_queue_exit(&ring);
+            return;
+        }
+        
+        notifier.assign(event_fd);
+        ready = true;
+        wait_for_completions();
+    }
+    
+    ~UringBackend() override {
+        if (ready) {
+            boost::system::error_code ec;
+            notifier.close(ec);
+            io_uring_queue_exit(&ring);
+        }
+    }
+    
+    bool is_ready() const { return ready; }
+    
+    const char* name() const override { return "io_uring"; }
+    
+    void run_blocking(std::function<int64_t()> task, Completion completion) override {
+        blocking.run_blocking(std::move(task), std::move(completion));
+    }
+    
+    void stat_size(const std::string& path, Completion completion) override {
+        auto request = std::make_unique<Request>();
+        request->path = path;
+        request->want_size = true;
+        submit(std::move(request), std::move(completion), [](io_uring_sqe* sqe, Request& r) {
+            io_uring_prep_statx(sqe, AT_FDCWD, r.path.c_str(), 0, STATX_TYPE | STATX_SIZE, &r.stat_buffer);
+        });
+    }
+    
+    void open(const std::string& path, int flags, int mode, Completion completion) override {
+        auto request = std::make_unique<Request>();
+        request->path = path;
+        submit(std::move(request), std::move(completion), [flags, mode](io_uring_sqe* sqe, Request& r) {
+            io_uring_prep_openat(sqe, AT_FDCWD, r.path.c_str(), flags, static_cast<mode_t>(mode));
+        });
+    }
+    
+    void read(int fd, char* buffer, size_t length, uint64_t offset, Completion completion) override {
+        unsigned chunk = static_cast<unsigned>(std::min<size_t>(length, 1u << 30));
+        submit(std::make_unique<Request>(), std::move(completion), [=](io_uring_sqe* sqe, Request&) {
+            io_uring_prep_read(sqe, fd, buffer, chunk, offset);
+        });
+    }
+    
+    void write(int fd, const char* buffer, size_t length, uint64_t offset, Completion completion) override {
+        unsigned chunk = static_cast<unsigned>(std::min<size_t>(length, 1u << 30));
+        submit(std::make_unique<Request>(), std::move(completion), [=](io_uring_sqe* sqe, Request&) {
+            io_uring_prep_write(sqe, fd, buffer, chunk, offset);
+        });
+    }
+    
+    void fsync(int fd, Completion completion) override {
+        submit(std::make_unique<Request>(), std::move(completion), [fd](io_uring_sqe* sqe, Request&) {
+            io_uring_prep_fsync(sqe, fd, 0);
+        });
+    }
+    
+    void close(int fd, Completion completion) override {
+        submit(std::make_unique<Request>(), std::move(completion), [fd](io_uring_sqe* sqe, Request&) {
+            io_uring_prep_close(sqe, fd);
+        });
+    }
+
+private:
+    template<class Prepare>
+    void submit(std::unique_ptr<Request> request, Completion completion, Prepare prepare) {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        if (!sqe) {
+            // 提交队列满：先把已排队的提交给内核再取
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        if (!sqe) {
+            net::post(notifier.get_executor(), [completion = std::move(completion)] {
+                completion(-EAGAIN);
+            });
+            return;
+        }
+        
+        request->completion = std::move(completion);
+        prepare(sqe, *request);
+        io_uring_sqe_set_data(sqe, request.release());
+        io_uring_submit(&ring);
+    }
+    
+    void wait_for_completions() {
+        notifier.async_wait(net::posix::descriptor_base::wait_read, [this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            uint64_t count = 0;
+            [[maybe_unused]] auto n = ::read(notifier.native_handle(), &count, sizeof(count));
+            reap();
+            wait_for_completions();
+        });
+    }
+    
+    void reap() {
+        io_uring_cqe* cqe = nullptr;
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            std::unique_ptr<Request> request(static_cast<Request*>(io_uring_cqe_get_data(cqe)));
+            int64_t result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            
+            if (result >= 0 && request->want_size) {
+                result = S_ISREG(request->stat_buffer.stx_mode)
+                    ? static_cast<int64_t>(request->stat_buffer.stx_size) : -static_cast<int64_t>(EISDIR);
+            }
+            request->completion(result);
+        }
+    }
+};
+#endif
+
+// 读整个文件的状态：stat -> open -> 循环read -> close
+struct ReadState {
+    Backend* backend;
+    std::string path;
+    std::string content;
+    int fd = -1;
+    size_t filled = 0;
+    FileIo::ReadHandler handler;
+};
+
+void finish_read(const std::shared_ptr<ReadState>& state, std::error_code ec) {
+    if (state->fd >= 0) {
+        state->backend->close(state->fd, [](int64_t) {});
+        state->fd = -1;
+    }
+    state->handler(ec, ec ? std::string() : std::move(state->content));
+}
+
+void read_chunk(const std::shared_ptr<ReadState>& state) {
+    if (state->filled == state->content.size()) {
+        return finish_read(state, {});
+    }
+    
+    state->backend->read(state->fd, state->content.data() + state->filled, state->content.size() - state->filled,
+                         state->filled, [state](int64_t n) {
+        if (n < 0) {
+            return finish_read(state, error_of(n));
+        }
+        if (n == 0) {
+            // 读取期间文件被截断
+            state->content.resize(state->filled);
+            return finish_read(state, {});
+        }
+        state->filled += static_cast<size_t>(n);
+        read_chunk(state);
+    });
+}
+
+// 保存文件的状态：open临时文件 -> 循环write -> fsync -> close -> 链接到最终路径
+struct StoreState {
+    Backend* backend;
+    std::string path;
+    std::string temp_path;
+    std::shared_ptr<const std::string> content;
+    int fd = -1;
+    size_t written = 0;
+    bool replace = false;       // 覆盖已有文件（快照等可变文件），而不是按内容去重
+    FileIo::StoreHandler handler;
+};
+
+void fail_store(const std::shared_ptr<StoreState>& state, std::error_code ec) {
+    std::cerr << "保存文件失败: " << state->path << ": " << ec.message() << std::endl;
+    if (state->fd >= 0) {
+        state->backend->close(state->fd, [](int64_t) {});
+        state->fd = -1;
+    }
+    state->backend->run_blocking([temp_path = state->temp_path] {
+        std::error_code remove_ec;
+        std::filesystem::remove(temp_path, remove_ec);
+        return int64_t{0};
+    }, [](int64_t) {});
+    state->handler(ec, false);
+}
+
+void publish_store(const std::shared_ptr<StoreState>& state) {
+    if (state->replace) {
+        // rename原子替换，读者要么看到旧文件要么看到完整的新文件
+        state->backend->run_blocking([path = state->path, temp_path = state->temp_path] {
+            std::error_code ec;
+            std::filesystem::rename(temp_path, path, ec);
+            return result_of(ec);
+        }, [state](int64_t result) {
+            if (result < 0) {
+                return fail_store(state, error_of(result));
+            }
+            state->handler({}, false);
+        });
+        return;
+    }
+    
+    // 硬链接在目标已存在时失败，天然区分"新内容"和"重复内容"，不会覆盖已有文件
+    // 文件系统不支持硬链接时退回 存在检查 + rename
+    state->backend->run_blocking([path = state->path, temp_path = state->temp_path] {
+        std::error_code ec;
+        int64_t result = 0;
+        std::filesystem::create_hard_link(temp_path, path, ec);
+        if (ec == std::errc::file_exists) {
+            result = 1;
+        } else if (ec) {
+            if (std::filesystem::exists(path, ec)) {
+                result = 1;
+            } else {
+                std::filesystem::rename(temp_path, path, ec);
+                return result_of(ec);
+            }
+        }
+        if (result == 1) {
+            // 复用已有文件：刷新修改时间，入库前不会被当作无人引用的文件清理掉
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        }
+        std::filesystem::remove(temp_path, ec);
+        return result;
+    }, [state](int64_t result) {
+        if (result < 0) {
+            return fail_store(state, error_of(result));
+        }
+        state->handler({}, result == 1);
+    });
+}
+
+void write_chunk(const std::shared_ptr<StoreState>& state) {
+    if (state->written == state->content->size()) {
+        // 先落盘再关闭、链接，崩溃后不会留下内容不完整的最终文件
+        state->backend->fsync(state->fd, [state](int64_t rc) {
+            if (rc < 0) {
+                return fail_store(state, error_of(rc));
+            }
+            int fd = state->fd;
+            state->fd = -1;
+            state->backend->close(fd, [state](int64_t rc) {
+                if (rc < 0) {
+                    return fail_store(state, error_of(rc));
+                }
+                publish_store(state);
+            });
+        });
+        return;
+    }
+    
+    state->backend->write(state->fd, state->content->data() + state->written,
+                          state->content->size() - state->written, state->written, [state](int64_t n) {
+        if (n < 0) {
+            return fail_store(state, error_of(n));
+        }
+        if (n == 0) {
+            return fail_store(state, std::make_error_code(std::errc::io_error));
+        }
+        state->written += static_cast<size_t>(n);
+        write_chunk(state);
+    });
+}
+
+} // namespace
+
+FileIo::FileIo(net::any_io_executor executor, size_t blocking_threads)
+    : executor(executor) {
+#ifdef COMMENTFREE_HAVE_LIBURING
+    auto uring = std::make_unique<UringBackend>(executor, blocking_threads);
+    if (uring->is_ready()) {
+        backend = std::move(uring);
+    } else {
+        std::cerr << "io_uring不可用，文件I/O退回线程池" << std::endl;
+    }
+#endif
+    if (!backend) {
+        backend = std::make_unique<PoolBackend>(executor, blocking_threads);
+    }
+}
+
+FileIo::~FileIo() = default;
+
+void FileIo::async_read_file(const std::string& path, size_t max_size, ReadHandler handler) {
+    auto state = std::make_shared<ReadState>();
+    state->backend = backend.get();
+    state->path = path;
+    state->handler = std::move(handler);
+    
+    backend->stat_size(path, [state, max_size](int64_t size) {
+        if (size < 0) {
+            return state->handler(error_of(size), std::string());
+        }
+        if (static_cast<uint64_t>(size) > max_size) {
+            return state->handler(std::make_error_code(std::errc::file_too_large), std::string());
+        }
+        
+        state->content.resize(static_cast<size_t>(size));
+        state->backend->open(state->path, read_flags, 0, [state](int64_t fd) {
+            if (fd < 0) {
+                return state->handler(error_of(fd), std::string());
+            }
+            state->fd = static_cast<int>(fd);
+            read_chunk(state);
+        });
+    });
+}
+
+void FileIo::async_store_file(const std::string& path, std::shared_ptr<const std::string> content,
+                              StoreHandler handler) {
+    start_store(path, std::move(content), false, std::move(handler));
+}
+
+void FileIo::async_replace_file(const std::string& path, std::shared_ptr<const std::string> content,
+                                std::function<void(std::error_code)> handler) {
+    start_store(path, std::move(content), true, [handler = std::move(handler)](std::error_code ec, bool) {
+        handler(ec);
+    });
+}
+
+net::awaitable<std::tuple<std::error_code, std::string>> FileIo::read_file(const std::string& path,
+                                                                          size_t max_size) {
+    return coro::from_callback<void(std::error_code, std::string)>([this, path, max_size](auto done) {
+        async_read_file(path, max_size, done);
+    });
+}
+
+void FileIo::start_store(const std::string& path, std::shared_ptr<const std::string> content, bool replace,
+                         StoreHandler handler) {
+    auto state = std::make_shared<StoreState>();
+    state->replace = replace;
+    state->backend = backend.get();
+    state->path = path;
+    state->temp_path = path + "." + std::to_string(++temp_counter) + ".part";   // 同目录，保证能硬链接
+    state->content = std::move(content);
+    state->handler = std::move(handler);
+    
+    std::string dir = std::filesystem::path(path).parent_path().string();
+    ensure_directory(dir, [state](std::error_code ec) {
+        if (ec) {
+            return state->handler(ec, false);
+        }
+        state->backend->open(state->temp_path, create_flags, create_mode, [state](int64_t fd) {
+            if (fd < 0) {
+                return fail_store(state, error_of(fd));
+            }
+            state->fd = static_cast<int>(fd);
+            write_chunk(state);
+        });
+    });
+}
+
+void FileIo::ensure_directory(const std::string& dir, std::function<void(std::error_code)> next) {
+    if (dir.empty() || known_directories.count(dir)) {
+        return next({});
+    }
+    
+    backend->run_blocking([dir] {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        return result_of(ec);
+    }, [this, dir, next = std::move(next)](int64_t rc) {
+        if (rc < 0) {
+            return next(error_of(rc));
+        }
+        known_directories.insert(dir);
+        next({});
+    });
+}
+
+} // namespace fileio
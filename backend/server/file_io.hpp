@@ -0,0 +1,83 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <unordered_set>
+
+namespace fileio {
+
+// 底层操作的完成回调：结果>=0为成功（字节数/fd/文件大小），<0为-errno
+using Completion = std::function<void(int64_t result)>;
+
+// 文件I/O后端：所有方法只能在io线程上调用，完成回调也投递回io线程
+class Backend {
+public:
+    virtual ~Backend() = default;
+    virtual const char* name() const = 0;
+    
+    // 普通文件的大小（不是普通文件时返回-EISDIR）
+    virtual void stat_size(const std::string& path, Completion completion) = 0;
+    virtual void open(const std::string& path, int flags, int mode, Completion completion) = 0;
+    virtual void read(int fd, char* buffer, size_t length, uint64_t offset, Completion completion) = 0;
+    virtual void write(int fd, const char* buffer, size_t length, uint64_t offset, Completion completion) = 0;
+    virtual void fsync(int fd, Completion completion) = 0;
+    virtual void close(int fd, Completion completion) = 0;
+    
+    // 建目录、改链接等元数据操作在辅助线程上同步执行
+    virtual void run_blocking(std::function<int64_t()> task, Completion completion) = 0;
+};
+
+// 异步文件I/O：Linux上优先io_uring（完成通知经eventfd接入Asio事件循环），
+// 不可用时退回线程池执行阻塞系统调用；网络线程上不再有阻塞的文件操作
+class FileIo {
+public:
+    using ReadHandler = std::function<void(std::error_code ec, std::string content)>;
+    using StoreHandler = std::function<void(std::error_code ec, bool deduplicated)>;
+
+private:
+    boost::asio::any_io_executor executor;
+    std::unique_ptr<Backend> backend;
+    std::unordered_set<std::string> known_directories;   // 已确认存在的目录，避免重复建目录
+    uint64_t temp_counter = 0;
+
+public:
+    FileIo(boost::asio::any_io_executor executor, size_t blocking_threads = 2);
+    ~FileIo();
+    FileIo(const FileIo&) = delete;
+    FileIo& operator=(const FileIo&) = delete;
+    
+    // 实际使用的后端："io_uring" 或 "thread_pool"
+    const char* backend_name() const { return backend->name(); }
+    
+    // 读取整个普通文件，超过max_size时返回file_too_large
+    void async_read_file(const std::string& path, size_t max_size, ReadHandler handler);
+    
+    // 内容寻址保存：写同目录临时文件并fsync，再硬链接到最终路径
+    // 最终路径已存在（相同内容）时丢弃临时文件，deduplicated为true
+    void async_store_file(const std::string& path, std::shared_ptr<const std::string> content,
+                          StoreHandler handler);
+    
+    // 整体替换文件：写临时文件并fsync，再rename覆盖最终路径
+    void async_replace_file(const std::string& path, std::shared_ptr<const std::string> content,
+                            std::function<void(std::error_code)> handler);
+    
+    // async_read_file的协程版本（在io线程的协程里co_await），得到 (ec, content)
+    boost::asio::awaitable<std::tuple<std::error_code, std::string>> read_file(const std::string& path,
+                                                                               size_t max_size);
+
+private:
+    void start_store(const std::string& path, std::shared_ptr<const std::string> content, bool replace,
+                     StoreHandler handler);
+    void ensure_directory(const std::string& dir, std::function<void(std::error_code)> next);
+};
+
+// 全局文件I/O（定义于main.cpp，为空时各处退回同步读写）
+extern std::shared_ptr<FileIo> g_file_io;
+
+} // namespace fileio
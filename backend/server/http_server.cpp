@@ -1,7 +1,14 @@
 #include "http_server.hpp"
 #include "routes.hpp"
+#include "live_hub.hpp"
+#include "load_shedder.hpp"
+#include "rate_limiter.hpp"
+#include "utils.hpp"
+#include "coro.hpp"
+#include <boost/asio/co_spawn.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <iostream>
 #include <memory>
@@ -14,94 +21,72 @@ using tcp = net::ip::tcp;
 
 namespace server {
 
-// MIME类型映射
-std::string mime_type(const std::string& path) {
-    using beast::iequals;
-    auto const ext = [&path] {
-        auto const pos = path.rfind(".");
-        if (pos == std::string::npos)
-            return std::string{};
-        return path.substr(pos);
-    }();
-    
-    if (iequals(ext, ".htm"))  return "text/html";
-    if (iequals(ext, ".html")) return "text/html";
-    if (iequals(ext, ".php"))  return "text/html";
-    if (iequals(ext, ".css"))  return "text/css";
-    if (iequals(ext, ".txt"))  return "text/plain";
-    if (iequals(ext, ".js"))   return "application/javascript";
-    if (iequals(ext, ".json")) return "application/json";
-    if (iequals(ext, ".xml"))  return "application/xml";
-    if (iequals(ext, ".swf"))  return "application/x-shockwave-flash";
-    if (iequals(ext, ".flv"))  return "video/x-flv";
-    if (iequals(ext, ".png"))  return "image/png";
-    if (iequals(ext, ".jpe"))  return "image/jpeg";
-    if (iequals(ext, ".jpeg")) return "image/jpeg";
-    if (iequals(ext, ".jpg"))  return "image/jpeg";
-    if (iequals(ext, ".gif"))  return "image/gif";
-    if (iequals(ext, ".bmp"))  return "image/bmp";
-    if (iequals(ext, ".ico"))  return "image/vnd.microsoft.icon";
-    if (iequals(ext, ".tiff")) return "image/tiff";
-    if (iequals(ext, ".tif"))  return "image/tiff";
-    if (iequals(ext, ".svg"))  return "image/svg+xml";
-    if (iequals(ext, ".svgz")) return "image/svg+xml";
-    return "application/text";
-}
-
-// 路径连接
-std::string path_cat(const std::string& base, const std::string& path) {
-    if (base.empty())
-        return path;
-    std::string result = base;
-    if (result.back() != '/' && !path.empty() && path.front() != '/')
-        result.append("/");
-    result.append(path);
-    return result;
-}
-
-HttpServer::HttpServer(const std::string& address, unsigned short port, const std::string& doc_root)
-    : ioc{1}, acceptor{ioc}, doc_root(doc_root), port(port) {
+HttpServer::HttpServer(const std::string& address, unsigned short port, const std::string& doc_root,
+                       const SessionLimits& limits)
+    : ioc{1}, acceptor{ioc}, tls_acceptor{ioc}, doc_root(doc_root), port(port), limits(limits),
+      connections(std::make_shared<ConnectionTracker>(limits.max_connections)) {
     
+    if (!open_acceptor(acceptor, address, port)) {
+        return;
+    }
+    
+    std::cout << "HTTP服务器启动在 " << address << ":" << port << std::endl;
+    std::cout << "文档根目录: " << doc_root << std::endl;
+}
+
+bool HttpServer::open_acceptor(tcp::acceptor& target, const std::string& address, unsigned short listen_port) {
     beast::error_code ec;
     
     // 解析地址
     auto const addr = net::ip::make_address(address);
-    tcp::endpoint endpoint{addr, port};
+    tcp::endpoint endpoint{addr, listen_port};
     
     // 打开acceptor
-    acceptor.open(endpoint.protocol(), ec);
+    target.open(endpoint.protocol(), ec);
     if (ec) {
         std::cerr << "打开acceptor失败: " << ec.message() << std::endl;
-        return;
+        return false;
     }
     
     // 允许地址重用
-    acceptor.set_option(net::socket_base::reuse_address(true), ec);
+    target.set_option(net::socket_base::reuse_address(true), ec);
     if (ec) {
         std::cerr << "设置socket选项失败: " << ec.message() << std::endl;
-        return;
+        return false;
     }
     
     // 绑定到服务器地址
-    acceptor.bind(endpoint, ec);
+    target.bind(endpoint, ec);
     if (ec) {
         std::cerr << "绑定地址失败: " << ec.message() << std::endl;
-        return;
+        return false;
     }
     
     // 开始监听连接
-    acceptor.listen(net::socket_base::max_listen_connections, ec);
+    target.listen(net::socket_base::max_listen_connections, ec);
     if (ec) {
         std::cerr << "监听失败: " << ec.message() << std::endl;
-        return;
+        return false;
     }
+    return true;
+}
+
+bool HttpServer::listen_tls(const std::string& address, unsigned short tls_port,
+                            std::shared_ptr<tls::Context> context) {
+    if (!context || !open_acceptor(tls_acceptor, address, tls_port)) {
+        return false;
+    }
+    tls_context = std::move(context);
     
-    std::cout << "HTTP服务器启动在 " << address << ":" << port << std::endl;
-    std::cout << "文档根目录: " << doc_root << std::endl;
+    std::cout << "HTTPS服务器启动在 " << address << ":" << tls_port << std::endl;
+    return true;
 }
 
 void HttpServer::run() {
-    do_accept();
+    do_accept(acceptor, nullptr);
+    if (tls_context) {
+        do_accept(tls_acceptor, tls_context);
+    }
     ioc.run();
 }
 
@@ -109,96 +94,401 @@ void HttpServer::stop() {
     ioc.stop();
 }
 
-void HttpServer::do_accept() {
-    acceptor.async_accept(
-        [this](beast::error_code ec, tcp::socket socket) {
-            on_accept(ec, std::move(socket));
+void HttpServer::add_periodic_task(std::chrono::steady_clock::duration interval, std::function<void()> task) {
+    periodic_timers.push_back(std::make_unique<net::steady_timer>(ioc));
+    schedule_periodic(*periodic_timers.back(), interval, std::move(task));
+}
+
+void HttpServer::post(std::function<void()> task) {
+    net::post(ioc, [task = std::move(task)]() {
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "投递任务异常: " << e.what() << std::endl;
+        }
+    });
+}
+
+void HttpServer::schedule_periodic(net::steady_timer& timer, std::chrono::steady_clock::duration interval,
+                                   std::function<void()> task) {
+    timer.expires_after(interval);
+    timer.async_wait([this, &timer, interval, task = std::move(task)](beast::error_code ec) mutable {
+        if (ec) {
+            return;
+        }
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "周期任务异常: " << e.what() << std::endl;
+        }
+        schedule_periodic(timer, interval, std::move(task));
+    });
+}
+
+void HttpServer::do_accept(tcp::acceptor& source, std::shared_ptr<tls::Context> tls) {
+    source.async_accept(
+        [this, &source, tls](beast::error_code ec, tcp::socket socket) {
+            on_accept(ec, std::move(socket), tls);
+            
+            // 继续接受连接
+            do_accept(source, tls);
         });
 }
 
-void HttpServer::on_accept(beast::error_code ec, tcp::socket socket) {
+void HttpServer::on_accept(beast::error_code ec, tcp::socket socket, std::shared_ptr<tls::Context> tls) {
     if (ec) {
         std::cerr << "接受连接失败: " << ec.message() << std::endl;
+    } else if ((g_load_shedder && g_load_shedder->should_shed_connection()) || !connections->make_room()) {
+        // 过载或连接数已满且没有可回收的空闲连接时，新连接直接返回503
+        std::make_shared<HttpSession>(std::move(socket), doc_root, limits, connections, tls)->shed();
     } else {
         // 创建新的会话并运行
-        std::make_shared<HttpSession>(std::move(socket), doc_root)->run();
+        std::make_shared<HttpSession>(std::move(socket), doc_root, limits, connections, tls)->run();
+    }
+}
+
+// ConnectionTracker实现
+ConnectionTracker::handle ConnectionTracker::add(std::weak_ptr<HttpSession> session) {
+    return sessions.insert(sessions.end(), std::move(session));
+}
+
+void ConnectionTracker::touch(handle h) {
+    sessions.splice(sessions.end(), sessions, h);
+}
+
+void ConnectionTracker::remove(handle h) {
+    sessions.erase(h);
+}
+
+bool ConnectionTracker::make_room() {
+    if (sessions.size() < max_connections) {
+        return true;
     }
     
-    // 继续接受连接
-    do_accept();
+    // 从最久未活动的一端找空闲连接，正在处理请求的连接不回收
+    for (auto it = sessions.begin(); it != sessions.end(); ++it) {
+        auto session = it->lock();
+        if (session && session->is_idle()) {
+            session->evict();
+            return true;
+        }
+    }
+    return false;
 }
 
 // HttpSession实现
-HttpSession::HttpSession(tcp::socket&& socket, const std::string& doc_root)
-    : socket_(std::move(socket)), doc_root_(doc_root) {
+HttpSession::HttpSession(tcp::socket&& socket, const std::string& doc_root, const SessionLimits& limits,
+                         std::shared_ptr<ConnectionTracker> tracker, std::shared_ptr<tls::Context> tls)
+    : stream_(std::move(socket)), doc_root_(doc_root), limits_(limits), tracker_(std::move(tracker)),
+      response_ready_(stream_.get_executor()), queue_space_(stream_.get_executor()) {
+    if (tls) {
+        tls_ = std::make_unique<tls::Stream>(stream_.socket(), std::move(tls));
+    }
+    
+    beast::error_code ec;
+    auto endpoint = stream_.socket().remote_endpoint(ec);
+    if (!ec) {
+        remote_address_ = endpoint.address().to_string();
+    }
+}
+
+HttpSession::~HttpSession() {
+    if (tracker_handle_) {
+        tracker_->remove(*tracker_handle_);
+    }
 }
 
 void HttpSession::run() {
-    do_read();
+    tracker_handle_ = tracker_->add(weak_from_this());
+    
+    // 协程的完成回调持有会话，读写协程和所有处理协程都结束后会话才释放
+    net::co_spawn(stream_.get_executor(), read_loop(), [self = shared_from_this()](std::exception_ptr e) {
+        if (e) {
+            std::cerr << "读取请求协程异常退出" << std::endl;
+            self->stop_reading();
+        }
+    });
+    start_writer();
+}
+
+void HttpSession::start_writer() {
+    net::co_spawn(stream_.get_executor(), write_loop(), [self = shared_from_this()](std::exception_ptr e) {
+        if (e) {
+            std::cerr << "写入响应协程异常退出" << std::endl;
+            self->read_closed_ = true;
+            self->stream_.close();
+        }
+    });
 }
 
-void HttpSession::do_read() {
-    req_ = {};
+void HttpSession::evict() {
+    tracker_->remove(*tracker_handle_);
+    tracker_handle_.reset();
     
-    http::async_read(socket_, buffer_, req_,
-        [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
-            self->on_read(ec, bytes_transferred);
-        });
+    // 关闭后挂起的读操作以operation_aborted结束，会话随之释放
+    stream_.close();
+}
+
+void HttpSession::shed() {
+    // 过载时不值得为503做一次TLS握手，直接关闭
+    if (tls_) {
+        stream_.close();
+        return;
+    }
+    send_rejection(http::status::service_unavailable, 1, "服务器繁忙，请稍后再试");
+    start_writer();
 }
 
-void HttpSession::on_read(beast::error_code ec, std::size_t bytes_transferred) {
-    boost::ignore_unused(bytes_transferred);
+net::awaitable<void> HttpSession::read_loop() {
+    beast::error_code ec;
     
-    if (ec == http::error::end_of_stream) {
-        return do_close();
+    // HTTPS连接先完成握手（受读请求头的时限约束）；失败多为扫描器和不匹配的客户端，只计数不输出
+    if (tls_) {
+        expires_after(limits_.read_header_timeout);
+        co_await tls_->async_handshake(net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
+            stream_.close();
+            stop_reading();
+            co_return;
+        }
     }
     
-    if (ec) {
-        std::cerr << "读取请求失败: " << ec.message() << std::endl;
-        return;
+    while (!read_closed_) {
+        // 待写响应过多时暂停预读，写出一部分后再恢复
+        if (write_queue_.size() >= max_pipelined) {
+            co_await coro::wait(queue_space_);
+            continue;
+        }
+        
+        // 先只读请求头，限流判断通过后再读请求体
+        http::request_parser<http::string_body> parser;
+        idle_ = true;
+        
+        // 新连接限时读完请求头；keep-alive连接限时等待下一个请求
+        // 有响应正在写时沿用写超时，写完后再切换
+        if (!writing_) {
+            expires_after(first_request_ ? limits_.read_header_timeout : limits_.idle_timeout);
+        }
+        
+        co_await (tls_ ? http::async_read_header(*tls_, buffer_, parser, net::redirect_error(net::use_awaitable, ec))
+                       : http::async_read_header(stream_, buffer_, parser, net::redirect_error(net::use_awaitable, ec)));
+        
+        if (ec == http::error::end_of_stream || ec == beast::error::timeout) {
+            break;
+        }
+        
+        if (ec == net::error::operation_aborted) {
+            read_closed_ = true;
+            response_ready_.cancel();
+            co_return;
+        }
+        
+        if (ec) {
+            std::cerr << "读取请求头失败: " << ec.message() << std::endl;
+            break;
+        }
+        
+        idle_ = false;
+        first_request_ = false;
+        if (tracker_handle_) {
+            tracker_->touch(*tracker_handle_);
+        }
+        
+        std::string target(parser.get().target());
+        RouteClass route = RateLimiter::classify(target);
+        
+        // 按客户端IP和路由类别限流
+        if (g_rate_limiter) {
+            int retry_after = 1;
+            if (!g_rate_limiter->allow(remote_address_, route, retry_after)) {
+                send_rejection(http::status::too_many_requests, retry_after, "请求过于频繁，请稍后再试",
+                               parser.get().version());
+                co_return;
+            }
+        }
+        
+        // 在途请求超出上限时拒绝，名额在响应写完后归还
+        LoadShedder::Ticket ticket;
+        if (g_load_shedder && !g_load_shedder->try_acquire(route, ticket)) {
+            send_rejection(http::status::service_unavailable, 1, "服务器繁忙，请稍后再试", parser.get().version());
+            co_return;
+        }
+        
+        if (!writing_) {
+            expires_after(limits_.read_body_timeout);
+        }
+        co_await (tls_ ? http::async_read(*tls_, buffer_, parser, net::redirect_error(net::use_awaitable, ec))
+                       : http::async_read(stream_, buffer_, parser, net::redirect_error(net::use_awaitable, ec)));
+        
+        if (ec == http::error::end_of_stream || ec == beast::error::timeout) {
+            // 请求体读取超时，连接上的剩余数据无法解析，写完已有响应后关闭
+            break;
+        }
+        
+        if (ec) {
+            std::cerr << "读取请求失败: " << ec.message() << std::endl;
+            break;
+        }
+        
+        http::request<http::string_body> req = parser.release();
+        
+        // 实时计数订阅：/api/live/<id> 升级为WebSocket，连接交给LiveSession
+        // 前面还有未写完的响应时不能移交连接，按普通请求处理
+        std::string live_path = beast::websocket::is_upgrade(req) ? std::string(req.target()) : std::string();
+        live_path = live_path.substr(0, live_path.find('?'));
+        if (live_path.starts_with("/api/live/")) {
+            // HTTPS连接只有内核双向接管加解密时才能把套接字交出去；否则明确拒绝，前端收到后退避并最终放弃
+            if (tls_ && !(tls_->ktls_send() && tls_->ktls_recv())) {
+                send_rejection(http::status::not_implemented, 0, "当前连接不支持实时推送", req.version());
+                co_return;
+            }
+            std::string id = live_path.substr(10);
+            if (write_queue_.empty() && !id.empty() && id.size() <= 16) {
+                read_closed_ = true;
+                response_ready_.cancel();
+                stream_.expires_never();
+                tls_.reset();
+                std::make_shared<LiveSession>(stream_.release_socket(), std::move(id))->run(std::move(req));
+                co_return;
+            }
+        }
+        
+        // 经事件循环排队后再处理，排队时延作为过载信号
+        auto enqueued = LoadShedder::clock::now();
+        co_await net::post(stream_.get_executor(), net::use_awaitable);
+        if (g_load_shedder) {
+            g_load_shedder->record_queue_delay(LoadShedder::clock::now() - enqueued);
+        }
+        
+        // 客户端要求关闭（或HTTP/1.0未要求保持）时，响应写完后关闭连接
+        bool keep_alive = req.keep_alive();
+        
+        // 先按请求顺序占位，处理协程完成后再填入；同时继续读取流水线中的下一个请求
+        // deque只在两端增删，占位元素的引用在写出前一直有效
+        write_queue_.push_back(PendingResponse{std::nullopt, !keep_alive, std::move(ticket)});
+        net::co_spawn(stream_.get_executor(), handle_request(std::move(req), &write_queue_.back()),
+            [self = shared_from_this()](std::exception_ptr e) {
+                if (e) {
+                    // 响应无法生成，队列卡在这个位置，只能关闭连接
+                    std::cerr << "请求处理协程异常退出" << std::endl;
+                    self->read_closed_ = true;
+                    self->stream_.close();
+                    self->response_ready_.cancel();
+                }
+            });
+        
+        if (!keep_alive) {
+            read_closed_ = true;
+        }
     }
     
-    // 处理请求
-    auto response = handle_request(std::move(req_));
+    stop_reading();
+}
+
+net::awaitable<void> HttpSession::handle_request(http::request<http::string_body> req, PendingResponse* slot) {
+    // 创建路由处理器实例（这里需要传入数据库管理器实例）
+    // 注意：在实际应用中，应该在服务器启动时创建数据库连接
+    extern std::shared_ptr<db::DatabaseManager> g_db_manager;
+    routes::RouteHandler handler(g_db_manager, "uploads");
     
-    // 发送响应
-    beast::async_write(socket_, std::move(response),
-        [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
-            self->on_write(false, ec, bytes_transferred);
-        });
+    slot->message.emplace(co_await handler.handle_request(req, doc_root_, remote_address_));
+    response_ready_.cancel();
 }
 
-void HttpSession::on_write(bool close, beast::error_code ec, std::size_t bytes_transferred) {
-    boost::ignore_unused(bytes_transferred);
+net::awaitable<void> HttpSession::write_loop() {
+    beast::error_code ec;
     
-    if (ec) {
-        std::cerr << "写入响应失败: " << ec.message() << std::endl;
-        return;
+    while (true) {
+        // 队首响应还在处理中时等它就绪；不再读取且队列已空（或连接已关闭）时结束
+        if (write_queue_.empty() || !write_queue_.front().message) {
+            if ((read_closed_ && write_queue_.empty()) || !stream_.socket().is_open()) {
+                break;
+            }
+            co_await coro::wait(response_ready_);
+            continue;
+        }
+        
+        writing_ = true;
+        expires_after(limits_.read_body_timeout);
+        auto& message = *write_queue_.front().message;
+        co_await (tls_ ? beast::async_write(*tls_, std::move(message), net::redirect_error(net::use_awaitable, ec))
+                       : beast::async_write(stream_, std::move(message), net::redirect_error(net::use_awaitable, ec)));
+        
+        // 响应已发出，归还在途名额；队列有空位，恢复读取下一个请求
+        writing_ = false;
+        bool close = write_queue_.front().close;
+        write_queue_.pop_front();
+        queue_space_.cancel();
+        
+        if (ec) {
+            std::cerr << "写入响应失败: " << ec.message() << std::endl;
+            
+            // 连接已不可用，取消挂起的读操作
+            read_closed_ = true;
+            stream_.close();
+            co_return;
+        }
+        
+        if (close) {
+            read_closed_ = true;
+            break;
+        }
+        
+        if (tracker_handle_) {
+            tracker_->touch(*tracker_handle_);
+        }
+        
+        if (write_queue_.empty() && idle_ && !read_closed_) {
+            expires_after(first_request_ ? limits_.read_header_timeout : limits_.idle_timeout);
+        }
     }
     
-    if (close) {
-        return do_close();
+    do_close();
+}
+
+void HttpSession::expires_after(std::chrono::steady_clock::duration timeout) {
+    if (tls_) {
+        tls_->expires_after(timeout);
+    } else {
+        stream_.expires_after(timeout);
     }
-    
-    // 读取下一个请求
-    do_read();
 }
 
-void HttpSession::do_close() {
-    beast::error_code ec;
-    socket_.shutdown(tcp::socket::shutdown_send, ec);
+void HttpSession::stop_reading() {
+    // 已读取的请求仍要写完响应，写协程写完最后一个响应后关闭
+    read_closed_ = true;
+    response_ready_.cancel();
 }
 
-template<class Body, class Allocator>
-http::message_generator HttpSession::handle_request(
-    http::request<Body, http::basic_fields<Allocator>>&& req) {
-    
-    // 创建路由处理器实例（这里需要传入数据库管理器实例）
-    // 注意：在实际应用中，应该在服务器启动时创建数据库连接
-    extern std::shared_ptr<db::DatabaseManager> g_db_manager;
-    routes::RouteHandler handler(g_db_manager, "uploads");
+void HttpSession::queue_response(http::message_generator response, bool close) {
+    write_queue_.push_back(PendingResponse{std::move(response), close, LoadShedder::Ticket()});
+    response_ready_.cancel();
+}
+
+void HttpSession::send_rejection(http::status status, int retry_after, const std::string& message,
+                                 unsigned version) {
+    http::response<http::string_body> res{status, version};
+    res.set(http::field::server, "CommentFree/1.0");
+    res.set(http::field::content_type, "application/json");
+    if (retry_after > 0) {
+        res.set(http::field::retry_after, std::to_string(retry_after));
+    }
+    res.set(http::field::access_control_allow_origin, "*");
+    res.keep_alive(false);
+    res.body() = utils::JsonUtils::create_error_response(message);
+    res.prepare_payload();
     
-    return handler.handle_request(std::move(req), doc_root_);
+    // 请求（体）没有读取，连接无法复用，排在已有响应之后发送，然后关闭
+    read_closed_ = true;
+    queue_response(std::move(res), true);
+}
+
+void HttpSession::do_close() {
+    if (tls_) {
+        tls_->shutdown();
+    }
+    beast::error_code ec;
+    stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
 }
 
-} // namespace server
\ No newline at end of file
+} // namespace server
@@ -3,10 +3,20 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/asio/awaitable.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/config.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <list>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
+#include "load_shedder.hpp"
+#include "tls.hpp"
 
 namespace http = boost::beast::http;
 namespace net = boost::asio;
@@ -14,16 +24,55 @@ using tcp = net::ip::tcp;
 
 namespace server {
 
+class HttpSession;
+
+// 会话超时与连接数限制
+struct SessionLimits {
+    std::chrono::seconds read_header_timeout{10};   // 新连接读取首个请求头的时限
+    std::chrono::seconds read_body_timeout{30};     // 读取请求体、写入响应的时限
+    std::chrono::seconds idle_timeout{60};          // keep-alive连接等待下一个请求的时限
+    size_t max_connections = 10000;
+};
+
+// 连接跟踪：按最近活动排序，连接数达到上限时关闭最久未活动的空闲连接
+// 只在io线程上访问
+class ConnectionTracker {
+public:
+    using handle = std::list<std::weak_ptr<HttpSession>>::iterator;
+    
+private:
+    std::list<std::weak_ptr<HttpSession>> sessions;  // 头部为最久未活动
+    size_t max_connections;
+    
+public:
+    explicit ConnectionTracker(size_t max_connections) : max_connections(max_connections) {}
+    
+    handle add(std::weak_ptr<HttpSession> session);
+    void touch(handle h);
+    void remove(handle h);
+    
+    // 是否还能接受新连接；已满时尝试关闭一个空闲连接，没有可关闭的返回false
+    bool make_room();
+    
+    size_t size() const { return sessions.size(); }
+};
+
 // HTTP请求处理器
 class HttpServer {
 private:
     net::io_context ioc;
     tcp::acceptor acceptor;
+    tcp::acceptor tls_acceptor;
+    std::shared_ptr<tls::Context> tls_context;
     std::string doc_root;
     unsigned short port;
+    SessionLimits limits;
+    std::shared_ptr<ConnectionTracker> connections;
+    std::vector<std::unique_ptr<net::steady_timer>> periodic_timers;
     
 public:
-    HttpServer(const std::string& address, unsigned short port, const std::string& doc_root);
+    HttpServer(const std::string& address, unsigned short port, const std::string& doc_root,
+               const SessionLimits& limits = SessionLimits());
     
     // 启动服务器
     void run();
@@ -31,38 +80,96 @@ public:
     // 停止服务器
     void stop();
     
+    // 注册周期任务（在io线程上执行，可安全访问数据库连接）
+    void add_periodic_task(std::chrono::steady_clock::duration interval, std::function<void()> task);
+    
+    // 把任务投递到io线程执行（供后台线程回写数据库、更新缓存）
+    void post(std::function<void()> task);
+    
+    // io线程的执行器（异步文件I/O的完成回调投递到这里）
+    net::any_io_executor executor() { return ioc.get_executor(); }
+    
+    // 当前HTTP连接数
+    size_t connection_count() const { return connections->size(); }
+    
+    // 另开一个HTTPS端口（在run之前调用），与HTTP端口共用连接数限制
+    bool listen_tls(const std::string& address, unsigned short tls_port, std::shared_ptr<tls::Context> context);
+    
 private:
-    // 接受连接
-    void do_accept();
+    bool open_acceptor(tcp::acceptor& target, const std::string& address, unsigned short listen_port);
+    
+    void schedule_periodic(net::steady_timer& timer, std::chrono::steady_clock::duration interval,
+                           std::function<void()> task);
+    
+    // 接受连接（tls非空时为HTTPS端口）
+    void do_accept(tcp::acceptor& source, std::shared_ptr<tls::Context> tls);
     
     // 处理HTTP会话
-    void on_accept(boost::beast::error_code ec, tcp::socket socket);
+    void on_accept(boost::beast::error_code ec, tcp::socket socket, std::shared_ptr<tls::Context> tls);
 };
 
-// HTTP会话处理
+// HTTP会话处理：读协程逐个读取请求并为每个请求启动处理协程，写协程按请求顺序写出响应
+// 两者与处理协程都运行在io线程上，通过写队列和信号定时器协作
 class HttpSession : public std::enable_shared_from_this<HttpSession> {
 private:
-    tcp::socket socket_;
+    // 按请求顺序排队的响应；message为空表示还在处理中（如等待数据库、文件I/O）
+    struct PendingResponse {
+        std::optional<http::message_generator> message;
+        bool close;
+        LoadShedder::Ticket ticket;
+    };
+    
+    // 流水线中最多积压的响应数
+    static constexpr size_t max_pipelined = 8;
+    
+    boost::beast::tcp_stream stream_;
+    std::unique_ptr<tls::Stream> tls_;  // HTTPS连接：在stream_的套接字上做TLS，超时也由它管理
     boost::beast::flat_buffer buffer_;
-    http::request<http::string_body> req_;
     std::string doc_root_;
+    std::string remote_address_;
+    SessionLimits limits_;
+    std::shared_ptr<ConnectionTracker> tracker_;
+    std::optional<ConnectionTracker::handle> tracker_handle_;
+    bool idle_ = false;             // 正在等待请求头
+    bool first_request_ = true;
+    std::deque<PendingResponse> write_queue_;
+    bool writing_ = false;
+    bool read_closed_ = false;      // 不再读取新请求
+    net::steady_timer response_ready_;  // 队首响应就绪或读取结束时唤醒写协程
+    net::steady_timer queue_space_;     // 写出响应、队列有空位时唤醒读协程
     
 public:
-    HttpSession(tcp::socket&& socket, const std::string& doc_root);
+    HttpSession(tcp::socket&& socket, const std::string& doc_root, const SessionLimits& limits,
+                std::shared_ptr<ConnectionTracker> tracker, std::shared_ptr<tls::Context> tls = nullptr);
+    ~HttpSession();
     
     // 开始会话
     void run();
     
+    // 是否处于空闲（等待请求头）状态，可被回收
+    bool is_idle() const { return idle_ && write_queue_.empty(); }
+    
+    // 连接数达到上限时被回收
+    void evict();
+    
+    // 过载时直接返回503并关闭
+    void shed();
+    
 private:
-    void do_read();
-    void on_read(boost::beast::error_code ec, std::size_t bytes_transferred);
-    void on_write(bool close, boost::beast::error_code ec, std::size_t bytes_transferred);
+    net::awaitable<void> read_loop();
+    net::awaitable<void> write_loop();
+    
+    // 处理一个请求，把响应填入它在写队列中的位置
+    net::awaitable<void> handle_request(http::request<http::string_body> req, PendingResponse* slot);
+    
+    void start_writer();
+    void expires_after(std::chrono::steady_clock::duration timeout);
+    void queue_response(http::message_generator response, bool close);
+    void stop_reading();
     void do_close();
     
-    // 处理请求
-    template<class Body, class Allocator>
-    http::message_generator handle_request(
-        http::request<Body, http::basic_fields<Allocator>>&& req);
+    // 直接拒绝请求（429/503等），排在已有响应之后发送，然后关闭连接；retry_after为0时不带Retry-After
+    void send_rejection(http::status status, int retry_after, const std::string& message, unsigned version = 11);
 };
 
 // MIME类型辅助函数
@@ -0,0 +1,137 @@
+#include "like_filter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace filter {
+
+namespace {
+
+// 64位混合函数（splitmix64）
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+RotatingBloomFilter::RotatingBloomFilter(size_t expected_items, double false_positive_rate,
+                                         clock::duration window)
+    : window(window), generation_start(clock::now()) {
+    // m = -n*ln(p)/ln(2)^2, k = m/n*ln(2)
+    double n = static_cast<double>(std::max<size_t>(expected_items, 1));
+    double ln2 = std::log(2.0);
+    double m = std::ceil(-n * std::log(false_positive_rate) / (ln2 * ln2));
+    
+    bit_count = std::max<size_t>(64, static_cast<size_t>(m));
+    hash_count = std::clamp<size_t>(static_cast<size_t>(std::round(m / n * ln2)), 1, 16);
+    
+    current.assign((bit_count + 63) / 64, 0);
+    previous.assign((bit_count + 63) / 64, 0);
+}
+
+void RotatingBloomFilter::rotate_if_needed(clock::time_point now) {
+    if (now - generation_start < window) {
+        return;
+    }
+    
+    // 超过两个窗口没有访问时，上一代也已过期
+    if (now - generation_start >= 2 * window) {
+        std::fill(previous.begin(), previous.end(), 0);
+    } else {
+        previous.swap(current);
+    }
+    std::fill(current.begin(), current.end(), 0);
+    generation_start = now;
+}
+
+bool RotatingBloomFilter::test(const std::vector<uint64_t>& bits, uint64_t key) const {
+    // 双重哈希：h1 + i*h2
+    uint64_t h1 = mix64(key);
+    uint64_t h2 = mix64(h1) | 1;
+    
+    for (size_t i = 0; i < hash_count; ++i) {
+        size_t bit = static_cast<size_t>((h1 + i * h2) % bit_count);
+        if (!(bits[bit / 64] & (1ULL << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RotatingBloomFilter::contains(uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    rotate_if_needed(clock::now());
+    return test(current, key) || test(previous, key);
+}
+
+void RotatingBloomFilter::insert(uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    rotate_if_needed(clock::now());
+    
+    uint64_t h1 = mix64(key);
+    uint64_t h2 = mix64(h1) | 1;
+    
+    for (size_t i = 0; i < hash_count; ++i) {
+        size_t bit = static_cast<size_t>((h1 + i * h2) % bit_count);
+        current[bit / 64] |= (1ULL << (bit % 64));
+    }
+}
+
+size_t RotatingBloomFilter::memory_bytes() const {
+    return (current.size() + previous.size()) * sizeof(uint64_t);
+}
+
+void RotatingBloomFilter::save(snapshot::Writer& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    out.put_u64(bit_count);
+    out.put_u64(hash_count);
+    out.put_u64(static_cast<uint64_t>(snapshot::to_wall_ms(generation_start)));
+    out.put_words(current);
+    out.put_words(previous);
+}
+
+bool RotatingBloomFilter::load(snapshot::Reader& in) {
+    uint64_t bits = 0;
+    uint64_t hashes = 0;
+    uint64_t start_ms = 0;
+    std::vector<uint64_t> saved_current;
+    std::vector<uint64_t> saved_previous;
+    if (!in.get_u64(bits) || !in.get_u64(hashes) || !in.get_u64(start_ms) ||
+        !in.get_words(saved_current) || !in.get_words(saved_previous)) {
+        return false;
+    }
+    if (bits != bit_count || hashes != hash_count ||
+        saved_current.size() != current.size() || saved_previous.size() != previous.size()) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    current.swap(saved_current);
+    previous.swap(saved_previous);
+    generation_start = snapshot::from_wall_ms(static_cast<int64_t>(start_ms));
+    // 停机期间跨过的窗口在这里补上轮换
+    rotate_if_needed(clock::now());
+    return true;
+}
+
+LikeFilter::LikeFilter(size_t expected_likes, std::chrono::hours window)
+    : bloom(expected_likes, 0.01, window) {
+}
+
+uint64_t LikeFilter::make_key(uint64_t fingerprint, const std::string& post_id) {
+    return mix64(fingerprint ^ mix64(std::hash<std::string>{}(post_id)));
+}
+
+bool LikeFilter::seen(uint64_t fingerprint, const std::string& post_id) {
+    return bloom.contains(make_key(fingerprint, post_id));
+}
+
+void LikeFilter::remember(uint64_t fingerprint, const std::string& post_id) {
+    bloom.insert(make_key(fingerprint, post_id));
+}
+
+} // namespace filter
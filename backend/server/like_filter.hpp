@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "snapshot.hpp"
+
+namespace filter {
+
+// 按时间窗口轮换的布隆过滤器
+// 维护当前/上一代两个位数组，每经过一个窗口把当前代降为上一代并清空当前代，
+// 因此一个键至少被记住一个窗口、至多两个窗口；内存固定为 2 x bits/8 字节
+// 存在约1%的误判（新键被当成已存在），不会漏判
+class RotatingBloomFilter {
+private:
+    using clock = std::chrono::steady_clock;
+    
+    size_t bit_count;
+    size_t hash_count;
+    clock::duration window;
+    clock::time_point generation_start;
+    std::vector<uint64_t> current;
+    std::vector<uint64_t> previous;
+    mutable std::mutex mutex;
+    
+public:
+    // expected_items: 每一代预计容纳的键数；false_positive_rate: 目标误判率
+    RotatingBloomFilter(size_t expected_items, double false_positive_rate, clock::duration window);
+    
+    // 是否（很可能）已经存在
+    bool contains(uint64_t key);
+    
+    // 加入键
+    void insert(uint64_t key);
+    
+    // 两代位数组占用的字节数
+    size_t memory_bytes() const;
+    
+    // 热启动快照：两代位数组和当前代的起始时间（墙上时间）
+    // 参数（位数、哈希数）与当前配置不一致时拒绝恢复
+    void save(snapshot::Writer& out) const;
+    bool load(snapshot::Reader& in);
+    
+private:
+    void rotate_if_needed(clock::time_point now);
+    bool test(const std::vector<uint64_t>& bits, uint64_t key) const;
+};
+
+// 点赞去重过滤器：键为（客户端指纹，评论ID）
+class LikeFilter {
+private:
+    RotatingBloomFilter bloom;
+    
+public:
+    explicit LikeFilter(size_t expected_likes = 1000000,
+                        std::chrono::hours window = std::chrono::hours(24));
+    
+    // 同一客户端在窗口内是否已经点过赞
+    bool seen(uint64_t fingerprint, const std::string& post_id);
+    
+    // 记录一次成功的点赞
+    void remember(uint64_t fingerprint, const std::string& post_id);
+    
+    void save(snapshot::Writer& out) const { bloom.save(out); }
+    bool load(snapshot::Reader& in) { return bloom.load(in); }
+    
+private:
+    static uint64_t make_key(uint64_t fingerprint, const std::string& post_id);
+};
+
+} // namespace filter
+
+namespace server {
+// 全局点赞去重过滤器（定义于main.cpp）
+extern std::shared_ptr<filter::LikeFilter> g_like_filter;
+}
@@ -0,0 +1,216 @@
+#include "live_hub.hpp"
+#include "async_db.hpp"
+#include "post_cache.hpp"
+#include "submit_log.hpp"
+#include "utils.hpp"
+#include <boost/asio/co_spawn.hpp>
+#include <algorithm>
+#include <iostream>
+
+namespace server {
+
+extern std::shared_ptr<db::DatabaseManager> g_db_manager;
+
+namespace {
+
+// 单个会话允许积压的消息数，超过后只保留最新的计数
+constexpr size_t max_queued_messages = 2;
+
+// 订阅的评论是否存在；查询失败时按存在处理，不因数据库抖动断开订阅
+net::awaitable<bool> post_exists(std::string id) {
+    if ((g_post_cache && g_post_cache->get(id)) || (wal::g_submit_log && wal::g_submit_log->find(id))) {
+        co_return true;
+    }
+    
+    std::vector<std::string> ids{id};
+    std::unordered_map<std::string, db::PostCounters> counters;
+    auto lookup = [&](db::DatabaseManager& db) { return db.get_post_counters(ids, counters); };
+    bool fetched = db::g_async_db ? co_await db::g_async_db->run(lookup) : lookup(*g_db_manager);
+    co_return !fetched || !counters.empty();
+}
+
+} // namespace
+
+LiveSession::LiveSession(tcp::socket&& socket, std::string post_id)
+    : ws_(std::move(socket)), post_id_(std::move(post_id)) {
+}
+
+void LiveSession::run(http::request<http::string_body> req) {
+    // 空闲一半超时时间后发ping，浏览器自动回pong，安静的订阅者不会被超时断开
+    auto timeouts = websocket::stream_base::timeout::suggested(beast::role_type::server);
+    timeouts.keep_alive_pings = true;
+    ws_.set_option(timeouts);
+    ws_.set_option(websocket::stream_base::decorator([](websocket::response_type& res) {
+        res.set(http::field::server, "CommentFree/1.0");
+    }));
+    
+    ws_.async_accept(req,
+        [self = shared_from_this()](beast::error_code ec) {
+            self->on_accept(ec);
+        });
+}
+
+void LiveSession::on_accept(beast::error_code ec) {
+    if (ec) {
+        std::cerr << "WebSocket握手失败: " << ec.message() << std::endl;
+        return;
+    }
+    
+    // 先确认评论存在再订阅，关闭帧不会与推送写入并发
+    do_read();
+    net::co_spawn(ws_.get_executor(), post_exists(post_id_),
+        [self = shared_from_this()](std::exception_ptr e, bool exists) {
+            self->on_checked(e || exists);
+        });
+}
+
+void LiveSession::on_checked(bool exists) {
+    if (closed_) {
+        return;
+    }
+    if (exists) {
+        if (g_live_hub) {
+            g_live_hub->subscribe(shared_from_this());
+        }
+        return;
+    }
+    
+    on_closed();
+    ws_.async_close(websocket::close_reason(static_cast<websocket::close_code>(unknown_post), "post not found"),
+        [self = shared_from_this()](beast::error_code) {});
+}
+
+void LiveSession::do_read() {
+    // 客户端不需要发送数据，读取只用于感知关闭和处理控制帧
+    ws_.async_read(buffer_,
+        [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
+            self->on_read(ec, bytes_transferred);
+        });
+}
+
+void LiveSession::on_read(beast::error_code ec, std::size_t bytes_transferred) {
+    boost::ignore_unused(bytes_transferred);
+    
+    if (ec) {
+        return on_closed();
+    }
+    
+    buffer_.consume(buffer_.size());
+    do_read();
+}
+
+void LiveSession::send(std::shared_ptr<const std::string> message) {
+    if (closed_) {
+        return;
+    }
+    
+    // 慢客户端只需要最新计数，替换掉尚未发送的旧消息
+    if (queue_.size() >= max_queued_messages) {
+        queue_.back() = std::move(message);
+        return;
+    }
+    
+    queue_.push_back(std::move(message));
+    if (queue_.size() == 1) {
+        do_write();
+    }
+}
+
+void LiveSession::do_write() {
+    ws_.text(true);
+    ws_.async_write(net::buffer(*queue_.front()),
+        [self = shared_from_this()](beast::error_code ec, std::size_t bytes_transferred) {
+            self->on_write(ec, bytes_transferred);
+        });
+}
+
+void LiveSession::on_write(beast::error_code ec, std::size_t bytes_transferred) {
+    boost::ignore_unused(bytes_transferred);
+    
+    if (ec) {
+        return on_closed();
+    }
+    
+    queue_.pop_front();
+    if (!queue_.empty()) {
+        do_write();
+    }
+}
+
+void LiveSession::on_closed() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    queue_.clear();
+    
+    if (g_live_hub) {
+        g_live_hub->unsubscribe(this);
+    }
+}
+
+void LiveHub::subscribe(const std::shared_ptr<LiveSession>& session) {
+    subscribers[session->post_id()].push_back(session);
+}
+
+void LiveHub::unsubscribe(const LiveSession* session) {
+    auto it = subscribers.find(session->post_id());
+    if (it == subscribers.end()) {
+        return;
+    }
+    
+    auto& list = it->second;
+    list.erase(std::remove_if(list.begin(), list.end(),
+        [session](const std::weak_ptr<LiveSession>& weak) {
+            auto sp = weak.lock();
+            return !sp || sp.get() == session;
+        }), list.end());
+    
+    if (list.empty()) {
+        subscribers.erase(it);
+        pending.erase(session->post_id());
+    }
+}
+
+void LiveHub::publish(const std::string& post_id, const db::PostCounters& counters) {
+    if (!subscribers.count(post_id)) {
+        return;
+    }
+    pending[post_id] = counters;
+}
+
+void LiveHub::flush() {
+    if (pending.empty()) {
+        return;
+    }
+    
+    for (const auto& [post_id, counters] : pending) {
+        auto it = subscribers.find(post_id);
+        if (it == subscribers.end()) {
+            continue;
+        }
+        
+        auto message = std::make_shared<const std::string>(
+            "{\"id\":\"" + utils::JsonUtils::escape_json_string(post_id) + "\","
+            "\"view_count\":" + std::to_string(counters.view_count) + ","
+            "\"like_count\":" + std::to_string(counters.like_count) + "}");
+        
+        auto& list = it->second;
+        for (const auto& weak : list) {
+            if (auto session = weak.lock()) {
+                session->send(message);
+            }
+        }
+    }
+    pending.clear();
+}
+
+size_t LiveHub::subscriber_count() const {
+    size_t count = 0;
+    for (const auto& [post_id, list] : subscribers) {
+        count += list.size();
+    }
+    return count;
+}
+
+} // namespace server
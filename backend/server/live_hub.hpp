@@ -0,0 +1,80 @@
+#pragma once
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "db.hpp"
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+namespace server {
+
+// 实时计数推送的WebSocket会话（订阅单个评论）
+// 服务器定期发ping保持空闲连接；订阅的评论不存在时以unknown_post关闭，前端据此不再重连
+class LiveSession : public std::enable_shared_from_this<LiveSession> {
+public:
+    static constexpr std::uint16_t unknown_post = 4404;
+
+private:
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    std::string post_id_;
+    std::deque<std::shared_ptr<const std::string>> queue_;   // 队首为正在发送的消息
+    bool closed_ = false;
+    
+public:
+    LiveSession(tcp::socket&& socket, std::string post_id);
+    
+    // 完成WebSocket握手并开始会话
+    void run(http::request<http::string_body> req);
+    
+    // 发送计数更新（消息在多个订阅者之间共享）
+    void send(std::shared_ptr<const std::string> message);
+    
+    const std::string& post_id() const { return post_id_; }
+    
+private:
+    void on_accept(beast::error_code ec);
+    void on_checked(bool exists);
+    void do_read();
+    void on_read(beast::error_code ec, std::size_t bytes_transferred);
+    void do_write();
+    void on_write(beast::error_code ec, std::size_t bytes_transferred);
+    void on_closed();
+};
+
+// 计数更新的订阅与合并广播
+// 同一评论在一个广播周期内的多次变化只推送最后一次，每条消息只序列化一次
+// 所有方法只在io线程上调用，无需加锁
+class LiveHub {
+private:
+    std::unordered_map<std::string, std::vector<std::weak_ptr<LiveSession>>> subscribers;
+    std::unordered_map<std::string, db::PostCounters> pending;   // 待广播的最新计数
+    
+public:
+    void subscribe(const std::shared_ptr<LiveSession>& session);
+    void unsubscribe(const LiveSession* session);
+    
+    // 记录计数变化（无订阅者时直接忽略）
+    void publish(const std::string& post_id, const db::PostCounters& counters);
+    
+    // 推送本周期内累积的变化（由周期任务调用）
+    void flush();
+    
+    size_t subscriber_count() const;
+};
+
+// 全局实时推送中心（定义于main.cpp）
+extern std::shared_ptr<LiveHub> g_live_hub;
+
+} // namespace server
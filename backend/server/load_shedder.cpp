@@ -0,0 +1,100 @@
+#include "load_shedder.hpp"
+#include <algorithm>
+
+namespace server {
+
+LoadShedder::Ticket& LoadShedder::Ticket::operator=(Ticket&& other) noexcept {
+    if (this != &other) {
+        if (owner) {
+            owner->release(route);
+        }
+        owner = other.owner;
+        route = other.route;
+        other.owner = nullptr;
+    }
+    return *this;
+}
+
+LoadShedder::Ticket::~Ticket() {
+    if (owner) {
+        owner->release(route);
+    }
+}
+
+LoadShedder::LoadShedder()
+    : interval_start(clock::now()) {
+    // 写操作代价最高，名额最少
+    route_limits[static_cast<size_t>(RouteClass::submit)] = 32;
+    route_limits[static_cast<size_t>(RouteClass::like)] = 128;
+    route_limits[static_cast<size_t>(RouteClass::view)] = 256;
+}
+
+bool LoadShedder::try_acquire(RouteClass route, Ticket& ticket) {
+    if (in_flight >= limit) {
+        rejected_requests++;
+        return false;
+    }
+    
+    if (route != RouteClass::none && route != RouteClass::count) {
+        size_t idx = static_cast<size_t>(route);
+        if (route_in_flight[idx] >= route_limits[idx]) {
+            rejected_requests++;
+            return false;
+        }
+        route_in_flight[idx]++;
+    }
+    
+    in_flight++;
+    ticket = Ticket(this, route);
+    return true;
+}
+
+void LoadShedder::release(RouteClass route) {
+    in_flight--;
+    if (route != RouteClass::none && route != RouteClass::count) {
+        route_in_flight[static_cast<size_t>(route)]--;
+    }
+}
+
+bool LoadShedder::should_shed_connection() {
+    if (overloaded && in_flight >= limit) {
+        rejected_connections++;
+        return true;
+    }
+    return false;
+}
+
+void LoadShedder::record_queue_delay(clock::duration delay) {
+    auto now = clock::now();
+    interval_min_delay = std::min(interval_min_delay, delay);
+    
+    if (now - interval_start < interval) {
+        return;
+    }
+    
+    // 窗口结束：最小时延仍高于目标说明是持续排队而非瞬时突发
+    last_min_delay = interval_min_delay;
+    overloaded = interval_min_delay > target_delay;
+    if (overloaded) {
+        limit = std::max(min_limit, limit * 7 / 10);
+    } else {
+        limit = std::min(max_limit, limit + 1);
+    }
+    
+    interval_start = now;
+    interval_min_delay = clock::duration::max();
+}
+
+LoadSnapshot LoadShedder::snapshot() const {
+    LoadSnapshot s;
+    s.in_flight = in_flight;
+    s.limit = limit;
+    s.route_in_flight = route_in_flight;
+    s.rejected_requests = rejected_requests.load();
+    s.rejected_connections = rejected_connections.load();
+    s.queue_delay_ms = std::chrono::duration<double, std::milli>(last_min_delay).count();
+    s.overloaded = overloaded;
+    return s;
+}
+
+} // namespace server
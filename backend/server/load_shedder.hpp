@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include "rate_limiter.hpp"
+
+namespace server {
+
+// 负载状态快照（用于 /api/load）
+struct LoadSnapshot {
+    int64_t in_flight = 0;
+    int64_t limit = 0;
+    std::array<int64_t, static_cast<size_t>(RouteClass::count)> route_in_flight{};
+    int64_t rejected_requests = 0;
+    int64_t rejected_connections = 0;
+    double queue_delay_ms = 0.0;       // 上一个观察窗口内的最小排队时延
+    bool overloaded = false;
+};
+
+// 过载保护：全局与分路由的在途请求上限
+// 全局上限按CoDel思路自适应：每个窗口内最小排队时延超过目标值说明队列持续积压，
+// 上限乘性减小；否则加性增大（AIMD）。超限的请求直接返回503
+// 只在io线程上调用
+class LoadShedder {
+public:
+    using clock = std::chrono::steady_clock;
+    
+    // 持有一个在途名额，析构时归还
+    class Ticket {
+    private:
+        LoadShedder* owner = nullptr;
+        RouteClass route = RouteClass::none;
+        
+    public:
+        Ticket() = default;
+        Ticket(LoadShedder* owner, RouteClass route) : owner(owner), route(route) {}
+        Ticket(Ticket&& other) noexcept : owner(other.owner), route(other.route) { other.owner = nullptr; }
+        Ticket& operator=(Ticket&& other) noexcept;
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket();
+    };
+    
+private:
+    // CoDel参数
+    static constexpr auto target_delay = std::chrono::milliseconds(5);
+    static constexpr auto interval = std::chrono::milliseconds(100);
+    static constexpr int64_t min_limit = 16;
+    static constexpr int64_t max_limit = 1024;
+    
+    int64_t limit = 256;
+    int64_t in_flight = 0;
+    std::array<int64_t, static_cast<size_t>(RouteClass::count)> route_in_flight{};
+    std::array<int64_t, static_cast<size_t>(RouteClass::count)> route_limits{};
+    
+    clock::time_point interval_start;
+    clock::duration interval_min_delay = clock::duration::max();
+    clock::duration last_min_delay = clock::duration::zero();
+    bool overloaded = false;
+    
+    std::atomic<int64_t> rejected_requests{0};
+    std::atomic<int64_t> rejected_connections{0};
+    
+public:
+    LoadShedder();
+    
+    // 请求头读取完成后申请名额，失败时应返回503
+    bool try_acquire(RouteClass route, Ticket& ticket);
+    
+    // 新连接是否应直接拒绝（过载且在途请求已满）
+    bool should_shed_connection();
+    
+    // 记录一次请求从入队到开始处理的时延
+    void record_queue_delay(clock::duration delay);
+    
+    LoadSnapshot snapshot() const;
+    
+private:
+    void release(RouteClass route);
+};
+
+// 全局过载保护（定义于main.cpp）
+extern std::shared_ptr<LoadShedder> g_load_shedder;
+
+} // namespace server
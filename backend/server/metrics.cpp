@@ -0,0 +1,278 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <bit>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace metrics {
+
+namespace {
+
+constexpr size_t route_count = static_cast<size_t>(Route::count);
+constexpr size_t statement_count = static_cast<size_t>(DbStatement::count);
+
+// 响应状态按1xx~5xx归类
+constexpr size_t status_classes = 5;
+
+const char* const route_names[route_count] = {
+    "submit", "view", "like", "api", "static"
+};
+
+const char* const statement_names[statement_count] = {
+    "save_post", "get_post", "get_posts", "list_posts", "get_top_posts", "get_site_totals",
+    "get_post_counters", "increment_view_count", "increment_view_counts", "increment_like_count",
+    "load_viewer_sketches", "save_viewer_sketches", "set_image_variants",
+    "save_posts", "scan_post_contents", "find_referenced_images"
+};
+
+// 每个线程独占一份，热路径上只做relaxed原子加，没有跨线程竞争
+struct ThreadMetrics {
+    std::array<Histogram, route_count> route_latency;
+    std::array<std::array<std::atomic<uint64_t>, status_classes>, route_count> route_status{};
+    std::array<Histogram, statement_count> db_latency;
+    std::array<std::atomic<uint64_t>, statement_count> db_errors{};
+};
+
+struct Gauge {
+    std::string name;
+    std::string help;
+    std::function<double()> value;
+};
+
+// 线程注册和抓取时才需要加锁；线程数据在进程结束前不释放
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadMetrics>> thread_metrics;
+std::vector<Gauge> gauges;
+
+ThreadMetrics& local_metrics() {
+    thread_local ThreadMetrics* local = nullptr;
+    if (!local) {
+        auto slot = std::make_unique<ThreadMetrics>();
+        local = slot.get();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        thread_metrics.push_back(std::move(slot));
+    }
+    return *local;
+}
+
+void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t to_nanos(std::chrono::steady_clock::duration elapsed) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+}
+
+void write_summary(std::ostringstream& out, const std::string& name, const std::string& labels,
+                   const Histogram& h) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (double q : quantiles) {
+        out << name << "{" << labels << ",quantile=\"" << q << "\"} "
+            << static_cast<double>(h.value_at_quantile(q)) / 1e9 << "\n";
+    }
+    out << name << "_sum{" << labels << "} " << static_cast<double>(h.sum()) / 1e9 << "\n";
+    out << name << "_count{" << labels << "} " << h.count() << "\n";
+}
+
+} // namespace
+
+// Histogram实现
+int Histogram::bucket_index(uint64_t value) {
+    if (value < static_cast<uint64_t>(sub_buckets)) {
+        return static_cast<int>(value);
+    }
+    
+    // 最后一组子桶覆盖 [2^(max_exponent-1), 2^max_exponent)，更大的值都计入最后一个桶
+    int exponent = std::bit_width(value) - 1;
+    if (exponent >= max_exponent) {
+        return bucket_count - 1;
+    }
+    
+    int sub_bucket = static_cast<int>((value >> (exponent - sub_bucket_bits)) & (sub_buckets - 1));
+    return (exponent - sub_bucket_bits + 1) * sub_buckets + sub_bucket;
+}
+
+uint64_t Histogram::bucket_upper_bound(int index) {
+    if (index < sub_buckets) {
+        return static_cast<uint64_t>(index);
+    }
+    
+    int exponent = index / sub_buckets + sub_bucket_bits - 1;
+    uint64_t sub_bucket = static_cast<uint64_t>(index % sub_buckets);
+    uint64_t lower = (sub_buckets + sub_bucket) << (exponent - sub_bucket_bits);
+    return lower + (uint64_t(1) << (exponent - sub_bucket_bits)) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+    add(buckets[bucket_index(value)], 1);
+    add(total_count, 1);
+    add(total_sum, value);
+    
+    uint64_t current = max_value.load(std::memory_order_relaxed);
+    while (value > current && !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::merge(const Histogram& other) {
+    for (int i = 0; i < bucket_count; ++i) {
+        uint64_t n = other.buckets[i].load(std::memory_order_relaxed);
+        if (n) {
+            add(buckets[i], n);
+        }
+    }
+    add(total_count, other.count());
+    add(total_sum, other.sum());
+    
+    uint64_t other_max = other.max();
+    uint64_t current = max_value.load(std::memory_order_relaxed);
+    while (other_max > current && !max_value.compare_exchange_weak(current, other_max, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total_count.store(0, std::memory_order_relaxed);
+    total_sum.store(0, std::memory_order_relaxed);
+    max_value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::value_at_quantile(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    
+    q = std::clamp(q, 0.0, 1.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(total) + 0.5));
+    
+    uint64_t seen = 0;
+    for (int i = 0; i < bucket_count; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // 桶上界可能超过实际最大值
+            return std::min(bucket_upper_bound(i), max());
+        }
+    }
+    return max();
+}
+
+Route classify_route(std::string_view target) {
+    if (target.starts_with("/api/submit")) {
+        return Route::submit;
+    }
+    if (target.starts_with("/api/view/")) {
+        return Route::view;
+    }
+    if (target.starts_with("/api/like/")) {
+        return Route::like;
+    }
+    if (target.starts_with("/api/") || target == "/metrics") {
+        return Route::api;
+    }
+    return Route::static_file;
+}
+
+void record_request(Route route, unsigned status, std::chrono::steady_clock::duration elapsed) {
+    ThreadMetrics& m = local_metrics();
+    size_t idx = static_cast<size_t>(route);
+    m.route_latency[idx].record(to_nanos(elapsed));
+    
+    size_t status_class = std::clamp<size_t>(status / 100, 1, status_classes) - 1;
+    add(m.route_status[idx][status_class], 1);
+}
+
+const char* statement_name(DbStatement statement) {
+    return statement_names[static_cast<size_t>(statement)];
+}
+
+DbTimer::DbTimer(DbStatement statement)
+    : statement(statement), start(std::chrono::steady_clock::now()),
+      exceptions_at_start(std::uncaught_exceptions()), span(statement_name(statement)) {
+}
+
+DbTimer::~DbTimer() {
+    ThreadMetrics& m = local_metrics();
+    size_t idx = static_cast<size_t>(statement);
+    m.db_latency[idx].record(to_nanos(std::chrono::steady_clock::now() - start));
+    if (std::uncaught_exceptions() > exceptions_at_start) {
+        add(m.db_errors[idx], 1);
+    }
+}
+
+void add_gauge(const std::string& name, const std::string& help, std::function<double()> value) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    gauges.push_back(Gauge{name, help, std::move(value)});
+}
+
+std::string render_prometheus() {
+    // 汇总到临时对象，热路径上的计数不受影响
+    auto total = std::make_unique<ThreadMetrics>();
+    std::vector<Gauge> gauge_snapshot;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto& m : thread_metrics) {
+            for (size_t r = 0; r < route_count; ++r) {
+                total->route_latency[r].merge(m->route_latency[r]);
+                for (size_t c = 0; c < status_classes; ++c) {
+                    add(total->route_status[r][c], m->route_status[r][c].load(std::memory_order_relaxed));
+                }
+            }
+            for (size_t s = 0; s < statement_count; ++s) {
+                total->db_latency[s].merge(m->db_latency[s]);
+                add(total->db_errors[s], m->db_errors[s].load(std::memory_order_relaxed));
+            }
+        }
+        gauge_snapshot = gauges;
+    }
+    
+    std::ostringstream out;
+    out << std::setprecision(9);
+    
+    out << "# HELP commentfree_http_request_duration_seconds Time spent handling HTTP requests.\n"
+        << "# TYPE commentfree_http_request_duration_seconds summary\n";
+    for (size_t r = 0; r < route_count; ++r) {
+        write_summary(out, "commentfree_http_request_duration_seconds",
+                      std::string("route=\"") + route_names[r] + "\"", total->route_latency[r]);
+    }
+    
+    out << "# HELP commentfree_http_responses_total HTTP responses by route and status class.\n"
+        << "# TYPE commentfree_http_responses_total counter\n";
+    for (size_t r = 0; r < route_count; ++r) {
+        for (size_t c = 0; c < status_classes; ++c) {
+            out << "commentfree_http_responses_total{route=\"" << route_names[r]
+                << "\",code=\"" << c + 1 << "xx\"} "
+                << total->route_status[r][c].load(std::memory_order_relaxed) << "\n";
+        }
+    }
+    
+    out << "# HELP commentfree_db_statement_duration_seconds Time spent in database statements.\n"
+        << "# TYPE commentfree_db_statement_duration_seconds summary\n";
+    for (size_t s = 0; s < statement_count; ++s) {
+        write_summary(out, "commentfree_db_statement_duration_seconds",
+                      std::string("statement=\"") + statement_names[s] + "\"", total->db_latency[s]);
+    }
+    
+    out << "# HELP commentfree_db_errors_total Database statements that failed.\n"
+        << "# TYPE commentfree_db_errors_total counter\n";
+    for (size_t s = 0; s < statement_count; ++s) {
+        out << "commentfree_db_errors_total{statement=\"" << statement_names[s] << "\"} "
+            << total->db_errors[s].load(std::memory_order_relaxed) << "\n";
+    }
+    
+    for (const auto& gauge : gauge_snapshot) {
+        out << "# HELP " << gauge.name << " " << gauge.help << "\n"
+            << "# TYPE " << gauge.name << " gauge\n"
+            << gauge.name << " " << gauge.value() << "\n";
+    }
+    
+    return out.str();
+}
+
+} // namespace metrics
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "tracing.hpp"
+
+namespace metrics {
+
+// HDR风格的对数-线性直方图：每个2的幂区间再等分8个子桶，相对误差约12.5%
+// 记录单位为纳秒，上限约18分钟，超出的值计入最后一个桶
+// 每个桶是独立的原子计数，单写者写入无需加锁
+class Histogram {
+public:
+    static constexpr int sub_bucket_bits = 3;
+    static constexpr int sub_buckets = 1 << sub_bucket_bits;
+    static constexpr int max_exponent = 40;
+    static constexpr int bucket_count = (max_exponent - sub_bucket_bits + 1) * sub_buckets;
+    
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> total_count{0};
+    std::atomic<uint64_t> total_sum{0};
+    std::atomic<uint64_t> max_value{0};
+    
+public:
+    void record(uint64_t value);
+    
+    // 把另一个直方图累加到当前直方图（抓取时汇总各线程数据）
+    void merge(const Histogram& other);
+    void reset();
+    
+    uint64_t count() const { return total_count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return total_sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_value.load(std::memory_order_relaxed); }
+    
+    // 分位数对应的值（取所在桶的上界），q取值[0, 1]
+    uint64_t value_at_quantile(double q) const;
+    
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_upper_bound(int index);
+};
+
+// 按路由统计的请求
+enum class Route {
+    submit,
+    view,
+    like,
+    api,            // 其他API
+    static_file,
+    count
+};
+
+// 按语句统计的数据库操作（每个DatabaseManager方法算一条）
+enum class DbStatement {
+    save_post,
+    get_post,
+    get_posts,
+    list_posts,
+    get_top_posts,
+    get_site_totals,
+    get_post_counters,
+    increment_view_count,
+    increment_view_counts,
+    increment_like_count,
+    load_viewer_sketches,
+    save_viewer_sketches,
+    set_image_variants,
+    save_posts,
+    scan_post_contents,
+    find_referenced_images,
+    count
+};
+
+Route classify_route(std::string_view target);
+
+// 记录一次请求的处理耗时和响应状态码
+void record_request(Route route, unsigned status, std::chrono::steady_clock::duration elapsed);
+
+const char* statement_name(DbStatement statement);
+
+// 数据库语句计时：析构时记录耗时，如果因异常离开作用域则同时计一次错误
+// 请求开启追踪时同时记一个同名分段
+class DbTimer {
+private:
+    DbStatement statement;
+    std::chrono::steady_clock::time_point start;
+    int exceptions_at_start;
+    tracing::Span span;
+    
+public:
+    explicit DbTimer(DbStatement statement);
+    ~DbTimer();
+    DbTimer(const DbTimer&) = delete;
+    DbTimer& operator=(const DbTimer&) = delete;
+};
+
+// 注册一个在抓取时求值的指标（缓存大小、队列长度等）
+void add_gauge(const std::string& name, const std::string& help, std::function<double()> value);
+
+// 汇总所有线程的数据，输出Prometheus文本格式
+std::string render_prometheus();
+
+} // namespace metrics
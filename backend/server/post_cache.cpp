@@ -0,0 +1,137 @@
+#include "post_cache.hpp"
+
+namespace cache {
+
+PostCache::PostCache(size_t capacity)
+    : capacity(capacity == 0 ? 1 : capacity) {
+}
+
+std::optional<db::Post> PostCache::get(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto it = index.find(id);
+    if (it == index.end()) {
+        return std::nullopt;
+    }
+    
+    // 移到链表头部
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->post;
+}
+
+std::shared_ptr<const ViewTemplate> PostCache::get_view(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto it = index.find(id);
+    if (it == index.end()) {
+        return nullptr;
+    }
+    
+    lru.splice(lru.begin(), lru, it->second);
+    if (!it->second->view) {
+        it->second->view = ViewTemplate::build(it->second->post);
+    }
+    return it->second->view;
+}
+
+void PostCache::put(const db::Post& post) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    db::Post entry = post;
+    entry.view_count = 0;
+    entry.like_count = 0;
+    
+    auto it = index.find(post.id);
+    if (it != index.end()) {
+        *it->second = Cached{std::move(entry), nullptr};
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    
+    lru.push_front(Cached{std::move(entry), nullptr});
+    index[post.id] = lru.begin();
+    
+    // 超出容量时淘汰最久未使用的
+    if (lru.size() > capacity) {
+        index.erase(lru.back().post.id);
+        lru.pop_back();
+    }
+}
+
+void PostCache::erase(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto it = index.find(id);
+    if (it != index.end()) {
+        lru.erase(it->second);
+        index.erase(it);
+    }
+}
+
+void PostCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    lru.clear();
+}
+
+size_t PostCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lru.size();
+}
+
+void PostCache::save(snapshot::Writer& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    out.put_u64(lru.size());
+    for (const auto& [post, view] : lru) {
+        out.put_string(post.id);
+        out.put_string(post.content);
+        out.put_string(post.created_at);
+        out.put_u32(static_cast<uint32_t>(post.image_paths.size()));
+        for (size_t i = 0; i < post.image_paths.size(); ++i) {
+            out.put_string(post.image_paths[i]);
+            const db::PostImageVariants* variants =
+                i < post.image_variants.size() ? &post.image_variants[i] : nullptr;
+            out.put_string(variants ? variants->thumbnail : std::string());
+            out.put_string(variants ? variants->medium : std::string());
+        }
+    }
+}
+
+bool PostCache::load(snapshot::Reader& in) {
+    uint64_t count = 0;
+    if (!in.get_u64(count)) {
+        return false;
+    }
+    
+    // 先完整解析，损坏的快照不会留下半个缓存；容量变小时只保留最近使用的部分
+    std::vector<db::Post> posts;
+    for (uint64_t n = 0; n < count; ++n) {
+        db::Post post;
+        uint32_t images = 0;
+        if (!in.get_string(post.id) || !in.get_string(post.content) ||
+            !in.get_string(post.created_at) || !in.get_u32(images)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < images; ++i) {
+            std::string path;
+            db::PostImageVariants variants;
+            if (!in.get_string(path) || !in.get_string(variants.thumbnail) || !in.get_string(variants.medium)) {
+                return false;
+            }
+            post.image_paths.push_back(std::move(path));
+            post.image_variants.push_back(std::move(variants));
+        }
+        if (posts.size() < capacity) {
+            posts.push_back(std::move(post));
+        }
+    }
+    
+    // 倒序put，最近使用的最后进入链表头部
+    for (auto it = posts.rbegin(); it != posts.rend(); ++it) {
+        put(*it);
+    }
+    return true;
+}
+
+} // namespace cache
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include "db.hpp"
+#include "snapshot.hpp"
+#include "view_body.hpp"
+
+namespace cache {
+
+// 热点评论缓存（LRU）
+// 只缓存评论中不会变化的部分（内容、时间、图片），计数器始终以数据库为准
+class PostCache {
+private:
+    struct Cached {
+        db::Post post;
+        std::shared_ptr<const ViewTemplate> view;   // 首次查看时生成
+    };
+    using Entry = std::list<Cached>::iterator;
+    
+    size_t capacity;
+    std::list<Cached> lru;                         // 头部为最近使用
+    std::unordered_map<std::string, Entry> index;
+    mutable std::mutex mutex;
+    
+public:
+    explicit PostCache(size_t capacity = 1024);
+    
+    // 查询缓存，命中时返回的Post计数器为0
+    std::optional<db::Post> get(const std::string& id);
+    
+    // 查询 /api/view 的响应模板，命中时按需生成并缓存；未缓存的评论返回nullptr
+    std::shared_ptr<const ViewTemplate> get_view(const std::string& id);
+    
+    // 写入缓存（计数器不会被保存），已有的响应模板随之丢弃
+    void put(const db::Post& post);
+    
+    // 移除缓存项
+    void erase(const std::string& id);
+    
+    // 清空缓存
+    void clear();
+    
+    size_t size() const;
+    
+    // 热启动快照：按最近使用顺序写出，恢复后LRU顺序不变
+    void save(snapshot::Writer& out) const;
+    bool load(snapshot::Reader& in);
+};
+
+} // namespace cache
+
+namespace server {
+// 全局评论缓存（定义于main.cpp）
+extern std::shared_ptr<cache::PostCache> g_post_cache;
+}
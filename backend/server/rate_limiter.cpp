@@ -0,0 +1,94 @@
+#include "rate_limiter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace server {
+
+RateLimiter::RateLimiter() {
+    // 发评论：突发5条，之后每10秒1条
+    configs[static_cast<size_t>(RouteClass::submit)] = {5.0, 0.1};
+    // 点赞：突发20次，之后每秒2次
+    configs[static_cast<size_t>(RouteClass::like)] = {20.0, 2.0};
+    // 查看：突发60次，之后每秒10次
+    configs[static_cast<size_t>(RouteClass::view)] = {60.0, 10.0};
+}
+
+RouteClass RateLimiter::classify(std::string_view target) {
+    if (target == "/api/submit") {
+        return RouteClass::submit;
+    }
+    if (target.starts_with("/api/like/")) {
+        return RouteClass::like;
+    }
+    if (target.starts_with("/api/view/")) {
+        return RouteClass::view;
+    }
+    return RouteClass::none;
+}
+
+RateLimiter::Shard& RateLimiter::shard_for(const std::string& client_ip) {
+    return shards[std::hash<std::string>{}(client_ip) % shard_count];
+}
+
+bool RateLimiter::allow(const std::string& client_ip, RouteClass route, int& retry_after) {
+    if (route == RouteClass::none || route == RouteClass::count) {
+        return true;
+    }
+    
+    const BucketConfig& config = configs[static_cast<size_t>(route)];
+    auto now = clock::now();
+    
+    Shard& shard = shard_for(client_ip);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    auto [it, inserted] = shard.clients.try_emplace(client_ip);
+    ClientBuckets& client = it->second;
+    client.last_seen = now;
+    
+    Bucket& bucket = client.buckets[static_cast<size_t>(route)];
+    if (inserted || bucket.last_refill == clock::time_point{}) {
+        bucket.tokens = config.capacity;
+    } else {
+        double elapsed = std::chrono::duration<double>(now - bucket.last_refill).count();
+        bucket.tokens = std::min(config.capacity, bucket.tokens + elapsed * config.refill_per_second);
+    }
+    bucket.last_refill = now;
+    
+    if (bucket.tokens >= 1.0) {
+        bucket.tokens -= 1.0;
+        return true;
+    }
+    
+    retry_after = std::max(1, static_cast<int>(std::ceil((1.0 - bucket.tokens) / config.refill_per_second)));
+    return false;
+}
+
+size_t RateLimiter::evict_idle(std::chrono::seconds idle_for) {
+    auto deadline = clock::now() - idle_for;
+    size_t evicted = 0;
+    
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.clients.begin(); it != shard.clients.end();) {
+            if (it->second.last_seen < deadline) {
+                it = shard.clients.erase(it);
+                evicted++;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return evicted;
+}
+
+size_t RateLimiter::client_count() {
+    size_t count = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        count += shard.clients.size();
+    }
+    return count;
+}
+
+} // namespace server
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace server {
+
+// 限流的路由类别（各自独立的令牌桶）
+enum class RouteClass {
+    submit = 0,
+    like,
+    view,
+    count,
+    none      // 不限流
+};
+
+// 令牌桶参数：容量（突发量）与每秒补充的令牌数
+struct BucketConfig {
+    double capacity;
+    double refill_per_second;
+};
+
+// 按客户端IP分片的令牌桶限流器
+// 在读取请求头之后、读取请求体之前调用，超限请求直接返回429，不解析请求体也不访问数据库
+class RateLimiter {
+private:
+    using clock = std::chrono::steady_clock;
+    
+    struct Bucket {
+        double tokens = 0.0;
+        clock::time_point last_refill;
+    };
+    
+    struct ClientBuckets {
+        std::array<Bucket, static_cast<size_t>(RouteClass::count)> buckets;
+        clock::time_point last_seen;
+    };
+    
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, ClientBuckets> clients;
+    };
+    
+    static constexpr size_t shard_count = 16;
+    
+    std::array<BucketConfig, static_cast<size_t>(RouteClass::count)> configs;
+    std::array<Shard, shard_count> shards;
+    
+public:
+    RateLimiter();
+    
+    // 根据请求路径判断路由类别
+    static RouteClass classify(std::string_view target);
+    
+    // 尝试消耗一个令牌；被拒绝时通过retry_after返回建议的重试等待秒数
+    bool allow(const std::string& client_ip, RouteClass route, int& retry_after);
+    
+    // 清理长时间空闲的客户端（令牌早已补满，保留没有意义）
+    size_t evict_idle(std::chrono::seconds idle_for);
+    
+    size_t client_count();
+    
+private:
+    Shard& shard_for(const std::string& client_ip);
+};
+
+// 全局限流器（定义于main.cpp）
+extern std::shared_ptr<RateLimiter> g_rate_limiter;
+
+} // namespace server
@@ -0,0 +1,128 @@
+// 不依赖服务器全局状态的请求解析辅助函数，单独编译以便微基准直接链接
+#include "routes.hpp"
+#include "http_server.hpp"
+#include "utils.hpp"
+#include <boost/beast/core/string.hpp>
+
+namespace beast = boost::beast;
+
+namespace server {
+
+// MIME类型映射
+std::string mime_type(const std::string& path) {
+    using beast::iequals;
+    auto const ext = [&path] {
+        auto const pos = path.rfind(".");
+        if (pos == std::string::npos)
+            return std::string{};
+        return path.substr(pos);
+    }();
+    
+    if (iequals(ext, ".htm"))  return "text/html";
+    if (iequals(ext, ".html")) return "text/html";
+    if (iequals(ext, ".php"))  return "text/html";
+    if (iequals(ext, ".css"))  return "text/css";
+    if (iequals(ext, ".txt"))  return "text/plain";
+    if (iequals(ext, ".js"))   return "application/javascript";
+    if (iequals(ext, ".json")) return "application/json";
+    if (iequals(ext, ".xml"))  return "application/xml";
+    if (iequals(ext, ".swf"))  return "application/x-shockwave-flash";
+    if (iequals(ext, ".flv"))  return "video/x-flv";
+    if (iequals(ext, ".png"))  return "image/png";
+    if (iequals(ext, ".jpe"))  return "image/jpeg";
+    if (iequals(ext, ".jpeg")) return "image/jpeg";
+    if (iequals(ext, ".jpg"))  return "image/jpeg";
+    if (iequals(ext, ".gif"))  return "image/gif";
+    if (iequals(ext, ".bmp"))  return "image/bmp";
+    if (iequals(ext, ".ico"))  return "image/vnd.microsoft.icon";
+    if (iequals(ext, ".tiff")) return "image/tiff";
+    if (iequals(ext, ".tif"))  return "image/tiff";
+    if (iequals(ext, ".svg"))  return "image/svg+xml";
+    if (iequals(ext, ".svgz")) return "image/svg+xml";
+    return "application/text";
+}
+
+// 路径连接
+std::string path_cat(const std::string& base, const std::string& path) {
+    if (base.empty())
+        return path;
+    std::string result = base;
+    if (result.back() != '/' && !path.empty() && path.front() != '/')
+        result.append("/");
+    result.append(path);
+    return result;
+}
+
+} // namespace server
+
+namespace routes {
+
+std::string RouteHandler::extract_post_id_from_path(const std::string& path) {
+    // 从路径中提取ID，例如 "/api/view/word42" -> "word42"
+    size_t last_slash = path.find_last_of('/');
+    if (last_slash != std::string::npos && last_slash < path.length() - 1) {
+        return path.substr(last_slash + 1);
+    }
+    return "";
+}
+
+bool RouteHandler::parse_multipart_form(const std::string& body, const std::string& boundary,
+                                       std::string& content, std::vector<utils::UploadPart>& uploads) {
+    // 简化的multipart解析（实际项目中建议使用专门的库）
+    std::string delimiter = "--" + boundary;
+    size_t pos = 0;
+    
+    while (pos < body.length()) {
+        size_t start = body.find(delimiter, pos);
+        if (start == std::string::npos) break;
+        
+        start += delimiter.length();
+        size_t end = body.find(delimiter, start);
+        if (end == std::string::npos) end = body.length();
+        
+        std::string part = body.substr(start, end - start);
+        
+        // 分离headers和content
+        size_t header_end = part.find("\r\n\r\n");
+        if (header_end == std::string::npos) {
+            pos = end;
+            continue;
+        }
+        
+        std::string headers = part.substr(0, header_end);
+        std::string part_content = part.substr(header_end + 4);
+        
+        // 移除末尾的\r\n
+        if (part_content.size() >= 2 && part_content.substr(part_content.size() - 2) == "\r\n") {
+            part_content = part_content.substr(0, part_content.size() - 2);
+        }
+        
+        // 解析headers
+        if (headers.find("name=\"content\"") != std::string::npos) {
+            content = part_content;
+        } else if (headers.find("name=\"images\"") != std::string::npos && 
+                  headers.find("filename=") != std::string::npos) {
+            
+            // 提取文件名
+            size_t filename_pos = headers.find("filename=\"");
+            if (filename_pos != std::string::npos) {
+                filename_pos += 10;
+                size_t filename_end = headers.find("\"", filename_pos);
+                if (filename_end != std::string::npos) {
+                    std::string filename = headers.substr(filename_pos, filename_end - filename_pos);
+                    
+                    // 验证文件格式（扩展名初筛，保存前再按文件头确认）
+                    if (utils::FileHandler::validate_image_format(filename)) {
+                        uploads.push_back(utils::UploadPart{filename, std::move(part_content)});
+                    }
+                }
+            }
+        }
+        
+        pos = end;
+    }
+    
+    return !content.empty();
+}
+
+} // namespace routes
@@ -1,12 +1,31 @@
 #include "routes.hpp"
 #include "utils.hpp"
 #include "http_server.hpp"
+#include "post_cache.hpp"
+#include "trending.hpp"
+#include "site_stats.hpp"
+#include "live_hub.hpp"
+#include "unique_views.hpp"
+#include "like_filter.hpp"
+#include "load_shedder.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include "thumbnailer.hpp"
+#include "file_io.hpp"
+#include "submit_log.hpp"
+#include "search_index.hpp"
+#include "async_db.hpp"
+#include "coro.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/json.hpp>
+#include <algorithm>
+#include <cctype>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -14,40 +33,167 @@ namespace json = boost::json;
 
 namespace routes {
 
+// 静态文件读取上限
+constexpr size_t max_static_file_size = 64 * 1024 * 1024;
+
+namespace {
+
+// 正在入库的点赞（客户端指纹/评论ID），只在io线程上访问
+std::unordered_set<std::string> likes_in_flight;
+
+// 读取pos处的定长十进制数，范围不符时返回false
+bool read_field(const std::string& s, size_t pos, size_t width, int min, int max, int& value) {
+    if (pos + width > s.size()) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = pos; i < pos + width; ++i) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (s[i] - '0');
+    }
+    return value >= min && value <= max;
+}
+
+// 解析分页游标 <created_at>|<id>
+// created_at为数据库输出的 YYYY-MM-DD HH:MM:SS[.ffffff]，id只含字母数字（与实时订阅相同最长16字节），
+// 格式不符时返回空，不把任意字符串交给数据库做类型转换
+std::optional<db::PostCursor> parse_cursor(const std::string& cursor) {
+    size_t sep = cursor.rfind('|');
+    if (sep == std::string::npos) {
+        return std::nullopt;
+    }
+    std::string created_at = cursor.substr(0, sep);
+    std::string id = cursor.substr(sep + 1);
+    
+    if (id.empty() || id.size() > 16 ||
+        !std::all_of(id.begin(), id.end(), [](unsigned char c) { return std::isalnum(c); })) {
+        return std::nullopt;
+    }
+    
+    int year, month, day, hour, minute, second;
+    if (created_at.size() < 19 ||
+        !read_field(created_at, 0, 4, 1, 9999, year) || created_at[4] != '-' ||
+        !read_field(created_at, 5, 2, 1, 12, month) || created_at[7] != '-' ||
+        !read_field(created_at, 8, 2, 1, 31, day) || (created_at[10] != ' ' && created_at[10] != 'T') ||
+        !read_field(created_at, 11, 2, 0, 23, hour) || created_at[13] != ':' ||
+        !read_field(created_at, 14, 2, 0, 59, minute) || created_at[16] != ':' ||
+        !read_field(created_at, 17, 2, 0, 59, second)) {
+        return std::nullopt;
+    }
+    static constexpr int month_days[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (day > month_days[month - 1] || (month == 2 && day == 29 && !leap)) {
+        return std::nullopt;
+    }
+    if (created_at.size() > 19) {
+        int fraction;
+        size_t digits = created_at.size() - 20;
+        if (created_at[19] != '.' || digits < 1 || digits > 6 ||
+            !read_field(created_at, 20, digits, 0, 999999, fraction)) {
+            return std::nullopt;
+        }
+    }
+    
+    return db::PostCursor{std::move(created_at), std::move(id)};
+}
+
+} // namespace
+
 RouteHandler::RouteHandler(std::shared_ptr<db::DatabaseManager> db, const std::string& uploads_dir)
     : db_manager(db), uploads_dir(uploads_dir) {
 }
 
+template<class F>
+net::awaitable<std::invoke_result_t<F&, db::DatabaseManager&>> RouteHandler::query(F f) {
+    if (db::g_async_db) {
+        co_return co_await db::g_async_db->run(std::move(f));
+    }
+    co_return f(*db_manager);
+}
+
 template<class Body, class Allocator>
-http::message_generator RouteHandler::handle_request(
-    http::request<Body, http::basic_fields<Allocator>>&& req,
-    const std::string& doc_root) {
+net::awaitable<http::message_generator> RouteHandler::handle_request(
+    const http::request<Body, http::basic_fields<Allocator>>& req,
+    const std::string& doc_root,
+    const std::string& client_ip) {
+    
+    auto start = std::chrono::steady_clock::now();
+    tracing::RequestTrace trace;
+    auto route = metrics::classify_route(std::string_view(req.target().data(), req.target().size()));
+    
+    // 路由在co_await数据库、文件I/O时挂起，追踪上下文由各等待点让出和恢复
+    RoutedResponse routed = co_await route_request(req, doc_root, client_ip);
+    co_return std::visit([&](auto& res) {
+        metrics::record_request(route, res.result_int(), std::chrono::steady_clock::now() - start);
+        
+        // 分段耗时：Server-Timing头和采样的追踪文件
+        std::string timing = trace.server_timing();
+        if (!timing.empty()) {
+            res.set("Server-Timing", timing);
+        }
+        trace.finish(std::string(req.method_string()), std::string(req.target()), res.result_int());
+        
+        // 与客户端协商连接复用：HTTP/1.0默认关闭，Connection: close显式关闭
+        res.version(req.version());
+        res.keep_alive(req.keep_alive());
+        return http::message_generator(std::move(res));
+    }, routed);
+}
+
+template<class Body, class Allocator>
+net::awaitable<RoutedResponse> RouteHandler::route_request(
+    const http::request<Body, http::basic_fields<Allocator>>& req,
+    const std::string& doc_root,
+    const std::string& client_ip) {
     
     std::string target = std::string(req.target());
     auto method = req.method();
+    uint64_t fingerprint = client_fingerprint(client_ip, std::string(req[http::field::user_agent]));
     
     std::cout << "收到请求: " << req.method_string() << " " << target << std::endl;
     
     // API路由处理
     if (target.starts_with("/api/")) {
         if (target == "/api/submit" && method == http::verb::post) {
-            return handle_api_submit(req);
+            co_return co_await handle_api_submit(req);
+        } else if (target == "/api/view/batch" && method == http::verb::post) {
+            co_return co_await handle_api_view_batch(req, fingerprint);
         } else if (target.starts_with("/api/view/") && method == http::verb::get) {
             std::string id = extract_post_id_from_path(target);
-            return handle_api_view(id);
+            co_return co_await handle_api_view(id, fingerprint);
         } else if (target.starts_with("/api/like/") && method == http::verb::post) {
             std::string id = extract_post_id_from_path(target);
-            return handle_api_like(id);
+            co_return co_await handle_api_like(id, fingerprint);
+        } else if ((target == "/api/posts" || target.starts_with("/api/posts?")) && method == http::verb::get) {
+            size_t query_pos = target.find('?');
+            co_return co_await handle_api_posts(query_pos == std::string::npos ? "" : target.substr(query_pos + 1));
+        } else if ((target == "/api/trending" || target.starts_with("/api/trending?")) && method == http::verb::get) {
+            size_t query_pos = target.find('?');
+            co_return handle_api_trending(query_pos == std::string::npos ? "" : target.substr(query_pos + 1));
+        } else if ((target == "/api/search" || target.starts_with("/api/search?")) && method == http::verb::get) {
+            size_t query_pos = target.find('?');
+            co_return co_await handle_api_search(query_pos == std::string::npos ? "" : target.substr(query_pos + 1));
+        } else if (target == "/api/stats" && method == http::verb::get) {
+            co_return handle_api_stats();
+        } else if (target == "/api/load" && method == http::verb::get) {
+            co_return handle_api_load();
         } else {
-            return not_found(target);
+            co_return not_found(target);
         }
     }
     
+    // Prometheus抓取
+    if (target == "/metrics" && method == http::verb::get) {
+        co_return ok_response(metrics::render_prometheus(), "text/plain; version=0.0.4");
+    }
+    
     // 静态文件服务
-    return serve_file(req, target, doc_root);
+    co_return co_await serve_file(req, target, doc_root);
 }
 
-http::response<http::string_body> RouteHandler::handle_api_submit(const http::request<http::string_body>& req) {
+net::awaitable<Response> RouteHandler::handle_api_submit(const http::request<http::string_body>& req) {
     try {
         // 解析Content-Type获取boundary
         std::string content_type = std::string(req[http::field::content_type]);
@@ -62,114 +208,720 @@ http::response<http::string_body> RouteHandler::handle_api_submit(const http::re
         }
         
         if (boundary.empty()) {
-            return bad_request("缺少multipart boundary");
+            co_return bad_request("缺少multipart boundary");
         }
         
         // 解析multipart/form-data
         std::string content;
-        std::vector<std::string> image_files;
+        std::vector<utils::UploadPart> uploads;
         
-        if (!parse_multipart_form(req.body(), boundary, content, image_files)) {
-            return bad_request("解析表单数据失败");
+        bool parsed;
+        {
+            tracing::Span span("parse_multipart");
+            parsed = parse_multipart_form(req.body(), boundary, content, uploads);
+        }
+        if (!parsed) {
+            co_return bad_request("解析表单数据失败");
+        }
+        
+        // 提交日志落盘即确认，数据库拒收的文本必须在这里挡住
+        if (!utils::StringUtils::is_valid_text(content)) {
+            co_return bad_request("评论内容包含无效字符");
+        }
+        for (const auto& part : uploads) {
+            if (!utils::StringUtils::is_valid_text(part.filename)) {
+                co_return bad_request("文件名包含无效字符");
+            }
         }
         
         // 验证内容长度
         if (!utils::StringUtils::validate_content_length(content, 50)) {
-            return bad_request("评论内容不能少于50字");
+            co_return bad_request("评论内容不能少于50字");
         }
         
         // 验证图片数量
-        if (image_files.size() > 9) {
-            return bad_request("最多只能上传9张图片");
+        if (uploads.size() > 9) {
+            co_return bad_request("最多只能上传9张图片");
+        }
+        
+        // 按文件头确认类型并计算内容哈希，得到保存路径；无法识别的文件忽略
+        std::vector<utils::StoredFile> image_files;
+        std::vector<std::shared_ptr<const std::string>> image_contents;
+        {
+            tracing::Span span("hash_uploads");
+            for (auto& part : uploads) {
+                auto stored = utils::FileHandler::prepare_upload(part.content, part.filename);
+                if (stored) {
+                    image_files.push_back(std::move(*stored));
+                    image_contents.push_back(std::make_shared<const std::string>(std::move(part.content)));
+                }
+            }
+        }
+        
+        if (!fileio::g_file_io) {
+            std::vector<utils::StoredFile> saved;
+            for (size_t i = 0; i < image_files.size(); ++i) {
+                if (utils::FileHandler::write_upload(*image_contents[i], image_files[i])) {
+                    saved.push_back(image_files[i]);
+                }
+            }
+            co_return co_await finish_submit(content, saved);
+        }
+        if (image_files.empty()) {
+            co_return co_await finish_submit(content, image_files);
+        }
+        
+        // 所有图片并发写盘，全部完成后再入库；写失败的图片忽略
+        std::vector<bool> stored(image_files.size(), false);
+        {
+            tracing::AwaitSpan span("store_uploads");
+            co_await coro::from_callback<void()>([&](auto done) {
+                auto remaining = std::make_shared<size_t>(image_files.size());
+                for (size_t i = 0; i < image_files.size(); ++i) {
+                    fileio::g_file_io->async_store_file(image_files[i].path, image_contents[i],
+                        [&, remaining, done, i](std::error_code ec, bool deduplicated) {
+                            if (!ec) {
+                                stored[i] = true;
+                                image_files[i].deduplicated = deduplicated;
+                            }
+                            if (--*remaining == 0) {
+                                done();
+                            }
+                        });
+                }
+            });
         }
         
+        std::vector<utils::StoredFile> saved;
+        for (size_t i = 0; i < image_files.size(); ++i) {
+            if (stored[i]) {
+                saved.push_back(image_files[i]);
+            }
+        }
+        co_return co_await finish_submit(content, saved);
+        
+    } catch (const std::exception& e) {
+        std::cerr << "提交评论异常: " << e.what() << std::endl;
+        co_return server_error("服务器内部错误");
+    }
+}
+
+net::awaitable<Response> RouteHandler::finish_submit(const std::string& content,
+                                                     const std::vector<utils::StoredFile>& image_files) {
+    try {
         // 生成ID
         utils::IdGenerator id_gen;
-        std::string post_id = id_gen.generate();
         
         // 创建评论对象
-        db::Post post;
-        post.id = post_id;
-        post.content = content;
-        post.image_paths = image_files;
+        db::PostWrite write;
+        write.post.id = id_gen.generate();
+        write.post.content = content;
+        
+        for (const auto& file : image_files) {
+            write.post.image_paths.push_back(file.path);
+            write.images.push_back(db::PostImage{file.path, file.filename, file.mime_type,
+                                                 static_cast<int64_t>(file.size)});
+        }
+        
+        if (!wal::g_submit_log) {
+            co_return co_await save_submit(write, image_files);
+        }
+        
+        // 日志落盘即确认，确认后ID不能再改，所以先在更大的ID空间里选一个未被占用的：
+        // 查未入库的日志和数据库；数据库暂时不可用时只查日志，靠ID空间避免冲突
+        utils::IdGenerator log_id_gen(999999);
+        bool reserved = false;
+        for (int attempt = 0; attempt < 8 && !reserved; ++attempt) {
+            std::vector<std::string> ids{log_id_gen.generate()};
+            if (wal::g_submit_log->find(ids.front())) {
+                continue;
+            }
+            std::unordered_map<std::string, db::PostCounters> taken;
+            bool checked = co_await query([&](db::DatabaseManager& db) { return db.get_post_counters(ids, taken); });
+            if (!checked || taken.empty()) {
+                write.post.id = ids.front();
+                reserved = true;
+            }
+        }
+        if (!reserved) {
+            co_return server_error("生成评论ID失败");
+        }
         
+        // 写入本地提交日志，落盘即确认；缩略图在后台入库之后再生成
+        // 日志写失败时退回直接写数据库
+        bool durable;
+        {
+            tracing::AwaitSpan span("submit_log");
+            durable = co_await coro::from_callback<void(bool)>([&](auto done) {
+                wal::g_submit_log->append(write, done);
+            });
+        }
+        if (!durable) {
+            co_return co_await save_submit(write, image_files);
+        }
+        
+        if (server::g_site_stats) {
+            server::g_site_stats->record_post(utils::StringUtils::utf8_length(content), image_files.size());
+        }
+        if (search::g_search_index) {
+            search::g_search_index->add(write.post.id, write.post.content);
+        }
+        std::string response_data = "{\"id\":\"" + write.post.id + "\"}";
+        co_return ok_response(utils::JsonUtils::create_success_response(response_data));
+        
+    } catch (const std::exception& e) {
+        std::cerr << "提交评论异常: " << e.what() << std::endl;
+        co_return server_error("服务器内部错误");
+    }
+}
+
+net::awaitable<Response> RouteHandler::save_submit(const db::PostWrite& write,
+                                                   const std::vector<utils::StoredFile>& image_files) {
+    try {
         // 保存到数据库
-        if (!db_manager->save_post(post)) {
-            return server_error("保存评论失败");
+        bool saved = co_await query([&](db::DatabaseManager& db) {
+            return db.save_post(write.post, write.images);
+        });
+        if (!saved) {
+            co_return server_error("保存评论失败");
+        }
+        
+        if (server::g_site_stats) {
+            server::g_site_stats->record_post(utils::StringUtils::utf8_length(write.post.content), image_files.size());
+        }
+        if (search::g_search_index) {
+            search::g_search_index->add(write.post.id, write.post.content);
+        }
+        
+        // 入库成功后再交给后台生成缩略图，失败只影响前端用原图
+        if (media::g_thumbnailer) {
+            for (const auto& file : image_files) {
+                media::g_thumbnailer->enqueue(file.path, file.mime_type);
+            }
         }
         
         // 返回成功响应
-        std::string response_data = "{\"id\":\"" + post_id + "\"}";
-        return ok_response(utils::JsonUtils::create_success_response(response_data));
+        std::string response_data = "{\"id\":\"" + write.post.id + "\"}";
+        co_return ok_response(utils::JsonUtils::create_success_response(response_data));
         
     } catch (const std::exception& e) {
         std::cerr << "提交评论异常: " << e.what() << std::endl;
-        return server_error("服务器内部错误");
+        co_return server_error("服务器内部错误");
     }
 }
 
-http::response<http::string_body> RouteHandler::handle_api_view(const std::string& id) {
+net::awaitable<RoutedResponse> RouteHandler::handle_api_view(const std::string& id, uint64_t fingerprint) {
     try {
         if (id.empty()) {
-            return bad_request("评论ID不能为空");
+            co_return bad_request("评论ID不能为空");
         }
         
-        // 增加浏览次数
-        db_manager->increment_view_count(id);
+        // 尚未入库的评论直接从提交日志的索引读取，计数从入库后开始
+        if (wal::g_submit_log) {
+            if (auto pending = wal::g_submit_log->find(id)) {
+                std::string json_data;
+                append_post_json(json_data, *pending);
+                co_return ok_response(utils::JsonUtils::create_success_response(json_data));
+            }
+        }
         
-        // 获取评论
-        auto post_opt = db_manager->get_post(id);
-        if (!post_opt) {
-            return not_found("评论不存在");
+        // 缓存命中时不变部分已序列化好，只需查计数；未命中时取整条评论并写入缓存
+        auto view = server::g_post_cache ? server::g_post_cache->get_view(id) : nullptr;
+        db::PostCounters counters;
+        if (view) {
+            std::vector<std::string> ids{id};
+            std::unordered_map<std::string, db::PostCounters> found;
+            bool fetched = co_await query([&](db::DatabaseManager& db) { return db.get_post_counters(ids, found); });
+            if (!fetched || !found.count(id)) {
+                co_return not_found("评论不存在");
+            }
+            counters = found[id];
+        } else {
+            auto post_opt = co_await query([&](db::DatabaseManager& db) { return db.get_post(id); });
+            if (!post_opt) {
+                co_return not_found("评论不存在");
+            }
+            counters = db::PostCounters{post_opt->view_count, post_opt->like_count};
+            
+            if (server::g_post_cache) {
+                server::g_post_cache->put(*post_opt);
+                view = server::g_post_cache->get_view(id);
+            }
+            if (!view) {
+                view = cache::ViewTemplate::build(*post_opt);
+            }
         }
         
-        db::Post post = *post_opt;
+        // 只有独立访客数变化时才写浏览数，重复访问不触碰数据库
+        int delta = 1;
+        std::optional<uint64_t> unique_views;
+        if (server::g_unique_views) {
+            tracing::Span span("unique_views");
+            std::vector<std::string> ids{id};
+            // 草图载入失败时record按寄存器变化计1次浏览，不返回不完整的独立访客数
+            bool loaded = co_await ensure_viewer_sketches_loaded(ids);
+            delta = static_cast<int>(server::g_unique_views->record(id, fingerprint));
+            if (loaded) {
+                unique_views = server::g_unique_views->unique_views(id);
+            }
+        }
         
-        // 构造JSON响应
-        std::ostringstream json_data;
-        json_data << "{"
-                  << "\"id\":\"" << utils::JsonUtils::escape_json_string(post.id) << "\","
-                  << "\"content\":\"" << utils::JsonUtils::escape_json_string(post.content) << "\","
-                  << "\"created_at\":\"" << utils::JsonUtils::escape_json_string(post.created_at) << "\","
-                  << "\"view_count\":" << post.view_count << ","
-                  << "\"like_count\":" << post.like_count << ","
-                  << "\"images\":[";
-        
-        for (size_t i = 0; i < post.image_paths.size(); ++i) {
-            if (i > 0) json_data << ",";
-            json_data << "\"" << utils::JsonUtils::escape_json_string(post.image_paths[i]) << "\"";
+        bool incremented = false;
+        if (delta > 0) {
+            incremented = co_await query([&](db::DatabaseManager& db) { return db.increment_view_count(id, delta); });
+        }
+        if (incremented) {
+            counters.view_count += delta;
+            
+            if (server::g_trending) {
+                server::g_trending->record_view(id);
+            }
+            if (server::g_site_stats) {
+                server::g_site_stats->record_views(delta);
+            }
+            if (server::g_live_hub) {
+                server::g_live_hub->publish(id, counters);
+            }
         }
-        json_data << "]}";
         
-        return ok_response(utils::JsonUtils::create_success_response(json_data.str()));
+        co_return view_response(std::move(view), counters, unique_views);
         
     } catch (const std::exception& e) {
         std::cerr << "查看评论异常: " << e.what() << std::endl;
-        return server_error("服务器内部错误");
+        co_return server_error("服务器内部错误");
+    }
+}
+
+net::awaitable<Response> RouteHandler::handle_api_view_batch(const http::request<http::string_body>& req,
+                                                             uint64_t fingerprint) {
+    // 单次批量请求最多包含的ID数
+    constexpr size_t max_batch_ids = 50;
+    
+    try {
+        // 请求体: {"ids": ["word42", "apple7", ...]}
+        boost::system::error_code ec;
+        json::value body = json::parse(req.body(), ec);
+        if (ec || !body.is_object()) {
+            co_return bad_request("请求体必须是JSON对象");
+        }
+        
+        const json::value* ids_value = body.as_object().if_contains("ids");
+        if (!ids_value || !ids_value->is_array()) {
+            co_return bad_request("缺少ids数组");
+        }
+        
+        const json::array& ids_array = ids_value->as_array();
+        if (ids_array.empty()) {
+            co_return bad_request("ids不能为空");
+        }
+        if (ids_array.size() > max_batch_ids) {
+            co_return bad_request("一次最多查询" + std::to_string(max_batch_ids) + "条评论");
+        }
+        
+        // 去重并保持请求顺序
+        std::vector<std::string> ids;
+        std::unordered_set<std::string> seen;
+        for (const auto& v : ids_array) {
+            if (!v.is_string() || v.as_string().empty()) {
+                co_return bad_request("ids中包含无效的评论ID");
+            }
+            std::string id(v.as_string());
+            if (seen.insert(id).second) {
+                ids.push_back(std::move(id));
+            }
+        }
+        
+        // 一次查询取回计数，同时确认哪些评论存在
+        std::unordered_map<std::string, db::PostCounters> counters;
+        bool found = co_await query([&](db::DatabaseManager& db) { return db.get_post_counters(ids, counters); });
+        if (!found) {
+            co_return server_error("获取评论失败");
+        }
+        
+        std::vector<std::string> existing;
+        for (const auto& id : ids) {
+            if (counters.count(id)) {
+                existing.push_back(id);
+            }
+        }
+        
+        // 只给独立访客数变化的评论增加浏览数，一条UPDATE完成
+        std::vector<std::string> increment_ids;
+        std::vector<int> amounts;
+        // 草图载入失败的评论由record按寄存器变化计1次浏览，下次访问再载入
+        if (server::g_unique_views) {
+            co_await ensure_viewer_sketches_loaded(existing);
+        }
+        for (const auto& id : existing) {
+            int delta = server::g_unique_views
+                ? static_cast<int>(server::g_unique_views->record(id, fingerprint))
+                : 1;
+            if (delta > 0) {
+                increment_ids.push_back(id);
+                amounts.push_back(delta);
+            }
+        }
+        
+        if (!increment_ids.empty()) {
+            bool incremented = co_await query([&](db::DatabaseManager& db) {
+                return db.increment_view_counts(increment_ids, amounts, counters);
+            });
+            if (!incremented) {
+                co_return server_error("获取评论失败");
+            }
+            
+            int64_t total = 0;
+            for (size_t i = 0; i < increment_ids.size(); ++i) {
+                total += amounts[i];
+                if (server::g_trending) {
+                    server::g_trending->record_view(increment_ids[i]);
+                }
+                if (server::g_live_hub) {
+                    server::g_live_hub->publish(increment_ids[i], counters[increment_ids[i]]);
+                }
+            }
+            if (server::g_site_stats) {
+                server::g_site_stats->record_views(total);
+            }
+        }
+        
+        // 命中缓存的直接使用，其余的一次性从数据库取回
+        std::unordered_map<std::string, db::Post> posts;
+        std::vector<std::string> missing;
+        for (const auto& id : existing) {
+            auto cached = server::g_post_cache ? server::g_post_cache->get(id) : std::nullopt;
+            if (cached) {
+                posts.emplace(id, std::move(*cached));
+            } else {
+                missing.push_back(id);
+            }
+        }
+        
+        if (!missing.empty()) {
+            std::vector<db::Post> fetched;
+            bool fetched_ok = co_await query([&](db::DatabaseManager& db) { return db.get_posts(missing, fetched); });
+            if (!fetched_ok) {
+                co_return server_error("获取评论失败");
+            }
+            for (auto& post : fetched) {
+                if (server::g_post_cache) {
+                    server::g_post_cache->put(post);
+                }
+                std::string id = post.id;
+                posts.emplace(std::move(id), std::move(post));
+            }
+        }
+        
+        // 按请求顺序输出，不存在的评论直接跳过
+        std::string json_data = "[";
+        bool first = true;
+        for (const auto& id : existing) {
+            auto it = posts.find(id);
+            if (it == posts.end()) {
+                continue;
+            }
+            
+            const db::PostCounters& c = counters[id];
+            it->second.view_count = c.view_count;
+            it->second.like_count = c.like_count;
+            if (server::g_unique_views) {
+                it->second.unique_views = server::g_unique_views->unique_views(id);
+            }
+            
+            if (!first) json_data += ",";
+            first = false;
+            append_post_json(json_data, it->second);
+        }
+        json_data += "]";
+        
+        co_return ok_response(utils::JsonUtils::create_success_response(json_data));
+        
+    } catch (const std::exception& e) {
+        std::cerr << "批量查看评论异常: " << e.what() << std::endl;
+        co_return server_error("服务器内部错误");
     }
 }
 
-http::response<http::string_body> RouteHandler::handle_api_like(const std::string& id) {
+net::awaitable<Response> RouteHandler::handle_api_like(const std::string& id, uint64_t fingerprint) {
     try {
         if (id.empty()) {
-            return bad_request("评论ID不能为空");
+            co_return bad_request("评论ID不能为空");
+        }
+        
+        // 同一客户端重复点赞直接在内存中幂等返回，不访问数据库
+        // 等待数据库期间同一客户端的并发点赞同样按重复处理
+        std::string like_key = std::to_string(fingerprint) + "/" + id;
+        if (server::g_like_filter &&
+            (server::g_like_filter->seen(fingerprint, id) || likes_in_flight.count(like_key))) {
+            co_return ok_response(utils::JsonUtils::create_success_response("{\"duplicate\":true}"));
         }
         
         // 增加点赞次数
-        if (!db_manager->increment_like_count(id)) {
-            return not_found("评论不存在");
+        likes_in_flight.insert(like_key);
+        auto counters = co_await query([&](db::DatabaseManager& db) { return db.increment_like_count(id); });
+        likes_in_flight.erase(like_key);
+        if (!counters) {
+            co_return not_found("评论不存在");
         }
         
-        return ok_response(utils::JsonUtils::create_success_response());
+        if (server::g_like_filter) {
+            server::g_like_filter->remember(fingerprint, id);
+        }
+        
+        if (server::g_trending) {
+            server::g_trending->record_like(id);
+        }
+        if (server::g_site_stats) {
+            server::g_site_stats->record_like();
+        }
+        if (server::g_live_hub) {
+            server::g_live_hub->publish(id, *counters);
+        }
+        
+        std::string json_data = "{\"duplicate\":false,\"like_count\":" + std::to_string(counters->like_count) + "}";
+        co_return ok_response(utils::JsonUtils::create_success_response(json_data));
         
     } catch (const std::exception& e) {
         std::cerr << "点赞异常: " << e.what() << std::endl;
+        co_return server_error("服务器内部错误");
+    }
+}
+
+net::awaitable<Response> RouteHandler::handle_api_posts(const std::string& query_string) {
+    try {
+        auto params = utils::StringUtils::parse_query_string(query_string);
+        
+        // 每页条数（默认20，最多100）
+        int limit = 20;
+        auto limit_it = params.find("limit");
+        if (limit_it != params.end() && !limit_it->second.empty()) {
+            auto value = utils::StringUtils::parse_int(limit_it->second, 1, 100);
+            if (!value) {
+                co_return bad_request("limit必须是1到100之间的整数");
+            }
+            limit = static_cast<int>(*value);
+        }
+        
+        // 游标格式: <created_at>|<id>
+        std::optional<db::PostCursor> after;
+        auto after_it = params.find("after");
+        if (after_it != params.end() && !after_it->second.empty()) {
+            after = parse_cursor(after_it->second);
+            if (!after) {
+                co_return bad_request("after游标无效");
+            }
+        }
+        
+        // 逐条直接序列化到响应体，不再额外拼装中间对象
+        std::string json_data = "{\"posts\":[";
+        std::string next_cursor;
+        int count = 0;
+        
+        // 回调在数据库线程上执行，协程挂起期间独占这些局部变量
+        bool ok = co_await query([&](db::DatabaseManager& db) {
+            return db.list_posts(after, limit, [&](const db::Post& post) {
+                if (count++ > 0) json_data += ",";
+                append_post_json(json_data, post);
+                next_cursor = post.created_at + "|" + post.id;
+            });
+        });
+        if (!ok) {
+            co_return server_error("获取评论列表失败");
+        }
+        
+        // 不足一页说明已经到底
+        json_data += "],\"next_cursor\":";
+        if (count == limit) {
+            json_data += "\"" + utils::JsonUtils::escape_json_string(next_cursor) + "\"";
+        } else {
+            json_data += "null";
+        }
+        json_data += "}";
+        
+        co_return ok_response(utils::JsonUtils::create_success_response(json_data));
+        
+    } catch (const std::exception& e) {
+        std::cerr << "获取评论列表异常: " << e.what() << std::endl;
+        co_return server_error("服务器内部错误");
+    }
+}
+
+http::response<http::string_body> RouteHandler::handle_api_trending(const std::string& query) {
+    try {
+        if (!server::g_trending) {
+            return server_error("热门索引未初始化");
+        }
+        
+        auto params = utils::StringUtils::parse_query_string(query);
+        
+        size_t limit = 20;
+        auto limit_it = params.find("limit");
+        if (limit_it != params.end() && !limit_it->second.empty()) {
+            auto max_entries = static_cast<int64_t>(server::g_trending->max_entries());
+            auto value = utils::StringUtils::parse_int(limit_it->second, 1, max_entries);
+            if (!value) {
+                return bad_request("limit必须是1到" + std::to_string(max_entries) + "之间的整数");
+            }
+            limit = static_cast<size_t>(*value);
+        }
+        
+        // 完全从内存返回，不访问数据库
+        std::ostringstream json_data;
+        json_data << std::fixed << std::setprecision(3) << "[";
+        auto entries = server::g_trending->top_n(limit);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i > 0) json_data << ",";
+            json_data << "{\"id\":\"" << utils::JsonUtils::escape_json_string(entries[i].id) << "\","
+                      << "\"score\":" << entries[i].score << "}";
+        }
+        json_data << "]";
+        
+        return ok_response(utils::JsonUtils::create_success_response(json_data.str()));
+        
+    } catch (const std::exception& e) {
+        std::cerr << "获取热门评论异常: " << e.what() << std::endl;
         return server_error("服务器内部错误");
     }
 }
 
+net::awaitable<Response> RouteHandler::handle_api_search(const std::string& query_string) {
+    try {
+        if (!search::g_search_index) {
+            co_return server_error("搜索索引未初始化");
+        }
+        
+        auto params = utils::StringUtils::parse_query_string(query_string);
+        
+        auto q_it = params.find("q");
+        std::string q = q_it == params.end() ? "" : utils::StringUtils::trim(q_it->second);
+        if (q.empty()) {
+            co_return bad_request("搜索词不能为空");
+        }
+        
+        size_t limit = 20;
+        auto limit_it = params.find("limit");
+        if (limit_it != params.end() && !limit_it->second.empty()) {
+            auto value = utils::StringUtils::parse_int(limit_it->second, 1, 100);
+            if (!value) {
+                co_return bad_request("limit必须是1到100之间的整数");
+            }
+            limit = static_cast<size_t>(*value);
+        }
+        
+        if (search::SearchIndex::tokenize(q).empty()) {
+            co_return bad_request("搜索词至少需要两个连续的文字或字母数字");
+        }
+        search::SearchResult result = search::g_search_index->search(q, limit);
+        
+        // 内容先从缓存和未入库的提交日志取（未入库的评论计数为0），
+        // 缓存命中的评论只查计数器，剩下的整条查询，同一次数据库调用完成
+        std::unordered_map<std::string, db::Post> found;
+        std::vector<std::string> cached;
+        std::vector<std::string> missing;
+        for (const auto& id : result.ids) {
+            std::optional<db::Post> post = server::g_post_cache ? server::g_post_cache->get(id) : std::nullopt;
+            if (post) {
+                cached.push_back(id);
+            } else if (wal::g_submit_log) {
+                post = wal::g_submit_log->find(id);
+            }
+            if (post) {
+                found.emplace(id, std::move(*post));
+            } else {
+                missing.push_back(id);
+            }
+        }
+        if (!cached.empty() || !missing.empty()) {
+            std::unordered_map<std::string, db::PostCounters> counters;
+            std::vector<db::Post> posts;
+            bool fetched = co_await query([&](db::DatabaseManager& db) {
+                return (cached.empty() || db.get_post_counters(cached, counters)) &&
+                       (missing.empty() || db.get_posts(missing, posts));
+            });
+            if (!fetched) {
+                co_return server_error("获取搜索结果失败");
+            }
+            for (const auto& id : cached) {
+                auto it = counters.find(id);
+                if (it == counters.end()) {
+                    found.erase(id);    // 缓存之后已被删除
+                    continue;
+                }
+                db::Post& post = found[id];
+                post.view_count = it->second.view_count;
+                post.like_count = it->second.like_count;
+            }
+            for (auto& post : posts) {
+                std::string id = post.id;
+                found.emplace(std::move(id), std::move(post));
+            }
+        }
+        
+        // 按索引给出的相关度顺序输出
+        std::string json_data = "{\"posts\":[";
+        int count = 0;
+        for (const auto& id : result.ids) {
+            auto it = found.find(id);
+            if (it == found.end()) {
+                continue;
+            }
+            if (count++ > 0) json_data += ",";
+            append_post_json(json_data, it->second);
+        }
+        json_data += "],\"total\":" + std::to_string(result.total) + "}";
+        
+        co_return ok_response(utils::JsonUtils::create_success_response(json_data));
+        
+    } catch (const std::exception& e) {
+        std::cerr << "搜索评论异常: " << e.what() << std::endl;
+        co_return server_error("服务器内部错误");
+    }
+}
+
+http::response<http::string_body> RouteHandler::handle_api_stats() {
+    if (!server::g_site_stats) {
+        return server_error("站点统计未初始化");
+    }
+    
+    // 常数时间返回内存中的统计
+    stats::StatsSnapshot s = server::g_site_stats->snapshot();
+    
+    std::ostringstream json_data;
+    json_data << std::fixed << std::setprecision(2)
+              << "{\"total_posts\":" << s.total_posts << ","
+              << "\"total_images\":" << s.total_images << ","
+              << "\"total_views\":" << s.total_views << ","
+              << "\"total_likes\":" << s.total_likes << ","
+              << "\"avg_content_length\":" << s.avg_content_length << ","
+              << "\"stddev_content_length\":" << s.stddev_content_length << "}";
+    
+    return ok_response(utils::JsonUtils::create_success_response(json_data.str()));
+}
+
+http::response<http::string_body> RouteHandler::handle_api_load() {
+    if (!server::g_load_shedder) {
+        return server_error("过载保护未初始化");
+    }
+    
+    server::LoadSnapshot s = server::g_load_shedder->snapshot();
+    
+    std::ostringstream json_data;
+    json_data << std::fixed << std::setprecision(3)
+              << "{\"in_flight\":" << s.in_flight << ","
+              << "\"limit\":" << s.limit << ","
+              << "\"in_flight_submit\":" << s.route_in_flight[static_cast<size_t>(server::RouteClass::submit)] << ","
+              << "\"in_flight_like\":" << s.route_in_flight[static_cast<size_t>(server::RouteClass::like)] << ","
+              << "\"in_flight_view\":" << s.route_in_flight[static_cast<size_t>(server::RouteClass::view)] << ","
+              << "\"rejected_requests\":" << s.rejected_requests << ","
+              << "\"rejected_connections\":" << s.rejected_connections << ","
+              << "\"queue_delay_ms\":" << s.queue_delay_ms << ","
+              << "\"overloaded\":" << (s.overloaded ? "true" : "false") << "}";
+    
+    return ok_response(utils::JsonUtils::create_success_response(json_data.str()));
+}
+
 template<class Body, class Allocator>
-http::message_generator RouteHandler::serve_file(
+net::awaitable<Response> RouteHandler::serve_file(
     const http::request<Body, http::basic_fields<Allocator>>& req,
     const std::string& path,
     const std::string& doc_root) {
@@ -199,10 +951,24 @@ http::message_generator RouteHandler::serve_file(
         full_path = doc_root + "/" + target;  // 前端文件
     }
     
+    // 异步读取，等待期间io线程继续处理其他请求
+    if (fileio::g_file_io) {
+        std::error_code ec;
+        std::string content;
+        {
+            tracing::AwaitSpan span("read_file");
+            std::tie(ec, content) = co_await fileio::g_file_io->read_file(full_path, max_static_file_size);
+        }
+        if (ec) {
+            co_return not_found(target);
+        }
+        co_return file_response(full_path, std::move(content), req.version());
+    }
+    
     // 读取文件
     std::ifstream file(full_path, std::ios::binary);
     if (!file.is_open()) {
-        return not_found(target);
+        co_return not_found(target);
     }
     
     // 读取文件内容
@@ -210,8 +976,12 @@ http::message_generator RouteHandler::serve_file(
                        std::istreambuf_iterator<char>());
     file.close();
     
-    // 创建响应
-    http::response<http::string_body> res{http::status::ok, req.version()};
+    co_return file_response(full_path, std::move(content), req.version());
+}
+
+http::response<http::string_body> RouteHandler::file_response(const std::string& full_path, std::string content,
+                                                              unsigned version) {
+    http::response<http::string_body> res{http::status::ok, version};
     res.set(http::field::server, "CommentFree/1.0");
     res.set(http::field::content_type, server::mime_type(full_path));
     res.body() = std::move(content);
@@ -222,76 +992,45 @@ http::message_generator RouteHandler::serve_file(
     return res;
 }
 
-std::string RouteHandler::extract_post_id_from_path(const std::string& path) {
-    // 从路径中提取ID，例如 "/api/view/word42" -> "word42"
-    size_t last_slash = path.find_last_of('/');
-    if (last_slash != std::string::npos && last_slash < path.length() - 1) {
-        return path.substr(last_slash + 1);
-    }
-    return "";
+uint64_t RouteHandler::client_fingerprint(const std::string& client_ip, const std::string& user_agent) {
+    return hll::UniqueViewTracker::fingerprint(client_ip, user_agent);
 }
 
-bool RouteHandler::parse_multipart_form(const std::string& body, const std::string& boundary,
-                                       std::string& content, std::vector<std::string>& image_files) {
-    // 简化的multipart解析（实际项目中建议使用专门的库）
-    std::string delimiter = "--" + boundary;
-    size_t pos = 0;
-    
-    while (pos < body.length()) {
-        size_t start = body.find(delimiter, pos);
-        if (start == std::string::npos) break;
-        
-        start += delimiter.length();
-        size_t end = body.find(delimiter, start);
-        if (end == std::string::npos) end = body.length();
-        
-        std::string part = body.substr(start, end - start);
-        
-        // 分离headers和content
-        size_t header_end = part.find("\r\n\r\n");
-        if (header_end == std::string::npos) {
-            pos = end;
-            continue;
+net::awaitable<bool> RouteHandler::ensure_viewer_sketches_loaded(const std::vector<std::string>& ids) {
+    std::vector<std::string> to_load;
+    for (const auto& id : ids) {
+        if (!server::g_unique_views->is_loaded(id)) {
+            to_load.push_back(id);
         }
-        
-        std::string headers = part.substr(0, header_end);
-        std::string part_content = part.substr(header_end + 4);
-        
-        // 移除末尾的\r\n
-        if (part_content.size() >= 2 && part_content.substr(part_content.size() - 2) == "\r\n") {
-            part_content = part_content.substr(0, part_content.size() - 2);
-        }
-        
-        // 解析headers
-        if (headers.find("name=\"content\"") != std::string::npos) {
-            content = part_content;
-        } else if (headers.find("name=\"images\"") != std::string::npos && 
-                  headers.find("filename=") != std::string::npos) {
-            
-            // 提取文件名
-            size_t filename_pos = headers.find("filename=\"");
-            if (filename_pos != std::string::npos) {
-                filename_pos += 10;
-                size_t filename_end = headers.find("\"", filename_pos);
-                if (filename_end != std::string::npos) {
-                    std::string filename = headers.substr(filename_pos, filename_end - filename_pos);
-                    
-                    // 验证文件格式
-                    if (utils::FileHandler::validate_image_format(filename)) {
-                        // 保存文件
-                        std::string saved_path = utils::FileHandler::save_uploaded_file(part_content, filename);
-                        if (!saved_path.empty()) {
-                            image_files.push_back(saved_path);
-                        }
-                    }
-                }
-            }
-        }
-        
-        pos = end;
+    }
+    if (to_load.empty()) {
+        co_return true;
     }
     
-    return !content.empty();
+    // 库中没有草图的评论同样标记为已载入；查询失败时返回false，下次访问再试
+    std::unordered_map<std::string, std::string> sketches;
+    bool loaded = co_await query([&](db::DatabaseManager& db) { return db.load_viewer_sketches(to_load, sketches); });
+    if (!loaded) {
+        std::cerr << "载入访客草图失败，浏览按单次计数" << std::endl;
+        co_return false;
+    }
+    for (const auto& id : to_load) {
+        auto it = sketches.find(id);
+        server::g_unique_views->load(id, it == sketches.end() ? std::string() : it->second);
+    }
+    co_return true;
+}
+
+void RouteHandler::append_post_json(std::string& out, const db::Post& post) {
+    cache::append_post_head(out, post);
+    out += std::to_string(post.view_count);
+    out += ",\"like_count\":";
+    out += std::to_string(post.like_count);
+    if (post.unique_views) {
+        out += ",\"unique_views\":";
+        out += std::to_string(*post.unique_views);
+    }
+    cache::append_post_tail(out, post);
 }
 
 std::string RouteHandler::create_json_response(const std::string& status, const std::string& message, 
@@ -349,6 +1088,17 @@ http::response<http::string_body> RouteHandler::ok_response(const std::string& c
     return res;
 }
 
+ViewResponse RouteHandler::view_response(std::shared_ptr<const cache::ViewTemplate> view,
+                                         const db::PostCounters& counters, std::optional<uint64_t> unique_views) {
+    ViewResponse res{http::status::ok, 11};
+    res.set(http::field::server, "CommentFree/1.0");
+    res.set(http::field::content_type, "application/json");
+    res.body() = cache::ViewBody::value_type(std::move(view), counters, unique_views);
+    res.prepare_payload();
+    add_cors_headers(res);
+    return res;
+}
+
 template<class Body>
 void RouteHandler::add_cors_headers(http::response<Body>& res) {
     res.set(http::field::access_control_allow_origin, "*");
@@ -357,11 +1107,18 @@ void RouteHandler::add_cors_headers(http::response<Body>& res) {
 }
 
 // 显式实例化模板
-template http::message_generator RouteHandler::handle_request<http::string_body, std::allocator<char>>(
-    http::request<http::string_body, http::basic_fields<std::allocator<char>>>&& req,
-    const std::string& doc_root);
+template net::awaitable<http::message_generator>
+RouteHandler::handle_request<http::string_body, std::allocator<char>>(
+    const http::request<http::string_body, http::basic_fields<std::allocator<char>>>& req,
+    const std::string& doc_root,
+    const std::string& client_ip);
+
+template net::awaitable<RoutedResponse> RouteHandler::route_request<http::string_body, std::allocator<char>>(
+    const http::request<http::string_body, http::basic_fields<std::allocator<char>>>& req,
+    const std::string& doc_root,
+    const std::string& client_ip);
 
-template http::message_generator RouteHandler::serve_file<http::string_body, std::allocator<char>>(
+template net::awaitable<Response> RouteHandler::serve_file<http::string_body, std::allocator<char>>(
     const http::request<http::string_body, http::basic_fields<std::allocator<char>>>& req,
     const std::string& path,
     const std::string& doc_root);
@@ -1,16 +1,30 @@
 #pragma once
 
+#include <boost/asio/awaitable.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/json.hpp>
+#include <functional>
 #include <string>
 #include <memory>
+#include <type_traits>
+#include <variant>
 #include "db.hpp"
+#include "utils.hpp"
+#include "view_body.hpp"
 
 namespace http = boost::beast::http;
+namespace net = boost::asio;
 
 namespace routes {
 
-// 路由处理器
+using Response = http::response<http::string_body>;
+using ViewResponse = http::response<cache::ViewBody>;
+
+// 路由结果：/api/view 的成功响应由缓存的模板片段拼成，其余都是字符串响应体
+using RoutedResponse = std::variant<Response, ViewResponse>;
+
+// 路由处理器：各处理函数是在io线程上运行的协程，
+// 等待数据库查询、文件I/O时co_await挂起，io线程在此期间继续处理其他连接
 class RouteHandler {
 private:
     std::shared_ptr<db::DatabaseManager> db_manager;
@@ -19,38 +33,68 @@ private:
 public:
     RouteHandler(std::shared_ptr<db::DatabaseManager> db, const std::string& uploads_dir);
     
-    // 处理所有HTTP请求的入口
+    // 处理所有HTTP请求的入口（req须在co_await结束前保持有效）
     template<class Body, class Allocator>
-    http::message_generator handle_request(
-        http::request<Body, http::basic_fields<Allocator>>&& req,
-        const std::string& doc_root);
+    net::awaitable<http::message_generator> handle_request(
+        const http::request<Body, http::basic_fields<Allocator>>& req,
+        const std::string& doc_root,
+        const std::string& client_ip);
+    
+    // 请求解析辅助函数（定义在request_helpers.cpp）
+    static std::string extract_post_id_from_path(const std::string& path);
+    static bool parse_multipart_form(const std::string& body, const std::string& boundary,
+                                     std::string& content, std::vector<utils::UploadPart>& uploads);
     
 private:
+    // 按路径分发到具体处理函数
+    template<class Body, class Allocator>
+    net::awaitable<RoutedResponse> route_request(
+        const http::request<Body, http::basic_fields<Allocator>>& req,
+        const std::string& doc_root,
+        const std::string& client_ip);
+    
     // API路由处理
-    http::response<http::string_body> handle_api_submit(const http::request<http::string_body>& req);
-    http::response<http::string_body> handle_api_view(const std::string& id);
-    http::response<http::string_body> handle_api_like(const std::string& id);
+    net::awaitable<Response> handle_api_submit(const http::request<http::string_body>& req);
+    net::awaitable<Response> finish_submit(const std::string& content,
+                                           const std::vector<utils::StoredFile>& image_files);
+    net::awaitable<Response> save_submit(const db::PostWrite& write,
+                                         const std::vector<utils::StoredFile>& image_files);
+    net::awaitable<RoutedResponse> handle_api_view(const std::string& id, uint64_t fingerprint);
+    net::awaitable<Response> handle_api_view_batch(const http::request<http::string_body>& req,
+                                                   uint64_t fingerprint);
+    net::awaitable<Response> handle_api_like(const std::string& id, uint64_t fingerprint);
+    net::awaitable<Response> handle_api_posts(const std::string& query);
+    net::awaitable<Response> handle_api_search(const std::string& query);
+    Response handle_api_trending(const std::string& query);
+    Response handle_api_stats();
+    Response handle_api_load();
     
     // 静态文件服务
     template<class Body, class Allocator>
-    http::message_generator serve_file(
+    net::awaitable<Response> serve_file(
         const http::request<Body, http::basic_fields<Allocator>>& req,
         const std::string& path,
         const std::string& doc_root);
+    Response file_response(const std::string& full_path, std::string content, unsigned version);
+    
+    // 在数据库线程上执行f(DatabaseManager&)并co_await结果；数据库线程未启用时在io线程上直接执行
+    template<class F>
+    net::awaitable<std::invoke_result_t<F&, db::DatabaseManager&>> query(F f);
     
     // 辅助函数
-    std::string extract_post_id_from_path(const std::string& path);
-    bool parse_multipart_form(const std::string& body, const std::string& boundary,
-                             std::string& content, std::vector<std::string>& image_files);
+    uint64_t client_fingerprint(const std::string& client_ip, const std::string& user_agent);
+    net::awaitable<bool> ensure_viewer_sketches_loaded(const std::vector<std::string>& ids);
+    void append_post_json(std::string& out, const db::Post& post);
     std::string create_json_response(const std::string& status, const std::string& message, 
                                    const std::string& data = "");
     
     // HTTP响应创建
-    http::response<http::string_body> bad_request(const std::string& why);
-    http::response<http::string_body> not_found(const std::string& target);
-    http::response<http::string_body> server_error(const std::string& what);
-    http::response<http::string_body> ok_response(const std::string& content, 
-                                                 const std::string& content_type = "application/json");
+    Response bad_request(const std::string& why);
+    Response not_found(const std::string& target);
+    Response server_error(const std::string& what);
+    Response ok_response(const std::string& content, const std::string& content_type = "application/json");
+    ViewResponse view_response(std::shared_ptr<const cache::ViewTemplate> view, const db::PostCounters& counters,
+                               std::optional<uint64_t> unique_views);
     
     // CORS处理
     template<class Body>
@@ -0,0 +1,226 @@
+#include "search_index.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <tuple>
+
+namespace search {
+
+namespace {
+
+// 解码一个UTF-8码点，非法字节返回0并前进一个字节
+uint32_t next_code_point(const std::string& text, size_t& i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+    if (length == 0 || i + length > text.size()) {
+        ++i;
+        return 0;
+    }
+    
+    uint32_t cp = length == 1 ? c : c & (0xFF >> (length + 1));
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char cc = static_cast<unsigned char>(text[i + k]);
+        if ((cc & 0xC0) != 0x80) {
+            ++i;
+            return 0;
+        }
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    i += length;
+    return cp;
+}
+
+// 归一化：全角ASCII转半角、英文转小写；分隔符（空白、标点）返回0
+uint32_t normalize(uint32_t cp) {
+    if (cp >= 0xFF01 && cp <= 0xFF5E) {
+        cp -= 0xFEE0;
+    }
+    if (cp < 0x80) {
+        if (cp >= 'A' && cp <= 'Z') {
+            return cp + ('a' - 'A');
+        }
+        bool alnum = (cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9');
+        return alnum ? cp : 0;
+    }
+    // 全角空格与CJK标点、通用标点
+    if ((cp >= 0x3000 && cp <= 0x303F) || (cp >= 0x2000 && cp <= 0x206F) || cp == 0xFF5F || cp == 0xFF60) {
+        return 0;
+    }
+    return cp;
+}
+
+void put_varint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+} // namespace
+
+std::vector<uint64_t> SearchIndex::tokenize(const std::string& text) {
+    std::vector<uint64_t> keys;
+    uint32_t previous = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        uint32_t cp = normalize(next_code_point(text, i));
+        if (cp != 0 && previous != 0) {
+            keys.push_back((static_cast<uint64_t>(previous) << 32) | cp);
+        }
+        previous = cp;
+    }
+    
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+std::vector<uint32_t> SearchIndex::decode(const Postings& postings) {
+    std::vector<uint32_t> docs;
+    docs.reserve(postings.count);
+    
+    uint32_t doc = 0;
+    uint32_t value = 0;
+    int shift = 0;
+    for (uint8_t byte : postings.bytes) {
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte & 0x80) {
+            shift += 7;
+            continue;
+        }
+        doc += value;
+        docs.push_back(doc);
+        value = 0;
+        shift = 0;
+    }
+    return docs;
+}
+
+void SearchIndex::add(const std::string& post_id, const std::string& content) {
+    std::vector<uint64_t> keys = tokenize(content);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    if (doc_of.count(post_id)) {
+        return;
+    }
+    uint32_t doc = static_cast<uint32_t>(documents.size());
+    documents.push_back(post_id);
+    doc_of.emplace(post_id, doc);
+    
+    for (uint64_t key : keys) {
+        Postings& postings = terms[key];
+        size_t before = postings.bytes.size();
+        // 第一项存文档号本身（相对0的差值）
+        put_varint(postings.bytes, postings.count == 0 ? doc : doc - postings.last_doc);
+        postings.last_doc = doc;
+        ++postings.count;
+        posting_bytes += postings.bytes.size() - before;
+    }
+}
+
+SearchResult SearchIndex::search(const std::string& query, size_t limit) const {
+    SearchResult result;
+    std::vector<uint64_t> keys = tokenize(query);
+    if (keys.empty() || limit == 0) {
+        return result;
+    }
+    if (keys.size() > max_query_terms) {
+        keys.resize(max_query_terms);
+    }
+    
+    std::vector<std::vector<uint32_t>> lists;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint64_t key : keys) {
+            auto it = terms.find(key);
+            if (it != terms.end()) {
+                lists.push_back(decode(it->second));
+            }
+        }
+    }
+    if (lists.empty()) {
+        return result;
+    }
+    std::sort(lists.begin(), lists.end(),
+        [](const auto& a, const auto& b) { return a.size() < b.size(); });
+    
+    std::vector<std::pair<uint32_t, uint32_t>> ranked;     // (匹配数, 文档号)
+    
+    // 快速路径：所有二元组都出现的评论已经够一页时，只做交集（以最短表为基准二分查找其余各表）
+    if (lists.size() == keys.size()) {
+        std::vector<uint32_t> matched;
+        std::vector<size_t> cursors(lists.size(), 0);
+        for (uint32_t doc : lists[0]) {
+            bool all = true;
+            for (size_t l = 1; l < lists.size() && all; ++l) {
+                auto begin = lists[l].begin() + static_cast<std::ptrdiff_t>(cursors[l]);
+                auto it = std::lower_bound(begin, lists[l].end(), doc);
+                cursors[l] = static_cast<size_t>(it - lists[l].begin());
+                all = it != lists[l].end() && *it == doc;
+            }
+            if (all) {
+                matched.push_back(doc);
+            }
+        }
+        if (matched.size() >= limit || keys.size() == 1) {
+            result.total = matched.size();
+            for (auto it = matched.rbegin(); it != matched.rend() && result.ids.size() < limit; ++it) {
+                result.ids.push_back(documents[*it]);
+            }
+            return result;
+        }
+    }
+    
+    // 部分匹配：多路归并统计每篇评论命中的二元组数，至少命中一半才计入
+    uint32_t min_match = static_cast<uint32_t>((keys.size() + 1) / 2);
+    using Cursor = std::tuple<uint32_t, size_t, size_t>;      // (文档号, 表下标, 位置)
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+    for (size_t l = 0; l < lists.size(); ++l) {
+        heap.emplace(lists[l][0], l, 0);
+    }
+    while (!heap.empty()) {
+        uint32_t doc = std::get<0>(heap.top());
+        uint32_t count = 0;
+        while (!heap.empty() && std::get<0>(heap.top()) == doc) {
+            auto [d, l, pos] = heap.top();
+            heap.pop();
+            ++count;
+            if (pos + 1 < lists[l].size()) {
+                heap.emplace(lists[l][pos + 1], l, pos + 1);
+            }
+        }
+        if (count >= min_match) {
+            ranked.emplace_back(count, doc);
+        }
+    }
+    
+    result.total = ranked.size();
+    size_t n = std::min(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(n), ranked.end(),
+        [](const auto& a, const auto& b) { return a > b; });
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < n; ++i) {
+        result.ids.push_back(documents[ranked[i].second]);
+    }
+    return result;
+}
+
+size_t SearchIndex::document_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return documents.size();
+}
+
+size_t SearchIndex::term_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return terms.size();
+}
+
+size_t SearchIndex::memory_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    // 倒排表字节 + 每个词项的表头（粗略计入哈希表节点开销）
+    return posting_bytes + terms.size() * (sizeof(uint64_t) + sizeof(Postings) + 16);
+}
+
+} // namespace search
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace search {
+
+// 一次搜索的结果：按匹配的二元组数降序、同分时新评论在前
+struct SearchResult {
+    std::vector<std::string> ids;
+    size_t total = 0;               // 达到最低匹配数的评论总数
+};
+
+// 评论内容的内存倒排索引
+// 中文没有空格分词，按字符二元组（相邻两个字符）建索引；英文数字转小写后同样处理，标点空白作为分隔
+// 文档号按加入顺序递增（启动时按created_at正序载入，越大越新），倒排表以差值+varint压缩、只追加
+class SearchIndex {
+public:
+    static constexpr size_t max_query_terms = 32;
+
+private:
+    struct Postings {
+        std::vector<uint8_t> bytes;     // 文档号差值的varint序列
+        uint32_t last_doc = 0;
+        uint32_t count = 0;
+    };
+    
+    std::unordered_map<uint64_t, Postings> terms;
+    std::vector<std::string> documents;                 // 文档号 -> 评论ID
+    std::unordered_map<std::string, uint32_t> doc_of;   // 评论ID -> 文档号，防止重复加入
+    size_t posting_bytes = 0;
+    mutable std::mutex mutex;
+
+public:
+    // 加入一条评论（已存在时忽略）
+    void add(const std::string& post_id, const std::string& content);
+    
+    // 搜索，至多返回limit条；查询中没有可用的二元组时结果为空
+    SearchResult search(const std::string& query, size_t limit) const;
+    
+    size_t document_count() const;
+    size_t term_count() const;
+    size_t memory_bytes() const;
+    
+    // 文本中去重后的二元组键（高32位/低32位为两个码点）
+    static std::vector<uint64_t> tokenize(const std::string& text);
+
+private:
+    static std::vector<uint32_t> decode(const Postings& postings);
+};
+
+// 全局搜索索引（定义于main.cpp）
+extern std::shared_ptr<SearchIndex> g_search_index;
+
+} // namespace search
@@ -0,0 +1,54 @@
+#include "site_stats.hpp"
+#include <cmath>
+
+namespace stats {
+
+void SiteStats::record_post(size_t content_length, size_t image_count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    total_posts++;
+    total_images += static_cast<int64_t>(image_count);
+    
+    double x = static_cast<double>(content_length);
+    double delta = x - length_mean;
+    length_mean += delta / static_cast<double>(total_posts);
+    length_m2 += delta * (x - length_mean);
+}
+
+void SiteStats::record_views(int64_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    total_views += count;
+}
+
+void SiteStats::record_like() {
+    std::lock_guard<std::mutex> lock(mutex);
+    total_likes++;
+}
+
+void SiteStats::reconcile(const db::SiteTotals& totals) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    total_posts = totals.total_posts;
+    total_images = totals.total_images;
+    total_views = totals.total_views;
+    total_likes = totals.total_likes;
+    length_mean = totals.avg_content_length;
+    length_m2 = totals.var_content_length * static_cast<double>(totals.total_posts);
+}
+
+StatsSnapshot SiteStats::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    StatsSnapshot s;
+    s.total_posts = total_posts;
+    s.total_images = total_images;
+    s.total_views = total_views;
+    s.total_likes = total_likes;
+    s.avg_content_length = length_mean;
+    s.stddev_content_length = total_posts > 0
+        ? std::sqrt(length_m2 / static_cast<double>(total_posts))
+        : 0.0;
+    return s;
+}
+
+} // namespace stats
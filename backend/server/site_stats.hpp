@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "db.hpp"
+
+namespace stats {
+
+// 站点统计快照
+struct StatsSnapshot {
+    int64_t total_posts = 0;
+    int64_t total_images = 0;
+    int64_t total_views = 0;
+    int64_t total_likes = 0;
+    double avg_content_length = 0.0;
+    double stddev_content_length = 0.0;
+};
+
+// 增量维护的站点统计
+// 提交/浏览/点赞时O(1)更新，查询时直接返回；定期用数据库结果校准漂移
+// 内容长度的均值和方差用Welford算法在线更新
+class SiteStats {
+private:
+    int64_t total_posts = 0;
+    int64_t total_images = 0;
+    int64_t total_views = 0;
+    int64_t total_likes = 0;
+    double length_mean = 0.0;
+    double length_m2 = 0.0;     // 与均值之差的平方和
+    mutable std::mutex mutex;
+    
+public:
+    // 新评论（content_length为字符数）
+    void record_post(size_t content_length, size_t image_count);
+    
+    void record_views(int64_t count = 1);
+    void record_like();
+    
+    // 用数据库中的真实值覆盖内存统计
+    void reconcile(const db::SiteTotals& totals);
+    
+    StatsSnapshot snapshot() const;
+};
+
+} // namespace stats
+
+namespace server {
+// 全局站点统计（定义于main.cpp）
+extern std::shared_ptr<stats::SiteStats> g_site_stats;
+}
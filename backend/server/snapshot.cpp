@@ -0,0 +1,340 @@
+#include "snapshot.hpp"
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace snapshot {
+
+namespace {
+
+constexpr char file_magic[8] = {'C', 'F', 'W', 'A', 'R', 'M', '\0', '\0'};
+constexpr uint32_t file_version = 1;
+constexpr uint32_t byte_order_mark = 0x01020304;
+constexpr uint32_t max_sections = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t created_ms;
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t payload_size;      // 头部之后的字节数
+    uint64_t checksum;          // 头部之后全部字节的校验和
+    uint64_t padding[2];
+};
+static_assert(sizeof(FileHeader) == 64, "快照头部须为64字节");
+
+struct RawSectionEntry {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;            // 相对文件开头
+    uint64_t size;
+};
+static_assert(sizeof(RawSectionEntry) == 24, "段表项须为24字节");
+
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+size_t padded(size_t size) {
+    return (size + 7) & ~size_t{7};
+}
+
+} // namespace
+
+uint64_t checksum(const char* data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = std::rotl(h ^ mix64(word), 27) * 0x100000001b3ULL;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    return mix64(h ^ mix64(tail ^ (size - i)));
+}
+
+void Writer::align() {
+    buffer.resize(padded(buffer.size()), '\0');
+}
+
+void Writer::put_u32(uint32_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Writer::put_u64(uint64_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Writer::put_f64(double value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Writer::put_string(const std::string& value) {
+    put_u32(static_cast<uint32_t>(value.size()));
+    buffer.append(value);
+}
+
+void Writer::put_words(const std::vector<uint64_t>& words) {
+    put_u64(words.size());
+    align();
+    buffer.append(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t));
+}
+
+void Writer::put_doubles(const std::vector<double>& values) {
+    put_u64(values.size());
+    align();
+    buffer.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+}
+
+bool Reader::take(void* out, size_t size) {
+    if (!ok || static_cast<size_t>(end - cursor) < size) {
+        ok = false;
+        return false;
+    }
+    std::memcpy(out, cursor, size);
+    cursor += size;
+    return true;
+}
+
+bool Reader::align() {
+    size_t offset = padded(static_cast<size_t>(cursor - begin));
+    if (!ok || offset > static_cast<size_t>(end - begin)) {
+        ok = false;
+        return false;
+    }
+    cursor = begin + offset;
+    return true;
+}
+
+bool Reader::get_u32(uint32_t& value) {
+    return take(&value, sizeof(value));
+}
+
+bool Reader::get_u64(uint64_t& value) {
+    return take(&value, sizeof(value));
+}
+
+bool Reader::get_f64(double& value) {
+    return take(&value, sizeof(value));
+}
+
+bool Reader::get_string(std::string& value) {
+    uint32_t length = 0;
+    if (!get_u32(length) || static_cast<size_t>(end - cursor) < length) {
+        ok = false;
+        return false;
+    }
+    value.assign(cursor, length);
+    cursor += length;
+    return true;
+}
+
+bool Reader::get_count(uint64_t& count, uint64_t limit) {
+    if (!get_u64(count) || count > limit) {
+        ok = false;
+        return false;
+    }
+    return true;
+}
+
+bool Reader::get_words(std::vector<uint64_t>& words) {
+    uint64_t count = 0;
+    if (!get_count(count, static_cast<uint64_t>(end - cursor) / sizeof(uint64_t)) || !align()) {
+        return false;
+    }
+    words.resize(count);
+    return take(words.data(), count * sizeof(uint64_t));
+}
+
+bool Reader::get_doubles(std::vector<double>& values) {
+    uint64_t count = 0;
+    if (!get_count(count, static_cast<uint64_t>(end - cursor) / sizeof(double)) || !align()) {
+        return false;
+    }
+    values.resize(count);
+    return take(values.data(), count * sizeof(double));
+}
+
+Writer& Builder::begin(Section section) {
+    sections.emplace_back(section, Writer());
+    return sections.back().second;
+}
+
+std::string Builder::finish() const {
+    // 布局：头部 | 段表 | 段数据（每段起点8字节对齐）
+    size_t table_size = padded(sections.size() * sizeof(RawSectionEntry));
+    size_t total = sizeof(FileHeader) + table_size;
+    for (const auto& [id, writer] : sections) {
+        total += padded(writer.data().size());
+    }
+    
+    std::string out(total, '\0');
+    size_t offset = sizeof(FileHeader) + table_size;
+    size_t entry_offset = sizeof(FileHeader);
+    for (const auto& [id, writer] : sections) {
+        RawSectionEntry entry{static_cast<uint32_t>(id), 0, offset, writer.data().size()};
+        std::memcpy(out.data() + entry_offset, &entry, sizeof(entry));
+        std::memcpy(out.data() + offset, writer.data().data(), writer.data().size());
+        entry_offset += sizeof(entry);
+        offset += padded(writer.data().size());
+    }
+    
+    FileHeader header{};
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = file_version;
+    header.byte_order = byte_order_mark;
+    header.created_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    header.section_count = static_cast<uint32_t>(sections.size());
+    header.payload_size = total - sizeof(FileHeader);
+    header.checksum = checksum(out.data() + sizeof(FileHeader), header.payload_size);
+    std::memcpy(out.data(), &header, sizeof(header));
+    return out;
+}
+
+std::unique_ptr<MappedSnapshot> MappedSnapshot::open(const std::string& path) {
+    std::unique_ptr<MappedSnapshot> snapshot(new MappedSnapshot());
+
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return nullptr;
+    }
+    snapshot->storage.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    snapshot->data = snapshot->storage.data();
+    snapshot->size = snapshot->storage.size();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        ::close(fd);
+        return nullptr;
+    }
+    
+    // 只读私有映射：按需缺页，校验时顺序扫描一遍
+    void* mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    ::madvise(mapping, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    snapshot->mapping = mapping;
+    snapshot->data = static_cast<const char*>(mapping);
+    snapshot->size = static_cast<size_t>(st.st_size);
+#endif
+
+    if (!snapshot->validate()) {
+        std::cerr << "快照文件无效，忽略: " << path << std::endl;
+        return nullptr;
+    }
+    return snapshot;
+}
+
+MappedSnapshot::~MappedSnapshot() {
+#ifndef _WIN32
+    if (mapping) {
+        ::munmap(mapping, size);
+    }
+#endif
+}
+
+bool MappedSnapshot::validate() {
+    if (size < sizeof(FileHeader)) {
+        return false;
+    }
+    
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0 ||
+        header.version != file_version || header.byte_order != byte_order_mark ||
+        header.payload_size != size - sizeof(FileHeader) || header.section_count > max_sections) {
+        return false;
+    }
+    if (checksum(data + sizeof(FileHeader), header.payload_size) != header.checksum) {
+        return false;
+    }
+    
+    size_t table_end = sizeof(FileHeader) + header.section_count * sizeof(RawSectionEntry);
+    if (table_end > size) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        RawSectionEntry raw;
+        std::memcpy(&raw, data + sizeof(FileHeader) + i * sizeof(RawSectionEntry), sizeof(raw));
+        if (raw.offset < table_end || raw.offset % 8 != 0 || raw.offset > size || raw.size > size - raw.offset) {
+            return false;
+        }
+        sections.push_back(SectionEntry{raw.id, raw.reserved, raw.offset, raw.size});
+    }
+    
+    created_ms = header.created_ms;
+    return true;
+}
+
+std::optional<Reader> MappedSnapshot::section(Section id) const {
+    for (const auto& entry : sections) {
+        if (entry.id == static_cast<uint32_t>(id)) {
+            return Reader(data + entry.offset, static_cast<size_t>(entry.size));
+        }
+    }
+    return std::nullopt;
+}
+
+std::chrono::system_clock::time_point MappedSnapshot::created_at() const {
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(created_ms));
+}
+
+bool write_file(const std::string& path, const std::string& bytes) {
+    std::string temp_path = path + ".tmp";
+    try {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        file.close();
+        if (!file) {
+            std::filesystem::remove(temp_path);
+            return false;
+        }
+        std::filesystem::rename(temp_path, path);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "写入快照失败: " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+}
+
+int64_t to_wall_ms(std::chrono::steady_clock::time_point point) {
+    auto wall = std::chrono::system_clock::now() -
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::steady_clock::now() - point);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(wall.time_since_epoch()).count();
+}
+
+std::chrono::steady_clock::time_point from_wall_ms(int64_t wall_ms) {
+    auto age = std::chrono::system_clock::now().time_since_epoch() - std::chrono::milliseconds(wall_ms);
+    return std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(age);
+}
+
+} // namespace snapshot
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace snapshot {
+
+// 快照中的段，编号写入文件，只能追加不能改号
+enum class Section : uint32_t {
+    post_cache = 1,
+    viewer_sketches = 2,
+    like_filter = 3,
+    trending = 4
+};
+
+// 段内数据的顺序写入（本机字节序；数组前补齐到8字节，映射后可直接按字访问）
+class Writer {
+private:
+    std::string buffer;
+
+public:
+    void put_u32(uint32_t value);
+    void put_u64(uint64_t value);
+    void put_f64(double value);
+    void put_string(const std::string& value);
+    void put_words(const std::vector<uint64_t>& words);
+    void put_doubles(const std::vector<double>& values);
+    
+    const std::string& data() const { return buffer; }
+
+private:
+    void align();
+};
+
+// 段内数据的读取，越界或格式错误时返回false，之后的读取都失败
+class Reader {
+private:
+    const char* begin;
+    const char* cursor;
+    const char* end;
+    bool ok = true;
+
+public:
+    Reader(const char* data, size_t size) : begin(data), cursor(data), end(data + size) {}
+    
+    bool get_u32(uint32_t& value);
+    bool get_u64(uint64_t& value);
+    bool get_f64(double& value);
+    bool get_string(std::string& value);
+    bool get_words(std::vector<uint64_t>& words);
+    bool get_doubles(std::vector<double>& values);
+    
+    // 读取了一个不超过limit的计数（防止损坏数据导致超大分配）
+    bool get_count(uint64_t& count, uint64_t limit);
+
+private:
+    bool take(void* out, size_t size);
+    bool align();
+};
+
+// 组装快照文件：头部（魔数、版本、字节序、创建时间、校验和）+ 段表 + 各段
+class Builder {
+private:
+    std::deque<std::pair<Section, Writer>> sections;
+
+public:
+    // 开始一个新段，返回的Writer在finish之前一直有效
+    Writer& begin(Section section);
+    
+    std::string finish() const;
+};
+
+// 只读映射一个快照文件并校验，段数据直接从映射中读取
+class MappedSnapshot {
+private:
+    struct SectionEntry {
+        uint32_t id;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+    
+    const char* data = nullptr;
+    size_t size = 0;
+    std::string storage;            // 不支持mmap的平台读入内存
+    void* mapping = nullptr;
+    std::vector<SectionEntry> sections;
+    uint64_t created_ms = 0;
+
+public:
+    // 文件不存在、版本不符或校验失败时返回nullptr
+    static std::unique_ptr<MappedSnapshot> open(const std::string& path);
+    ~MappedSnapshot();
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+    
+    std::optional<Reader> section(Section id) const;
+    
+    std::chrono::system_clock::time_point created_at() const;
+
+private:
+    MappedSnapshot() = default;
+    bool validate();
+};
+
+// 按8字节一组混合的64位校验和，只用于发现截断和损坏（快照、提交日志共用）
+uint64_t checksum(const char* data, size_t size);
+
+// 同步写入（临时文件 + 改名），用于退出时事件循环已停止的场合
+bool write_file(const std::string& path, const std::string& bytes);
+
+// 稳态时钟时刻与墙上时间互换，用于跨进程保存窗口起点、衰减基准点
+int64_t to_wall_ms(std::chrono::steady_clock::time_point point);
+std::chrono::steady_clock::time_point from_wall_ms(int64_t wall_ms);
+
+} // namespace snapshot
@@ -0,0 +1,523 @@
+#include "submit_log.hpp"
+#include "snapshot.hpp"
+#include "utils.hpp"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace net = boost::asio;
+
+namespace wal {
+
+namespace {
+
+#ifdef _WIN32
+constexpr int append_flags = _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY;
+constexpr int append_mode = _S_IREAD | _S_IWRITE;
+
+int sys_open(const char* path) { return ::_open(path, append_flags, append_mode); }
+int64_t sys_write(int fd, const char* data, size_t size) { return ::_write(fd, data, static_cast<unsigned>(size)); }
+int sys_sync(int fd) { return ::_commit(fd); }
+int sys_truncate(int fd, uint64_t size) { return ::_chsize_s(fd, static_cast<__int64>(size)); }
+int sys_close(int fd) { return ::_close(fd); }
+int sys_open_append(const char* path) { return ::_open(path, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, append_mode); }
+// NTFS的目录项随文件元数据一起提交，没有单独同步目录的接口
+int sys_sync_dir(const char*) { return 0; }
+#else
+constexpr int append_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+constexpr int append_mode = 0644;
+
+int sys_open(const char* path) { return ::open(path, append_flags, append_mode); }
+int64_t sys_write(int fd, const char* data, size_t size) { return ::write(fd, data, size); }
+int sys_sync(int fd) { return ::fdatasync(fd); }
+int sys_truncate(int fd, uint64_t size) { return ::ftruncate(fd, static_cast<off_t>(size)); }
+int sys_close(int fd) { return ::close(fd); }
+int sys_open_append(const char* path) { return ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, append_mode); }
+
+// 新建、改名、删除文件后同步目录，否则崩溃后目录项可能丢失（连同其中已确认的记录）
+int sys_sync_dir(const char* path) {
+    int fd = ::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    return result;
+}
+#endif
+
+// 记录帧：u32载荷长度 | u32保留 | u64载荷校验和 | 载荷
+constexpr size_t frame_header_size = 16;
+constexpr uint32_t max_record_size = 1024 * 1024;
+
+// UTC时间（与直接入库时的 NOW() AT TIME ZONE 'UTC' 一致），格式与PostgreSQL输出的timestamp一致（精确到微秒）
+std::string current_timestamp() {
+    auto now = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() % 1000000;
+    
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    std::ostringstream out;
+    out << std::put_time(&utc, "%Y-%m-%d %H:%M:%S") << '.' << std::setw(6) << std::setfill('0') << micros;
+    return out.str();
+}
+
+std::string segment_name(uint64_t first_seq) {
+    std::ostringstream out;
+    out << std::setw(20) << std::setfill('0') << first_seq << ".log";
+    return out.str();
+}
+
+void encode_record(std::string& out, uint64_t seq, const db::PostWrite& entry) {
+    snapshot::Writer payload;
+    payload.put_u64(seq);
+    payload.put_string(entry.post.id);
+    payload.put_string(entry.post.content);
+    payload.put_string(entry.post.created_at);
+    payload.put_u32(static_cast<uint32_t>(entry.images.size()));
+    for (const auto& image : entry.images) {
+        payload.put_string(image.path);
+        payload.put_string(image.filename);
+        payload.put_string(image.mime_type);
+        payload.put_u64(static_cast<uint64_t>(image.file_size));
+    }
+    
+    const std::string& data = payload.data();
+    uint32_t length = static_cast<uint32_t>(data.size());
+    uint32_t reserved = 0;
+    uint64_t sum = snapshot::checksum(data.data(), data.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+    out.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+    out.append(data);
+}
+
+bool decode_record(const char* data, size_t size, uint64_t& seq, db::PostWrite& entry) {
+    snapshot::Reader in(data, size);
+    uint32_t images = 0;
+    if (!in.get_u64(seq) || !in.get_string(entry.post.id) || !in.get_string(entry.post.content) ||
+        !in.get_string(entry.post.created_at) || !in.get_u32(images)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < images; ++i) {
+        db::PostImage image;
+        uint64_t file_size = 0;
+        if (!in.get_string(image.path) || !in.get_string(image.filename) ||
+            !in.get_string(image.mime_type) || !in.get_u64(file_size)) {
+            return false;
+        }
+        image.file_size = static_cast<int64_t>(file_size);
+        entry.post.image_paths.push_back(image.path);
+        entry.post.image_variants.push_back(db::PostImageVariants{});
+        entry.images.push_back(std::move(image));
+    }
+    return true;
+}
+
+} // namespace
+
+SubmitLog::SubmitLog(const std::string& dir, const std::string& db_connection,
+                     net::any_io_executor executor, DrainHandler on_drained)
+    : dir(dir), executor(executor), on_drained(std::move(on_drained)), drain_db(db_connection) {
+}
+
+SubmitLog::~SubmitLog() {
+    stop();
+}
+
+bool SubmitLog::open() {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "无法创建提交日志目录: " << dir << ": " << ec.message() << std::endl;
+        return false;
+    }
+    
+    replay();
+    if (!open_segment(next_seq)) {
+        return false;
+    }
+    remove_drained_segments();
+    
+    writer = std::thread([this] { write_loop(); });
+    drainer = std::thread([this] { drain_loop(); });
+    return true;
+}
+
+void SubmitLog::replay() {
+    // 检查点：该序号及之前的记录已经入库
+    std::ifstream checkpoint_file(dir + "/drained");
+    if (checkpoint_file >> drained_seq) {
+        durable_seq = drained_seq;
+    } else {
+        drained_seq = 0;
+    }
+    
+    std::vector<std::filesystem::path> files;
+    for (const auto& item : std::filesystem::directory_iterator(dir)) {
+        if (item.is_regular_file() && item.path().extension() == ".log") {
+            files.push_back(item.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    
+    for (size_t f = 0; f < files.size(); ++f) {
+        std::ifstream file(files[f], std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        
+        size_t offset = 0;
+        while (content.size() - offset >= frame_header_size) {
+            uint32_t length;
+            uint64_t sum;
+            std::memcpy(&length, content.data() + offset, sizeof(length));
+            std::memcpy(&sum, content.data() + offset + 8, sizeof(sum));
+            const char* payload = content.data() + offset + frame_header_size;
+            if (length > max_record_size || content.size() - offset - frame_header_size < length ||
+                snapshot::checksum(payload, length) != sum) {
+                break;
+            }
+            
+            uint64_t seq = 0;
+            db::PostWrite entry;
+            if (!decode_record(payload, length, seq, entry)) {
+                break;
+            }
+            offset += frame_header_size + length;
+            
+            next_seq = std::max(next_seq, seq + 1);
+            durable_seq = std::max(durable_seq, seq);
+            if (seq > drained_seq) {
+                index[entry.post.id] = entry.post;
+                drain_queue.push_back(Queued{seq, std::move(entry)});
+            }
+        }
+        
+        // 崩溃时写了一半的尾部记录没有被确认过，丢弃即可
+        if (offset < content.size()) {
+            std::cerr << "提交日志 " << files[f].string() << " 在偏移 " << offset << " 处截断" << std::endl;
+        }
+        
+        uint64_t first_seq = std::strtoull(files[f].stem().string().c_str(), nullptr, 10);
+        segments.push_back(Segment{first_seq, files[f].string()});
+    }
+    
+    next_seq = std::max(next_seq, drained_seq + 1);
+    if (!drain_queue.empty()) {
+        std::cout << "提交日志回放: " << drain_queue.size() << " 条评论待入库" << std::endl;
+    }
+}
+
+bool SubmitLog::open_segment(uint64_t first_seq) {
+    std::string path = dir + "/" + segment_name(first_seq);
+    int fd = sys_open(path.c_str());
+    if (fd < 0) {
+        std::cerr << "无法创建提交日志分段: " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (sys_sync_dir(dir.c_str()) != 0) {
+        std::cerr << "无法同步提交日志目录: " << dir << ": " << std::strerror(errno) << std::endl;
+        sys_close(fd);
+        return false;
+    }
+    if (segment_fd >= 0) {
+        sys_close(segment_fd);
+    }
+    segment_fd = fd;
+    segment_size = 0;
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    // 同名的旧分段里没有有效记录（否则序号会更大），已被截断重用
+    if (!segments.empty() && segments.back().first_seq == first_seq) {
+        segments.pop_back();
+    }
+    segments.push_back(Segment{first_seq, path});
+    return true;
+}
+
+bool SubmitLog::write_batch(const std::string& buffer, uint64_t first_seq) {
+    if (segment_size >= segment_limit && !open_segment(first_seq)) {
+        return false;
+    }
+    
+    size_t written = 0;
+    while (written < buffer.size()) {
+        int64_t n = sys_write(segment_fd, buffer.data() + written, buffer.size() - written);
+        if (n <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    
+    if (written == buffer.size() && sys_sync(segment_fd) == 0) {
+        segment_size += buffer.size();
+        return true;
+    }
+    
+    // 截掉写了一半的批次，后续追加仍然接在有效记录之后
+    std::cerr << "写入提交日志失败: " << std::strerror(errno) << std::endl;
+    sys_truncate(segment_fd, segment_size);
+#ifndef _WIN32
+    ::lseek(segment_fd, static_cast<off_t>(segment_size), SEEK_SET);
+#else
+    ::_lseeki64(segment_fd, static_cast<__int64>(segment_size), SEEK_SET);
+#endif
+    return false;
+}
+
+void SubmitLog::append(db::PostWrite entry, AppendHandler handler) {
+    if (entry.post.created_at.empty()) {
+        entry.post.created_at = current_timestamp();
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopping) {
+            write_queue.push_back(Pending{next_seq++, std::move(entry), std::move(handler)});
+            write_cv.notify_one();
+            return;
+        }
+    }
+    handler(false);
+}
+
+void SubmitLog::write_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        write_cv.wait(lock, [this] { return stopping || !write_queue.empty(); });
+        if (write_queue.empty()) {
+            break;
+        }
+        
+        // 组提交：取走当前所有等待的追加，一次write + 一次fsync
+        std::vector<Pending> batch;
+        batch.swap(write_queue);
+        lock.unlock();
+        
+        std::string buffer;
+        for (const auto& pending : batch) {
+            encode_record(buffer, pending.seq, pending.entry);
+        }
+        bool durable = write_batch(buffer, batch.front().seq);
+        
+        lock.lock();
+        std::vector<AppendHandler> handlers;
+        for (auto& pending : batch) {
+            handlers.push_back(std::move(pending.handler));
+            if (durable) {
+                index[pending.entry.post.id] = pending.entry.post;
+                durable_seq = pending.seq;
+                drain_queue.push_back(Queued{pending.seq, std::move(pending.entry)});
+            }
+        }
+        if (durable) {
+            drain_cv.notify_one();
+        }
+        
+        net::post(executor, [handlers = std::move(handlers), durable] {
+            for (const auto& handler : handlers) {
+                handler(durable);
+            }
+        });
+    }
+}
+
+void SubmitLog::drain_loop() {
+    auto backoff = std::chrono::milliseconds(500);
+    constexpr auto max_backoff = std::chrono::seconds(30);
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        drain_cv.wait(lock, [this] { return stopping || !drain_queue.empty(); });
+        if (stopping) {
+            break;
+        }
+        
+        std::vector<db::PostWrite> batch;
+        std::vector<uint64_t> seqs;
+        for (size_t i = 0; i < drain_queue.size() && i < drain_batch; ++i) {
+            batch.push_back(drain_queue[i].entry);
+            seqs.push_back(drain_queue[i].seq);
+        }
+        lock.unlock();
+        
+        std::vector<size_t> rejected;
+        bool saved = (drain_db.is_connected() || drain_db.connect()) && drain_db.save_posts(batch, rejected);
+        
+        // ID已确认给客户端，不能再改：确认前已查重，仍然冲突只可能是其他实例同时用了同一ID；
+        // 数据被拒绝的记录（确认前已校验文本，通常是旧版本写入的日志）重试也不会成功。
+        // 这两类记录移到 conflicts 文件留待人工处理，不阻塞后面的记录
+        if (saved && !rejected.empty()) {
+            std::string diverted;
+            for (size_t i : rejected) {
+                encode_record(diverted, seqs[i], batch[i]);
+            }
+            saved = append_conflicts(diverted);
+        }
+        
+        lock.lock();
+        if (!saved) {
+            // 数据库暂时不可用或conflicts写入失败：指数退避后重试（断开的连接在下一轮重连），记录一直留在日志里；
+            // 本批已入库的记录下一轮按重放识别
+            drain_cv.wait_for(lock, backoff, [this] { return stopping; });
+            backoff = std::min<std::chrono::milliseconds>(backoff * 2, max_backoff);
+            continue;
+        }
+        backoff = std::chrono::milliseconds(500);
+        
+        std::vector<db::PostWrite> drained;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            Queued& queued = drain_queue.front();
+            index.erase(queued.entry.post.id);
+            if (std::find(rejected.begin(), rejected.end(), i) != rejected.end()) {
+                std::cerr << "评论无法入库，已移入conflicts: " << queued.entry.post.id << std::endl;
+            } else {
+                drained.push_back(std::move(queued.entry));
+            }
+            drain_queue.pop_front();
+        }
+        
+        // 队列按序号排列，队首之前的记录都已处理
+        uint64_t through = drain_queue.empty() ? durable_seq : drain_queue.front().seq - 1;
+        if (through > drained_seq) {
+            drained_seq = through;
+            lock.unlock();
+            checkpoint(through);
+            remove_drained_segments();
+            lock.lock();
+        }
+        
+        if (!drained.empty() && on_drained) {
+            net::post(executor, [handler = on_drained, drained = std::move(drained)] {
+                handler(drained);
+            });
+        }
+    }
+}
+
+void SubmitLog::checkpoint(uint64_t seq) {
+    // 检查点丢失只会导致重放已入库的记录，save_posts会识别出来，因此不需要fsync
+    std::string path = dir + "/drained";
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        file << seq << '\n';
+        if (!file) {
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (!ec) {
+        sys_sync_dir(dir.c_str());
+    }
+}
+
+bool SubmitLog::append_conflicts(const std::string& records) {
+    // 这些记录随检查点推进会从日志中删除，必须先落盘
+    std::string path = dir + "/conflicts";
+    int fd = sys_open_append(path.c_str());
+    bool durable = fd >= 0 && sys_write(fd, records.data(), records.size()) == static_cast<int64_t>(records.size()) &&
+                   sys_sync(fd) == 0;
+    if (fd >= 0) {
+        sys_close(fd);
+    }
+    durable = durable && sys_sync_dir(dir.c_str()) == 0;
+    if (!durable) {
+        std::cerr << "写入conflicts失败: " << path << ": " << std::strerror(errno) << std::endl;
+    }
+    return durable;
+}
+
+void SubmitLog::remove_drained_segments() {
+    std::vector<std::string> removable;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 下一个分段的起始序号之前的记录都已入库时，整个分段可以删除；当前写入的分段保留
+        while (segments.size() > 1 && segments[1].first_seq <= drained_seq + 1) {
+            removable.push_back(segments.front().path);
+            segments.pop_front();
+        }
+    }
+    for (const auto& path : removable) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+    if (!removable.empty()) {
+        sys_sync_dir(dir.c_str());
+    }
+}
+
+std::optional<db::Post> SubmitLog::find(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(id);
+    if (it == index.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+size_t SubmitLog::backlog() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return drain_queue.size() + write_queue.size();
+}
+
+std::unordered_set<std::string> SubmitLog::pending_images() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unordered_set<std::string> paths;
+    for (const auto& pending : write_queue) {
+        for (const auto& image : pending.entry.images) {
+            paths.insert(image.path);
+        }
+    }
+    for (const auto& queued : drain_queue) {
+        for (const auto& image : queued.entry.images) {
+            paths.insert(image.path);
+        }
+    }
+    return paths;
+}
+
+void SubmitLog::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    write_cv.notify_all();
+    drain_cv.notify_all();
+    
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (drainer.joinable()) {
+        drainer.join();
+    }
+    if (segment_fd >= 0) {
+        sys_close(segment_fd);
+        segment_fd = -1;
+    }
+    drain_db.disconnect();
+}
+
+} // namespace wal
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "db.hpp"
+
+namespace wal {
+
+// 本地提交日志：评论先追加到 data/ 下的分段日志并fsync即向客户端确认，
+// 后台线程（独立数据库连接）批量写入PostgreSQL，失败时退避重试
+// 同一批到达的追加共用一次fsync（组提交）；未入库的评论可从内存索引直接读取
+class SubmitLog {
+public:
+    using AppendHandler = std::function<void(bool durable)>;
+    using DrainHandler = std::function<void(const std::vector<db::PostWrite>& drained)>;
+    
+    static constexpr uint64_t segment_limit = 16 * 1024 * 1024;   // 单个分段超过该大小后换新分段
+    static constexpr size_t drain_batch = 64;                      // 每个数据库事务最多写入的评论数
+
+private:
+    struct Pending {
+        uint64_t seq;
+        db::PostWrite entry;
+        AppendHandler handler;
+    };
+    
+    struct Queued {
+        uint64_t seq;
+        db::PostWrite entry;
+    };
+    
+    struct Segment {
+        uint64_t first_seq;
+        std::string path;
+    };
+    
+    std::string dir;
+    boost::asio::any_io_executor executor;
+    DrainHandler on_drained;
+    db::DatabaseManager drain_db;
+    
+    mutable std::mutex mutex;
+    std::condition_variable write_cv;
+    std::condition_variable drain_cv;
+    bool stopping = false;
+    
+    std::vector<Pending> write_queue;                     // 等待组提交的追加
+    std::deque<Queued> drain_queue;                       // 已落盘、尚未入库
+    std::unordered_map<std::string, db::Post> index;      // 尚未入库的评论（供读取）
+    std::deque<Segment> segments;                         // 按序号排列，最后一个为当前写入的分段
+    uint64_t next_seq = 1;
+    uint64_t durable_seq = 0;                             // 已落盘的最大序号
+    uint64_t drained_seq = 0;                             // 该序号及之前的记录都已入库
+    
+    int segment_fd = -1;                                  // 只由写线程使用
+    uint64_t segment_size = 0;
+    
+    std::thread writer;
+    std::thread drainer;
+
+public:
+    SubmitLog(const std::string& dir, const std::string& db_connection,
+              boost::asio::any_io_executor executor, DrainHandler on_drained);
+    ~SubmitLog();
+    SubmitLog(const SubmitLog&) = delete;
+    SubmitLog& operator=(const SubmitLog&) = delete;
+    
+    // 回放已有日志并启动写线程、入库线程；目录不可用时返回false
+    bool open();
+    
+    // 入库事务同时发布变更通知（须在open之前调用）
+    void enable_change_events(const std::string& instance_id) { drain_db.enable_change_events(instance_id); }
+    
+    // 追加一条评论（io线程调用），落盘后在io线程上回调；created_at为空时取当前时间
+    void append(db::PostWrite entry, AppendHandler handler);
+    
+    // 尚未入库的评论
+    std::optional<db::Post> find(const std::string& id) const;
+    
+    // 尚未入库的评论数
+    size_t backlog() const;
+    
+    // 尚未入库的评论引用的图片路径（清理上传目录时视为仍被引用）
+    std::unordered_set<std::string> pending_images() const;
+    
+    // 停止后台线程；已确认的记录留在日志中，下次启动时继续入库
+    void stop();
+
+private:
+    void replay();
+    bool open_segment(uint64_t first_seq);
+    bool write_batch(const std::string& buffer, uint64_t first_seq);
+    void write_loop();
+    void drain_loop();
+    void checkpoint(uint64_t seq);
+    bool append_conflicts(const std::string& records);
+    void remove_drained_segments();
+};
+
+// 全局提交日志（定义于main.cpp，为空时直接写数据库）
+extern std::shared_ptr<SubmitLog> g_submit_log;
+
+} // namespace wal
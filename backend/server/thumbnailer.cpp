@@ -0,0 +1,456 @@
+#include "thumbnailer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef COMMENTFREE_HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+#ifdef COMMENTFREE_HAVE_LIBPNG
+#include <png.h>
+#endif
+#ifdef COMMENTFREE_HAVE_LIBWEBP
+#include <webp/decode.h>
+#include <webp/encode.h>
+#endif
+
+namespace media {
+
+namespace {
+
+// 8位RGB像素缓冲
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+// 解码前按文件头里的尺寸拒绝超大图片，防止小文件声明巨大尺寸耗尽内存（约50MP，RGB解码后150MB）
+constexpr uint64_t max_pixels = 50ull * 1000 * 1000;
+
+bool within_pixel_limit(uint64_t width, uint64_t height, const char* format) {
+    if (width * height <= max_pixels) {
+        return true;
+    }
+    std::cerr << format << "图片尺寸过大: " << width << "x" << height << std::endl;
+    return false;
+}
+
+#ifdef COMMENTFREE_HAVE_LIBJPEG
+// 默认的error_exit会直接退出进程；异常不能穿过libjpeg的C栈帧，改为longjmp回到调用处
+struct JpegError {
+    jpeg_error_mgr mgr;
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void jpeg_error_exit(j_common_ptr info) {
+    JpegError* error = reinterpret_cast<JpegError*>(info->err);
+    (*info->err->format_message)(info, error->message);
+    std::longjmp(error->jump, 1);
+}
+
+// 利用DCT缩放直接解码到不小于目标尺寸的分辨率，大图缩略时省掉大部分解码工作
+// setjmp之后不能有需要析构的局部对象
+bool decode_jpeg(const std::string& data, int target, Image& out) {
+    jpeg_decompress_struct cinfo;
+    JpegError jerr;
+    cinfo.err = jpeg_std_error(&jerr.mgr);
+    jerr.mgr.error_exit = jpeg_error_exit;
+    
+    if (setjmp(jerr.jump)) {
+        std::cerr << "JPEG解码失败: " << jerr.message << std::endl;
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, reinterpret_cast<const unsigned char*>(data.data()),
+                 static_cast<unsigned long>(data.size()));
+    jpeg_read_header(&cinfo, TRUE);
+    if (!within_pixel_limit(cinfo.image_width, cinfo.image_height, "JPEG")) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    unsigned int longest = std::max(cinfo.image_width, cinfo.image_height);
+    while (cinfo.scale_denom < 8 && longest / (cinfo.scale_denom * 2) >= static_cast<unsigned int>(target)) {
+        cinfo.scale_denom *= 2;
+    }
+    
+    jpeg_start_decompress(&cinfo);
+    out.width = static_cast<int>(cinfo.output_width);
+    out.height = static_cast<int>(cinfo.output_height);
+    out.pixels.resize(static_cast<size_t>(out.width) * out.height * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        unsigned char* row = out.pixels.data() + static_cast<size_t>(cinfo.output_scanline) * out.width * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+#endif
+
+#ifdef COMMENTFREE_HAVE_LIBPNG
+bool decode_png(const std::string& data, Image& out) {
+    png_image image{};
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, data.data(), data.size())) {
+        std::cerr << "PNG解码失败: " << image.message << std::endl;
+        return false;
+    }
+    if (!within_pixel_limit(image.width, image.height, "PNG")) {
+        png_image_free(&image);
+        return false;
+    }
+    
+    // 透明部分合成到白色背景上
+    image.format = PNG_FORMAT_RGB;
+    png_color background{255, 255, 255};
+    out.width = static_cast<int>(image.width);
+    out.height = static_cast<int>(image.height);
+    out.pixels.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, &background, out.pixels.data(), 0, nullptr)) {
+        std::cerr << "PNG解码失败: " << image.message << std::endl;
+        png_image_free(&image);
+        return false;
+    }
+    return true;
+}
+#endif
+
+#ifdef COMMENTFREE_HAVE_LIBWEBP
+bool decode_webp(const std::string& data, Image& out) {
+    int width = 0;
+    int height = 0;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    if (!WebPGetInfo(bytes, data.size(), &width, &height)) {
+        std::cerr << "WebP解码失败" << std::endl;
+        return false;
+    }
+    if (!within_pixel_limit(static_cast<uint64_t>(width), static_cast<uint64_t>(height), "WebP")) {
+        return false;
+    }
+    
+    uint8_t* rgb = WebPDecodeRGB(bytes, data.size(), &width, &height);
+    if (!rgb) {
+        std::cerr << "WebP解码失败" << std::endl;
+        return false;
+    }
+    out.width = width;
+    out.height = height;
+    out.pixels.assign(rgb, rgb + static_cast<size_t>(width) * height * 3);
+    WebPFree(rgb);
+    return true;
+}
+#endif
+
+// 面积平均缩小，长边不超过max_side；原图更小时不放大
+Image downscale(const Image& src, int max_side) {
+    int longest = std::max(src.width, src.height);
+    if (longest <= max_side) {
+        return src;
+    }
+    
+    Image dst;
+    dst.width = std::max(1, static_cast<int>(static_cast<int64_t>(src.width) * max_side / longest));
+    dst.height = std::max(1, static_cast<int>(static_cast<int64_t>(src.height) * max_side / longest));
+    dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * 3);
+    
+    for (int y = 0; y < dst.height; ++y) {
+        int y0 = static_cast<int>(static_cast<int64_t>(y) * src.height / dst.height);
+        int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(y + 1) * src.height / dst.height));
+        for (int x = 0; x < dst.width; ++x) {
+            int x0 = static_cast<int>(static_cast<int64_t>(x) * src.width / dst.width);
+            int x1 = std::max(x0 + 1, static_cast<int>(static_cast<int64_t>(x + 1) * src.width / dst.width));
+            
+            uint32_t sum[3] = {0, 0, 0};
+            for (int sy = y0; sy < y1; ++sy) {
+                const unsigned char* p = src.pixels.data() + (static_cast<size_t>(sy) * src.width + x0) * 3;
+                for (int sx = x0; sx < x1; ++sx, p += 3) {
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                }
+            }
+            uint32_t count = static_cast<uint32_t>((y1 - y0) * (x1 - x0));
+            unsigned char* q = dst.pixels.data() + (static_cast<size_t>(y) * dst.width + x) * 3;
+            q[0] = static_cast<unsigned char>(sum[0] / count);
+            q[1] = static_cast<unsigned char>(sum[1] / count);
+            q[2] = static_cast<unsigned char>(sum[2] / count);
+        }
+    }
+    return dst;
+}
+
+// 优先编码为WebP，没有libwebp时退回JPEG
+const char* variant_extension() {
+#ifdef COMMENTFREE_HAVE_LIBWEBP
+    return ".webp";
+#else
+    return ".jpg";
+#endif
+}
+
+bool encode(const Image& image, std::string& out) {
+#if defined(COMMENTFREE_HAVE_LIBWEBP)
+    uint8_t* data = nullptr;
+    size_t size = WebPEncodeRGB(image.pixels.data(), image.width, image.height, image.width * 3, 75.0f, &data);
+    if (size == 0) {
+        return false;
+    }
+    out.assign(reinterpret_cast<const char*>(data), size);
+    WebPFree(data);
+    return true;
+#elif defined(COMMENTFREE_HAVE_LIBJPEG)
+    jpeg_compress_struct cinfo;
+    JpegError jerr;
+    cinfo.err = jpeg_std_error(&jerr.mgr);
+    jerr.mgr.error_exit = jpeg_error_exit;
+    
+    // 输出缓冲区由libjpeg分配，出错时同样要释放
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    if (setjmp(jerr.jump)) {
+        std::cerr << "JPEG编码失败: " << jerr.message << std::endl;
+        jpeg_destroy_compress(&cinfo);
+        free(buffer);
+        return false;
+    }
+    
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+    cinfo.image_width = static_cast<JDIMENSION>(image.width);
+    cinfo.image_height = static_cast<JDIMENSION>(image.height);
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 80, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = const_cast<unsigned char*>(image.pixels.data()) +
+                       static_cast<size_t>(cinfo.next_scanline) * image.width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    out.assign(reinterpret_cast<const char*>(buffer), size);
+    free(buffer);
+    return true;
+#else
+    (void)image;
+    (void)out;
+    return false;
+#endif
+}
+
+bool decode(const std::string& data, const std::string& mime_type, int target, Image& out) {
+#ifdef COMMENTFREE_HAVE_LIBJPEG
+    if (mime_type == "image/jpeg") {
+        return decode_jpeg(data, target, out);
+    }
+#endif
+#ifdef COMMENTFREE_HAVE_LIBPNG
+    if (mime_type == "image/png") {
+        return decode_png(data, out);
+    }
+#endif
+#ifdef COMMENTFREE_HAVE_LIBWEBP
+    if (mime_type == "image/webp") {
+        return decode_webp(data, out);
+    }
+#endif
+    (void)data;
+    (void)mime_type;
+    (void)target;
+    (void)out;
+    return false;
+}
+
+bool decodable(const std::string& mime_type) {
+#ifdef COMMENTFREE_HAVE_LIBJPEG
+    if (mime_type == "image/jpeg") return true;
+#endif
+#ifdef COMMENTFREE_HAVE_LIBPNG
+    if (mime_type == "image/png") return true;
+#endif
+#ifdef COMMENTFREE_HAVE_LIBWEBP
+    if (mime_type == "image/webp") return true;
+#endif
+    (void)mime_type;
+    return false;
+}
+
+// 先写同目录下的唯一临时文件再改名，读者不会看到写了一半的文件；
+// 相同内容的图片同时生成变体时各写各的临时文件，不会互相截断
+bool write_file(const std::string& path, const std::string& data) {
+    std::error_code ec;
+#ifdef _WIN32
+    static std::atomic<uint64_t> temp_counter{0};
+    std::string temp_path = path + ".part." + std::to_string(temp_counter++);
+    std::ofstream file(temp_path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    file.close();
+    bool written = static_cast<bool>(file);
+#else
+    std::string temp_path = path + ".part.XXXXXX";
+    int fd = ::mkstemp(temp_path.data());
+    if (fd < 0) {
+        return false;
+    }
+    // mkstemp按0600创建，变体与原图一样需要对静态文件服务可读
+    bool written = ::fchmod(fd, 0644) == 0;
+    for (size_t offset = 0; written && offset < data.size();) {
+        ssize_t n = ::write(fd, data.data() + offset, data.size() - offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        written = n > 0;
+        offset += n > 0 ? static_cast<size_t>(n) : 0;
+    }
+    written = ::close(fd) == 0 && written;
+#endif
+    
+    if (!written) {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+Thumbnailer::Thumbnailer(size_t threads, size_t max_queue, std::function<void(const VariantResult&)> on_done)
+    : max_queue(max_queue), on_done(std::move(on_done)) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+Thumbnailer::~Thumbnailer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+bool Thumbnailer::available() {
+#if defined(COMMENTFREE_HAVE_LIBJPEG) || defined(COMMENTFREE_HAVE_LIBPNG) || defined(COMMENTFREE_HAVE_LIBWEBP)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Thumbnailer::enqueue(const std::string& source_path, const std::string& mime_type) {
+    if (!decodable(mime_type)) {
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.size() >= max_queue) {
+            std::cerr << "缩略图队列已满，跳过: " << source_path << std::endl;
+            return false;
+        }
+        jobs.push_back(Job{source_path, mime_type});
+    }
+    cv.notify_one();
+    return true;
+}
+
+void Thumbnailer::worker_loop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        
+        try {
+            VariantResult result = process(job);
+            if (!result.thumbnail_path.empty() || !result.medium_path.empty()) {
+                on_done(result);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "生成缩略图异常: " << e.what() << std::endl;
+        }
+    }
+}
+
+VariantResult Thumbnailer::process(const Job& job) {
+    VariantResult result;
+    result.source_path = job.source_path;
+    
+    // 原图按内容寻址，变体路径由原图路径决定；已生成过（重复上传）时直接复用
+    std::filesystem::path source(job.source_path);
+    std::string stem = (source.parent_path() / source.stem()).string();
+    std::string thumbnail_path = stem + "_thumb" + variant_extension();
+    std::string medium_path = stem + "_medium" + variant_extension();
+    if (std::filesystem::exists(thumbnail_path) && std::filesystem::exists(medium_path)) {
+        result.thumbnail_path = thumbnail_path;
+        result.medium_path = medium_path;
+        return result;
+    }
+    
+    std::ifstream file(job.source_path, std::ios::binary);
+    if (!file.is_open()) {
+        return result;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    
+    // 以中图尺寸为解码目标，缩略图再从中图缩小
+    Image original;
+    if (!decode(data, job.mime_type, medium_size, original)) {
+        return result;
+    }
+    
+    Image medium = downscale(original, medium_size);
+    Image thumbnail = downscale(medium, thumbnail_size);
+    
+    std::string encoded;
+    if (encode(medium, encoded) && write_file(medium_path, encoded)) {
+        result.medium_path = medium_path;
+    }
+    if (encode(thumbnail, encoded) && write_file(thumbnail_path, encoded)) {
+        result.thumbnail_path = thumbnail_path;
+    }
+    return result;
+}
+
+} // namespace media
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace media {
+
+// 一张原图生成的缩略图与中图路径（未生成的为空）
+struct VariantResult {
+    std::string source_path;
+    std::string thumbnail_path;
+    std::string medium_path;
+};
+
+// 后台缩略图生成：有界队列 + 固定数量工作线程，提交评论时只入队不等待
+// 解码/编码依赖可选的系统库（libjpeg、libpng、libwebp），编译时未找到则不可用
+// 完成回调在工作线程上调用，需要访问数据库时应投递回io线程
+class Thumbnailer {
+public:
+    static constexpr int thumbnail_size = 320;   // 长边像素
+    static constexpr int medium_size = 1280;
+    
+private:
+    struct Job {
+        std::string source_path;
+        std::string mime_type;
+    };
+    
+    size_t max_queue;
+    std::function<void(const VariantResult&)> on_done;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+    
+public:
+    Thumbnailer(size_t threads, size_t max_queue, std::function<void(const VariantResult&)> on_done);
+    ~Thumbnailer();
+    Thumbnailer(const Thumbnailer&) = delete;
+    Thumbnailer& operator=(const Thumbnailer&) = delete;
+    
+    // 编译时是否带了至少一种解码器
+    static bool available();
+    
+    // 入队一张原图，队列已满或格式不支持时返回false
+    bool enqueue(const std::string& source_path, const std::string& mime_type);
+    
+private:
+    void worker_loop();
+    VariantResult process(const Job& job);
+};
+
+// 全局缩略图生成器（定义于main.cpp）
+extern std::shared_ptr<Thumbnailer> g_thumbnailer;
+
+} // namespace media
@@ -0,0 +1,221 @@
+#include "tls.hpp"
+#include <boost/asio/ssl/error.hpp>
+#include <openssl/err.h>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace tls {
+
+namespace {
+
+std::string last_error() {
+    char buffer[256];
+    ERR_error_string_n(ERR_get_error(), buffer, sizeof(buffer));
+    return buffer;
+}
+
+// 只支持HTTP/1.1：客户端同时提供h2时选http/1.1，没有提供http/1.1时不协商ALPN
+int select_alpn(SSL*, const unsigned char** out, unsigned char* outlen, const unsigned char* in,
+                unsigned int inlen, void*) {
+    static const unsigned char http11[] = "\x08http/1.1";
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outlen, http11, sizeof(http11) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+} // namespace
+
+Context::~Context() {
+    if (ctx) {
+        SSL_CTX_free(ctx);
+    }
+}
+
+std::shared_ptr<Context> Context::create(const Options& options) {
+    auto context = std::make_shared<Context>();
+    context->ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX* ctx = context->ctx;
+    if (!ctx) {
+        std::cerr << "创建TLS上下文失败: " << last_error() << std::endl;
+        return nullptr;
+    }
+    
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+#ifdef SSL_OP_ENABLE_KTLS
+    // 握手完成后把记录层交给内核（需要内核tls模块和AES-GCM/ChaCha20套件），不可用时自动退回用户态
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+    // 部分写入：一次写不完时返回已写字节数，由Beast的写操作继续
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_alpn_select_cb(ctx, select_alpn, nullptr);
+    
+    if (SSL_CTX_use_certificate_chain_file(ctx, options.certificate_file.c_str()) != 1) {
+        std::cerr << "加载TLS证书失败: " << options.certificate_file << ": " << last_error() << std::endl;
+        return nullptr;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, options.private_key_file.c_str(), SSL_FILETYPE_PEM) != 1) {
+        std::cerr << "加载TLS私钥失败: " << options.private_key_file << ": " << last_error() << std::endl;
+        return nullptr;
+    }
+    if (SSL_CTX_check_private_key(ctx) != 1) {
+        std::cerr << "TLS私钥与证书不匹配" << std::endl;
+        return nullptr;
+    }
+    
+    // 会话复用：TLS 1.2的会话ID走服务端缓存，TLS 1.3和支持票据的客户端走会话票据（服务端无状态）
+    static const unsigned char session_context[] = "commentfree";
+    SSL_CTX_set_session_id_context(ctx, session_context, sizeof(session_context) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, options.session_cache_size);
+    SSL_CTX_set_timeout(ctx, options.session_timeout);
+    SSL_CTX_set_num_tickets(ctx, 1);
+    
+    // 多实例共享票据密钥，任一实例签发的票据在其他实例上也能复用
+    if (!options.ticket_key_file.empty()) {
+        std::ifstream file(options.ticket_key_file, std::ios::binary);
+        std::string keys((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (keys.size() != 80) {
+            std::cerr << "TLS票据密钥文件须为80字节: " << options.ticket_key_file << std::endl;
+            return nullptr;
+        }
+        if (SSL_CTX_set_tlsext_ticket_keys(ctx, keys.data(), static_cast<long>(keys.size())) != 1) {
+            std::cerr << "设置TLS票据密钥失败: " << last_error() << std::endl;
+            return nullptr;
+        }
+    }
+    
+    return context;
+}
+
+bool Context::kernel_supports_ktls() {
+    std::ifstream file("/proc/sys/net/ipv4/tcp_available_ulp");
+    std::string name;
+    while (file >> name) {
+        if (name == "tls") {
+            return true;
+        }
+    }
+    return false;
+}
+
+Stream::Stream(boost::asio::ip::tcp::socket& socket, std::shared_ptr<Context> context)
+    : socket_(socket), context_(std::move(context)), read_timer_(socket.get_executor()),
+      write_timer_(socket.get_executor()) {
+    ssl_ = SSL_new(context_->native_handle());
+    
+    // OpenSSL直接读写套接字（非阻塞），kTLS要求socket BIO
+    boost::beast::error_code ec;
+    socket_.non_blocking(true, ec);
+    if (ssl_) {
+        SSL_set_fd(ssl_, static_cast<int>(socket_.native_handle()));
+    }
+}
+
+Stream::~Stream() {
+    if (ssl_) {
+        SSL_free(ssl_);
+    }
+}
+
+void Stream::shutdown() {
+    if (ssl_ && SSL_is_init_finished(ssl_) && socket_.is_open()) {
+        ERR_clear_error();
+        SSL_shutdown(ssl_);
+    }
+}
+
+Stream::Step Stream::translate(int result, boost::beast::error_code& ec) {
+    int error = SSL_get_error(ssl_, result);
+    switch (error) {
+        case SSL_ERROR_WANT_READ:
+            return Step::want_read;
+        case SSL_ERROR_WANT_WRITE:
+            return Step::want_write;
+        case SSL_ERROR_ZERO_RETURN:
+            ec = boost::asio::error::eof;
+            return Step::failed;
+        case SSL_ERROR_SYSCALL:
+            // 对方未发close_notify直接断开，按连接结束处理
+            ec = errno == 0 ? boost::beast::error_code(boost::asio::error::eof)
+                            : boost::beast::error_code(errno, boost::system::system_category());
+            return Step::failed;
+        default:
+            ec = boost::beast::error_code(static_cast<int>(ERR_get_error()), boost::asio::error::get_ssl_category());
+            return Step::failed;
+    }
+}
+
+Stream::Step Stream::handshake_step(boost::beast::error_code& ec) {
+    if (!ssl_) {
+        ec = boost::asio::error::no_memory;
+        return Step::failed;
+    }
+    
+    ERR_clear_error();
+    errno = 0;
+    int result = SSL_accept(ssl_);
+    if (result != 1) {
+        Step step = translate(result, ec);
+        if (step == Step::failed) {
+            ++context_->stats().failed;
+        }
+        return step;
+    }
+    
+    // 握手完成：记录复用和内核接管情况
+    Stats& stats = context_->stats();
+    ++stats.handshakes;
+    if (SSL_session_reused(ssl_)) {
+        ++stats.resumed;
+    }
+#ifdef BIO_CTRL_GET_KTLS_SEND
+    ktls_send_ = BIO_ctrl(SSL_get_wbio(ssl_), BIO_CTRL_GET_KTLS_SEND, 0, nullptr) > 0;
+    ktls_recv_ = BIO_ctrl(SSL_get_rbio(ssl_), BIO_CTRL_GET_KTLS_RECV, 0, nullptr) > 0;
+#endif
+    if (ktls_send_) {
+        ++stats.ktls_send;
+    }
+    if (ktls_recv_) {
+        ++stats.ktls_recv;
+    }
+    return Step::done;
+}
+
+Stream::Step Stream::read_step(boost::asio::mutable_buffer buffer, size_t& bytes, boost::beast::error_code& ec) {
+    if (buffer.size() == 0) {
+        return Step::done;
+    }
+    
+    // 内核解密时SSL_read直接recvmsg明文，并处理内核交上来的控制记录（警报、会话票据等）
+    ERR_clear_error();
+    errno = 0;
+    int result = SSL_read_ex(ssl_, buffer.data(), buffer.size(), &bytes);
+    return result == 1 ? Step::done : translate(result, ec);
+}
+
+Stream::Step Stream::write_step(size_t& bytes, boost::beast::error_code& ec) {
+    if (scratch_size_ == 0) {
+        return Step::done;
+    }
+    
+    ERR_clear_error();
+    errno = 0;
+    int result = SSL_write_ex(ssl_, scratch_.data(), scratch_size_, &bytes);
+    if (result == 1) {
+        scratch_size_ = 0;
+        return Step::done;
+    }
+    Step step = translate(result, ec);
+    if (step == Step::failed) {
+        scratch_size_ = 0;
+    }
+    return step;
+}
+
+} // namespace tls
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+#include <boost/beast/core/buffers_prefix.hpp>
+#include <boost/beast/core/error.hpp>
+#include <openssl/ssl.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace tls {
+
+// HTTPS监听的证书与会话复用配置
+// 本地测试可用自签名证书：
+//   openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj /CN=localhost
+struct Options {
+    std::string certificate_file;   // PEM证书链
+    std::string private_key_file;   // PEM私钥
+    std::string ticket_key_file;    // 80字节会话票据密钥，多实例共享时各实例用同一份；为空则进程内随机生成
+    long session_cache_size = 20000;
+    long session_timeout = 3600;    // 秒
+};
+
+// 握手与复用统计（供指标导出）
+struct Stats {
+    std::atomic<uint64_t> handshakes{0};
+    std::atomic<uint64_t> resumed{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> ktls_send{0};
+    std::atomic<uint64_t> ktls_recv{0};
+};
+
+// 服务端SSL_CTX：只用TLS 1.2及以上，ALPN只协商http/1.1，开启会话缓存、会话票据和kTLS
+class Context {
+private:
+    SSL_CTX* ctx = nullptr;
+    Stats stats_;
+
+public:
+    Context() = default;
+    ~Context();
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    
+    // 加载证书和私钥，失败时输出原因并返回nullptr
+    static std::shared_ptr<Context> create(const Options& options);
+    
+    SSL_CTX* native_handle() const { return ctx; }
+    Stats& stats() { return stats_; }
+    
+    // 本机是否加载了内核TLS模块（tcp_available_ulp含tls）
+    static bool kernel_supports_ktls();
+};
+
+// 直接在套接字上运行的TLS流（OpenSSL socket BIO），满足Beast的AsyncReadStream/AsyncWriteStream
+// 不用asio::ssl::stream：它经内存BIO中转，OpenSSL无法把密钥交给内核
+// 握手后内核接管加解密（kTLS）时，写响应直接writev明文，不再经用户态加密和复制；
+// 没有kTLS时退回SSL_read/SSL_write
+// 套接字由调用方持有（HttpSession的tcp_stream），只在io线程上使用
+class Stream {
+public:
+    using executor_type = boost::asio::ip::tcp::socket::executor_type;
+    using clock = std::chrono::steady_clock;
+    
+    // 用户态加密时小缓冲区合并成一条记录再写，避免每个头部字段一条TLS记录
+    static constexpr size_t max_record = 16384;
+
+private:
+    boost::asio::ip::tcp::socket& socket_;
+    std::shared_ptr<Context> context_;
+    SSL* ssl_ = nullptr;
+    bool ktls_send_ = false;
+    bool ktls_recv_ = false;
+    
+    // 超时语义与tcp_stream一致：到期关闭套接字，挂起的操作以timeout结束
+    clock::time_point deadline_ = clock::time_point::max();
+    bool timed_out_ = false;
+    boost::asio::steady_timer read_timer_;
+    boost::asio::steady_timer write_timer_;
+    
+    std::array<char, max_record> scratch_;
+    size_t scratch_size_ = 0;       // 待重试的合并写入（SSL_write要求重试时数据不变）
+
+public:
+    Stream(boost::asio::ip::tcp::socket& socket, std::shared_ptr<Context> context);
+    ~Stream();
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+    
+    executor_type get_executor() { return socket_.get_executor(); }
+    boost::asio::ip::tcp::socket& socket() { return socket_; }
+    
+    void expires_after(clock::duration duration) { deadline_ = clock::now() + duration; }
+    void expires_never() { deadline_ = clock::time_point::max(); }
+    
+    bool ktls_send() const { return ktls_send_; }
+    bool ktls_recv() const { return ktls_recv_; }
+    
+    // 发送close_notify（尽力而为，不等待对方）
+    void shutdown();
+    
+    template<class Token>
+    auto async_handshake(Token&& token);
+    
+    template<class MutableBufferSequence, class Token>
+    auto async_read_some(const MutableBufferSequence& buffers, Token&& token);
+    
+    template<class ConstBufferSequence, class Token>
+    auto async_write_some(const ConstBufferSequence& buffers, Token&& token);
+
+private:
+    // 一次非阻塞尝试的结果
+    enum class Step { done, want_read, want_write, failed };
+    
+    Step handshake_step(boost::beast::error_code& ec);
+    Step read_step(boost::asio::mutable_buffer buffer, size_t& bytes, boost::beast::error_code& ec);
+    Step write_step(size_t& bytes, boost::beast::error_code& ec);
+    Step translate(int result, boost::beast::error_code& ec);
+    
+    // 等待套接字可读/可写，期间受deadline_限制
+    template<class Handler>
+    void wait(Step step, boost::asio::steady_timer& timer, Handler handler);
+    
+    // 首次尝试即完成时投递完成回调，不在发起函数内直接调用
+    template<class Handler, class... Args>
+    void complete(bool waited, Handler& handler, Args... args);
+    
+    template<class Handler>
+    void handshake_op(Handler handler, bool waited);
+    
+    template<class Handler>
+    void read_op(boost::asio::mutable_buffer buffer, Handler handler, bool waited);
+    
+    template<class ConstBufferSequence, class Handler>
+    void write_op(const ConstBufferSequence& buffers, Handler handler, bool waited);
+};
+
+template<class Handler, class... Args>
+void Stream::complete(bool waited, Handler& handler, Args... args) {
+    if (waited) {
+        std::move(handler)(args...);
+        return;
+    }
+    auto executor = boost::asio::get_associated_executor(handler, get_executor());
+    boost::asio::post(executor, boost::beast::bind_front_handler(std::move(handler), args...));
+}
+
+template<class Handler>
+void Stream::wait(Step step, boost::asio::steady_timer& timer, Handler handler) {
+    if (deadline_ != clock::time_point::max()) {
+        timer.expires_at(deadline_);
+        timer.async_wait([this](boost::beast::error_code ec) {
+            if (!ec) {
+                timed_out_ = true;
+                socket_.close(ec);
+            }
+        });
+    }
+    auto type = step == Step::want_read ? boost::asio::ip::tcp::socket::wait_read
+                                        : boost::asio::ip::tcp::socket::wait_write;
+    socket_.async_wait(type, [this, &timer, handler = std::move(handler)](boost::beast::error_code ec) mutable {
+        timer.cancel();
+        if (timed_out_) {
+            ec = boost::beast::error::timeout;
+        }
+        handler(ec);
+    });
+}
+
+template<class Handler>
+void Stream::handshake_op(Handler handler, bool waited) {
+    boost::beast::error_code ec;
+    Step step = handshake_step(ec);
+    if (step == Step::done || step == Step::failed) {
+        return complete(waited, handler, ec);
+    }
+    wait(step, read_timer_, [this, handler = std::move(handler)](boost::beast::error_code ec) mutable {
+        if (ec) {
+            return complete(true, handler, ec);
+        }
+        handshake_op(std::move(handler), true);
+    });
+}
+
+template<class Handler>
+void Stream::read_op(boost::asio::mutable_buffer buffer, Handler handler, bool waited) {
+    boost::beast::error_code ec;
+    size_t bytes = 0;
+    Step step = read_step(buffer, bytes, ec);
+    if (step == Step::done || step == Step::failed) {
+        return complete(waited, handler, ec, bytes);
+    }
+    wait(step, read_timer_, [this, buffer, handler = std::move(handler)](boost::beast::error_code ec) mutable {
+        if (ec) {
+            return complete(true, handler, ec, size_t(0));
+        }
+        read_op(buffer, std::move(handler), true);
+    });
+}
+
+template<class ConstBufferSequence, class Handler>
+void Stream::write_op(const ConstBufferSequence& buffers, Handler handler, bool waited) {
+    boost::beast::error_code ec;
+    size_t bytes = 0;
+    Step step;
+    if (ktls_send_) {
+        // 内核加密：整个缓冲区序列一次writev，由内核切分记录
+        bytes = socket_.write_some(buffers, ec);
+        step = ec == boost::asio::error::would_block ? Step::want_write : Step::done;
+    } else {
+        if (scratch_size_ == 0) {
+            scratch_size_ = boost::asio::buffer_copy(boost::asio::buffer(scratch_), buffers);
+        }
+        step = write_step(bytes, ec);
+    }
+    if (step == Step::done || step == Step::failed) {
+        return complete(waited, handler, ec, bytes);
+    }
+    wait(step, write_timer_, [this, buffers, handler = std::move(handler)](boost::beast::error_code ec) mutable {
+        if (ec) {
+            scratch_size_ = 0;
+            return complete(true, handler, ec, size_t(0));
+        }
+        write_op(buffers, std::move(handler), true);
+    });
+}
+
+template<class Token>
+auto Stream::async_handshake(Token&& token) {
+    return boost::asio::async_initiate<Token, void(boost::beast::error_code)>(
+        [this](auto handler) {
+            handshake_op(std::move(handler), false);
+        },
+        token);
+}
+
+template<class MutableBufferSequence, class Token>
+auto Stream::async_read_some(const MutableBufferSequence& buffers, Token&& token) {
+    return boost::asio::async_initiate<Token, void(boost::beast::error_code, size_t)>(
+        [this](auto handler, boost::asio::mutable_buffer buffer) {
+            read_op(buffer, std::move(handler), false);
+        },
+        token, boost::beast::buffers_front(buffers));
+}
+
+template<class ConstBufferSequence, class Token>
+auto Stream::async_write_some(const ConstBufferSequence& buffers, Token&& token) {
+    return boost::asio::async_initiate<Token, void(boost::beast::error_code, size_t)>(
+        [this](auto handler, const ConstBufferSequence& buffers) {
+            write_op(buffers, std::move(handler), false);
+        },
+        token, buffers);
+}
+
+} // namespace tls
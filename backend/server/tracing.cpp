@@ -0,0 +1,169 @@
+#include "tracing.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define COMMENTFREE_HAVE_RDTSC 1
+#endif
+
+namespace tracing {
+
+namespace {
+
+bool server_timing_enabled = false;
+uint64_t sample_every = 0;          // 0表示不写追踪文件
+double nanos_per_tick = 1.0;
+
+std::mutex trace_file_mutex;
+std::ofstream trace_file;
+
+thread_local RequestTrace* current_trace = nullptr;
+thread_local uint64_t sample_counter = 0;
+
+// 用steady_clock标定TSC频率
+double calibrate_ticks() {
+#ifdef COMMENTFREE_HAVE_RDTSC
+    auto wall_start = std::chrono::steady_clock::now();
+    uint64_t tick_start = now_ticks();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t tick_end = now_ticks();
+    auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - wall_start).count();
+    if (tick_end > tick_start) {
+        return static_cast<double>(wall_ns) / static_cast<double>(tick_end - tick_start);
+    }
+#endif
+    return 1.0;
+}
+
+double ticks_to_ms(uint64_t ticks) {
+    return static_cast<double>(ticks) * nanos_per_tick / 1e6;
+}
+
+} // namespace
+
+uint64_t now_ticks() {
+#ifdef COMMENTFREE_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void configure(bool server_timing, const std::string& trace_path, double sample_rate) {
+    server_timing_enabled = server_timing;
+    sample_every = 0;
+    
+    if (!trace_path.empty() && sample_rate > 0.0) {
+        trace_file.open(trace_path, std::ios::app);
+        if (!trace_file.is_open()) {
+            std::cerr << "无法打开追踪文件: " << trace_path << std::endl;
+        } else {
+            sample_every = static_cast<uint64_t>(std::llround(1.0 / std::min(sample_rate, 1.0)));
+        }
+    }
+    
+    if (server_timing_enabled || sample_every) {
+        nanos_per_tick = calibrate_ticks();
+    }
+}
+
+RequestTrace::RequestTrace() {
+    // 按1/N计数采样，不需要随机数
+    sampled = sample_every && ++sample_counter % sample_every == 0;
+    if (!server_timing_enabled && !sampled) {
+        return;
+    }
+    
+    enabled = true;
+    start_ticks = now_ticks();
+    resume();
+}
+
+RequestTrace::~RequestTrace() {
+    suspend();
+}
+
+void RequestTrace::suspend() {
+    if (active) {
+        current_trace = previous;
+        active = false;
+    }
+}
+
+void RequestTrace::resume() {
+    if (enabled && !active) {
+        previous = current_trace;
+        current_trace = this;
+        active = true;
+    }
+}
+
+RequestTrace* RequestTrace::current() {
+    return current_trace;
+}
+
+void RequestTrace::add_span(const char* name, uint64_t start, uint64_t end) {
+    if (span_count < max_spans) {
+        spans[span_count++] = SpanRecord{name, start, end};
+    }
+}
+
+std::string RequestTrace::server_timing() const {
+    if (!enabled || !server_timing_enabled) {
+        return "";
+    }
+    
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (size_t i = 0; i < span_count; ++i) {
+        out << spans[i].name << ";dur=" << ticks_to_ms(spans[i].end - spans[i].start) << ", ";
+    }
+    out << "total;dur=" << ticks_to_ms(now_ticks() - start_ticks);
+    return out.str();
+}
+
+void RequestTrace::finish(const std::string& method, const std::string& target, unsigned status) {
+    if (!sampled) {
+        return;
+    }
+    
+    uint64_t end_ticks = now_ticks();
+    auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    
+    std::ostringstream line;
+    line.setf(std::ios::fixed);
+    line.precision(3);
+    line << "{\"ts\":" << wall_ms
+         << ",\"method\":\"" << utils::JsonUtils::escape_json_string(method) << "\""
+         << ",\"target\":\"" << utils::JsonUtils::escape_json_string(target) << "\""
+         << ",\"status\":" << status
+         << ",\"total_ms\":" << ticks_to_ms(end_ticks - start_ticks)
+         << ",\"spans\":[";
+    for (size_t i = 0; i < span_count; ++i) {
+        if (i > 0) {
+            line << ",";
+        }
+        line << "{\"name\":\"" << spans[i].name << "\""
+             << ",\"start_ms\":" << ticks_to_ms(spans[i].start - start_ticks)
+             << ",\"dur_ms\":" << ticks_to_ms(spans[i].end - spans[i].start) << "}";
+    }
+    line << "]}\n";
+    
+    std::lock_guard<std::mutex> lock(trace_file_mutex);
+    trace_file << line.str();
+    trace_file.flush();
+}
+
+} // namespace tracing
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace tracing {
+
+// 时间戳：x86上读TSC，其他平台退化为steady_clock纳秒
+uint64_t now_ticks();
+
+// 启动时配置：是否输出Server-Timing头、采样写入的JSON追踪文件与采样率
+// 两者都关闭时Span只有一次线程局部变量读取和分支
+void configure(bool server_timing, const std::string& trace_file, double sample_rate);
+
+// 单个请求的分段记录，同一线程同时只有一个活动请求
+class RequestTrace {
+public:
+    static constexpr size_t max_spans = 16;
+    
+private:
+    struct SpanRecord {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+    
+    std::array<SpanRecord, max_spans> spans{};
+    size_t span_count = 0;
+    uint64_t start_ticks = 0;
+    bool enabled = false;
+    bool sampled = false;
+    bool active = false;
+    RequestTrace* previous = nullptr;
+    
+public:
+    RequestTrace();
+    ~RequestTrace();
+    RequestTrace(const RequestTrace&) = delete;
+    RequestTrace& operator=(const RequestTrace&) = delete;
+    
+    // 当前线程上活动的请求，未启用追踪时为nullptr
+    static RequestTrace* current();
+    
+    void add_span(const char* name, uint64_t start, uint64_t end);
+    
+    // 请求挂起等待异步I/O时让出当前线程，完成回调中再恢复
+    void suspend();
+    void resume();
+    
+    // Server-Timing头的值，未启用时返回空串
+    std::string server_timing() const;
+    
+    // 被采样的请求写一行JSON到追踪文件
+    void finish(const std::string& method, const std::string& target, unsigned status);
+};
+
+// 异步回调作用域内恢复请求的追踪上下文（trace可为nullptr）
+class ResumeScope {
+private:
+    RequestTrace* trace;
+    
+public:
+    explicit ResumeScope(RequestTrace* trace) : trace(trace) {
+        if (trace) {
+            trace->resume();
+        }
+    }
+    ~ResumeScope() {
+        if (trace) {
+            trace->suspend();
+        }
+    }
+    ResumeScope(const ResumeScope&) = delete;
+    ResumeScope& operator=(const ResumeScope&) = delete;
+};
+
+// 作用域内的一个分段，name须为字符串字面量
+class Span {
+private:
+    RequestTrace* trace;
+    const char* name;
+    uint64_t start;
+    
+public:
+    explicit Span(const char* name)
+        : trace(RequestTrace::current()), name(name), start(trace ? now_ticks() : 0) {}
+    ~Span() {
+        if (trace) {
+            trace->add_span(name, start, now_ticks());
+        }
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+};
+
+// 协程里包住一次co_await的分段：挂起期间io线程会运行其他请求，先让出追踪上下文，
+// 析构时（协程已恢复）重新激活并记录等待耗时
+class AwaitSpan {
+private:
+    RequestTrace* trace;
+    const char* name;
+    uint64_t start;
+    
+public:
+    explicit AwaitSpan(const char* name)
+        : trace(RequestTrace::current()), name(name), start(trace ? now_ticks() : 0) {
+        if (trace) {
+            trace->suspend();
+        }
+    }
+    ~AwaitSpan() {
+        if (trace) {
+            trace->resume();
+            trace->add_span(name, start, now_ticks());
+        }
+    }
+    AwaitSpan(const AwaitSpan&) = delete;
+    AwaitSpan& operator=(const AwaitSpan&) = delete;
+};
+
+} // namespace tracing
@@ -0,0 +1,246 @@
+#include "trending.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace trending {
+
+namespace {
+
+// 64位混合函数（splitmix64），把同一个哈希值派生成各行独立的哈希
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// 前向衰减的指数超过该值时平移基准点，避免double溢出
+constexpr double max_exponent = 40.0;
+
+} // namespace
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : width(width), depth(depth), cells(width * depth, 0.0) {
+}
+
+size_t CountMinSketch::cell_index(size_t row, size_t hash) const {
+    return row * width + static_cast<size_t>(mix64(hash + row) % width);
+}
+
+double CountMinSketch::add(const std::string& key, double amount) {
+    size_t hash = std::hash<std::string>{}(key);
+    double result = std::numeric_limits<double>::max();
+    
+    for (size_t row = 0; row < depth; ++row) {
+        double& cell = cells[cell_index(row, hash)];
+        cell += amount;
+        result = std::min(result, cell);
+    }
+    return result;
+}
+
+double CountMinSketch::estimate(const std::string& key) const {
+    size_t hash = std::hash<std::string>{}(key);
+    double result = std::numeric_limits<double>::max();
+    
+    for (size_t row = 0; row < depth; ++row) {
+        result = std::min(result, cells[cell_index(row, hash)]);
+    }
+    return result;
+}
+
+void CountMinSketch::scale(double factor) {
+    for (auto& cell : cells) {
+        cell *= factor;
+    }
+}
+
+void CountMinSketch::save(snapshot::Writer& out) const {
+    out.put_u64(width);
+    out.put_u64(depth);
+    out.put_doubles(cells);
+}
+
+bool CountMinSketch::load(snapshot::Reader& in) {
+    uint64_t saved_width = 0;
+    uint64_t saved_depth = 0;
+    std::vector<double> saved_cells;
+    if (!in.get_u64(saved_width) || !in.get_u64(saved_depth) || !in.get_doubles(saved_cells)) {
+        return false;
+    }
+    if (saved_width != width || saved_depth != depth || saved_cells.size() != cells.size()) {
+        return false;
+    }
+    cells.swap(saved_cells);
+    return true;
+}
+
+TrendingIndex::TrendingIndex(size_t capacity, double half_life_seconds)
+    : capacity(capacity == 0 ? 1 : capacity),
+      half_life_seconds(half_life_seconds),
+      landmark(clock::now()) {
+    top.reserve(this->capacity + 1);
+}
+
+void TrendingIndex::record_view(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    record(id, view_weight, clock::now());
+}
+
+void TrendingIndex::record_like(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    record(id, like_weight, clock::now());
+}
+
+void TrendingIndex::seed(const std::string& id, int view_count, int like_count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    double weight = view_count * view_weight + like_count * like_weight;
+    if (weight > 0) {
+        record(id, weight, clock::now());
+    }
+}
+
+double TrendingIndex::decay_exponent(clock::time_point now) const {
+    double elapsed = std::chrono::duration<double>(now - landmark).count();
+    return elapsed / half_life_seconds;
+}
+
+void TrendingIndex::rescale_if_needed(clock::time_point now) {
+    double exponent = decay_exponent(now);
+    if (exponent < max_exponent) {
+        return;
+    }
+    
+    // 把基准点移到当前时刻，所有已有分数按比例缩小
+    double factor = std::exp2(-exponent);
+    sketch.scale(factor);
+    for (auto& [id, score] : top) {
+        score *= factor;
+    }
+    min_score *= factor;
+    landmark = now;
+}
+
+void TrendingIndex::record(const std::string& id, double weight, clock::time_point now) {
+    rescale_if_needed(now);
+    
+    double scaled = weight * std::exp2(decay_exponent(now));
+    double estimate = sketch.add(id, scaled);
+    
+    auto it = top.find(id);
+    if (it != top.end()) {
+        it->second = estimate;
+        return;
+    }
+    
+    if (top.size() < capacity) {
+        top.emplace(id, estimate);
+        if (top.size() == 1 || estimate < min_score) {
+            min_score = estimate;
+        }
+        return;
+    }
+    
+    // min_score只是下界，真正淘汰前重新计算最小值
+    if (estimate <= min_score) {
+        return;
+    }
+    refresh_min();
+    if (estimate <= min_score) {
+        return;
+    }
+    
+    auto victim = std::min_element(top.begin(), top.end(),
+        [](const auto& a, const auto& b) { return a.second < b.second; });
+    top.erase(victim);
+    top.emplace(id, estimate);
+    refresh_min();
+}
+
+void TrendingIndex::refresh_min() {
+    min_score = std::numeric_limits<double>::max();
+    for (const auto& [id, score] : top) {
+        min_score = std::min(min_score, score);
+    }
+    if (top.empty()) {
+        min_score = 0.0;
+    }
+}
+
+void TrendingIndex::save(snapshot::Writer& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    out.put_f64(half_life_seconds);
+    out.put_u64(static_cast<uint64_t>(snapshot::to_wall_ms(landmark)));
+    sketch.save(out);
+    out.put_u64(top.size());
+    for (const auto& [id, score] : top) {
+        out.put_string(id);
+        out.put_f64(score);
+    }
+}
+
+bool TrendingIndex::load(snapshot::Reader& in) {
+    double saved_half_life = 0.0;
+    uint64_t landmark_ms = 0;
+    uint64_t count = 0;
+    if (!in.get_f64(saved_half_life) || !in.get_u64(landmark_ms)) {
+        return false;
+    }
+    // 半衰期不同则分数的含义不同
+    if (saved_half_life != half_life_seconds) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    CountMinSketch saved_sketch = sketch;
+    if (!saved_sketch.load(in) || !in.get_u64(count)) {
+        return false;
+    }
+    
+    std::unordered_map<std::string, double> saved_top;
+    for (uint64_t n = 0; n < count; ++n) {
+        std::string id;
+        double score = 0.0;
+        if (!in.get_string(id) || !in.get_f64(score)) {
+            return false;
+        }
+        saved_top.emplace(std::move(id), score);
+    }
+    
+    // 容量变小时只保留分数最高的
+    while (saved_top.size() > capacity) {
+        saved_top.erase(std::min_element(saved_top.begin(), saved_top.end(),
+            [](const auto& a, const auto& b) { return a.second < b.second; }));
+    }
+    
+    sketch = std::move(saved_sketch);
+    top = std::move(saved_top);
+    landmark = snapshot::from_wall_ms(static_cast<int64_t>(landmark_ms));
+    refresh_min();
+    rescale_if_needed(clock::now());
+    return true;
+}
+
+std::vector<TrendingEntry> TrendingIndex::top_n(size_t n) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    // 折算回当前时刻的分数
+    double factor = std::exp2(-decay_exponent(clock::now()));
+    
+    std::vector<TrendingEntry> entries;
+    entries.reserve(top.size());
+    for (const auto& [id, score] : top) {
+        entries.push_back({id, score * factor});
+    }
+    
+    n = std::min(n, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + n, entries.end(),
+        [](const TrendingEntry& a, const TrendingEntry& b) { return a.score > b.score; });
+    entries.resize(n);
+    return entries;
+}
+
+} // namespace trending
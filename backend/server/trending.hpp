@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include "snapshot.hpp"
+
+namespace trending {
+
+// Count-Min Sketch：用固定内存估计任意评论的（衰减后）热度
+class CountMinSketch {
+private:
+    size_t width;
+    size_t depth;
+    std::vector<double> cells;   // depth行 x width列
+    
+public:
+    CountMinSketch(size_t width = 4096, size_t depth = 4);
+    
+    // 累加并返回该键当前的估计值
+    double add(const std::string& key, double amount);
+    
+    // 估计值（各行最小值）
+    double estimate(const std::string& key) const;
+    
+    // 所有单元乘以同一系数（用于衰减基准点平移）
+    void scale(double factor);
+    
+    // 快照读写；宽度、深度与当前配置不一致时拒绝恢复
+    void save(snapshot::Writer& out) const;
+    bool load(snapshot::Reader& in);
+    
+private:
+    size_t cell_index(size_t row, size_t hash) const;
+};
+
+// 热门条目
+struct TrendingEntry {
+    std::string id;
+    double score = 0.0;
+};
+
+// 时间衰减的Top-K热门评论索引
+// 采用前向衰减：事件权重按 2^((t - 基准点) / 半衰期) 放大，读取时再统一折算到当前时刻，
+// 因此无需定期衰减所有计数；浏览/点赞事件更新为O(1)（淘汰候选时O(K)）
+class TrendingIndex {
+private:
+    using clock = std::chrono::steady_clock;
+    
+    size_t capacity;                                  // K
+    double half_life_seconds;
+    clock::time_point landmark;                       // 衰减基准点
+    CountMinSketch sketch;
+    std::unordered_map<std::string, double> top;      // 候选集合（衰减基准点下的分数）
+    double min_score = 0.0;                           // 候选集合最小分数的下界
+    mutable std::mutex mutex;
+    
+public:
+    // 事件权重
+    static constexpr double view_weight = 1.0;
+    static constexpr double like_weight = 3.0;
+    
+    explicit TrendingIndex(size_t capacity = 50, double half_life_seconds = 6 * 3600.0);
+    
+    // 记录一次浏览/点赞
+    void record_view(const std::string& id);
+    void record_like(const std::string& id);
+    
+    // 用历史计数初始化（启动时从数据库重建）
+    void seed(const std::string& id, int view_count, int like_count);
+    
+    // 当前最热门的n条（按分数降序）
+    std::vector<TrendingEntry> top_n(size_t n) const;
+    
+    size_t max_entries() const { return capacity; }
+    
+    // 热启动快照：草图、候选集合和衰减基准点（墙上时间），恢复成功后无需从数据库重建
+    void save(snapshot::Writer& out) const;
+    bool load(snapshot::Reader& in);
+    
+private:
+    void record(const std::string& id, double weight, clock::time_point now);
+    void rescale_if_needed(clock::time_point now);
+    double decay_exponent(clock::time_point now) const;
+    void refresh_min();
+};
+
+} // namespace trending
+
+namespace server {
+// 全局热门索引（定义于main.cpp）
+extern std::shared_ptr<trending::TrendingIndex> g_trending;
+}
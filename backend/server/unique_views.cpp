@@ -0,0 +1,391 @@
+#include "unique_views.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <tuple>
+
+namespace hll {
+
+namespace {
+
+// 64位混合函数（splitmix64），改善std::hash的低位分布
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+const char hex_digits[] = "0123456789abcdef";
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void append_hex_byte(std::string& out, uint8_t b) {
+    out += hex_digits[b >> 4];
+    out += hex_digits[b & 0x0F];
+}
+
+} // namespace
+
+void HyperLogLog::split_hash(uint64_t hash, uint32_t& index, uint8_t& rank) {
+    // 高p位选寄存器，其余位的前导零个数+1作为秩
+    index = static_cast<uint32_t>(hash >> (64 - precision));
+    uint64_t rest = (hash << precision) | (1ULL << (precision - 1));
+    rank = static_cast<uint8_t>(std::countl_zero(rest) + 1);
+}
+
+bool HyperLogLog::add(uint64_t hash) {
+    uint32_t index;
+    uint8_t rank;
+    split_hash(hash, index, rank);
+    return update_register(index, rank);
+}
+
+bool HyperLogLog::merge(const HyperLogLog& other) {
+    bool changed = false;
+    if (other.is_dense()) {
+        for (uint32_t index = 0; index < register_count; ++index) {
+            if (other.dense[index] != 0) {
+                changed |= update_register(index, other.dense[index]);
+            }
+        }
+        return changed;
+    }
+    for (uint32_t entry : other.sparse) {
+        changed |= update_register(entry >> 8, static_cast<uint8_t>(entry & 0xFF));
+    }
+    return changed;
+}
+
+bool HyperLogLog::update_register(uint32_t index, uint8_t rank) {
+    if (is_dense()) {
+        if (rank <= dense[index]) {
+            return false;
+        }
+        dense[index] = rank;
+        estimate_valid = false;
+        return true;
+    }
+    
+    auto it = std::lower_bound(sparse.begin(), sparse.end(), index << 8);
+    if (it != sparse.end() && (*it >> 8) == index) {
+        if (rank <= (*it & 0xFF)) {
+            return false;
+        }
+        *it = (index << 8) | rank;
+        estimate_valid = false;
+        return true;
+    }
+    
+    sparse.insert(it, (index << 8) | rank);
+    if (sparse.size() > sparse_limit) {
+        convert_to_dense();
+    }
+    estimate_valid = false;
+    return true;
+}
+
+void HyperLogLog::convert_to_dense() {
+    dense.assign(register_count, 0);
+    for (uint32_t entry : sparse) {
+        dense[entry >> 8] = static_cast<uint8_t>(entry & 0xFF);
+    }
+    sparse.clear();
+    sparse.shrink_to_fit();
+}
+
+uint64_t HyperLogLog::estimate() const {
+    if (!estimate_valid) {
+        cached_estimate = compute_estimate();
+        estimate_valid = true;
+    }
+    return cached_estimate;
+}
+
+uint64_t HyperLogLog::compute_estimate() const {
+    const double m = static_cast<double>(register_count);
+    const double alpha = 0.7213 / (1.0 + 1.079 / m);
+    
+    double sum = 0.0;
+    uint32_t zeros = 0;
+    
+    if (is_dense()) {
+        for (uint8_t r : dense) {
+            sum += std::ldexp(1.0, -static_cast<int>(r));
+            if (r == 0) zeros++;
+        }
+    } else {
+        zeros = register_count - static_cast<uint32_t>(sparse.size());
+        sum = zeros;
+        for (uint32_t entry : sparse) {
+            sum += std::ldexp(1.0, -static_cast<int>(entry & 0xFF));
+        }
+    }
+    
+    double raw = alpha * m * m / sum;
+    
+    // 小基数时使用线性计数
+    if (raw <= 2.5 * m && zeros > 0) {
+        return static_cast<uint64_t>(std::llround(m * std::log(m / zeros)));
+    }
+    return static_cast<uint64_t>(std::llround(raw));
+}
+
+std::string HyperLogLog::to_hex() const {
+    std::string out;
+    
+    if (is_dense()) {
+        out.reserve(2 + register_count * 2);
+        append_hex_byte(out, 1);
+        for (uint8_t r : dense) {
+            append_hex_byte(out, r);
+        }
+    } else {
+        out.reserve(2 + sparse.size() * 8);
+        append_hex_byte(out, 0);
+        for (uint32_t entry : sparse) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                append_hex_byte(out, static_cast<uint8_t>(entry >> shift));
+            }
+        }
+    }
+    return out;
+}
+
+bool HyperLogLog::from_hex(const std::string& hex) {
+    sparse.clear();
+    dense.clear();
+    estimate_valid = false;
+    
+    if (hex.size() < 2 || hex.size() % 2 != 0) {
+        return false;
+    }
+    
+    std::vector<uint8_t> bytes(hex.size() / 2);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        int hi = hex_value(hex[2 * i]);
+        int lo = hex_value(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        bytes[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    
+    if (bytes[0] == 1 && bytes.size() == 1 + register_count) {
+        dense.assign(bytes.begin() + 1, bytes.end());
+        return true;
+    }
+    
+    if (bytes[0] == 0 && (bytes.size() - 1) % 4 == 0) {
+        for (size_t i = 1; i < bytes.size(); i += 4) {
+            uint32_t entry = (uint32_t(bytes[i]) << 24) | (uint32_t(bytes[i + 1]) << 16) |
+                             (uint32_t(bytes[i + 2]) << 8) | uint32_t(bytes[i + 3]);
+            if ((entry >> 8) >= register_count) {
+                sparse.clear();
+                return false;
+            }
+            sparse.push_back(entry);
+        }
+        std::sort(sparse.begin(), sparse.end());
+        if (sparse.size() > sparse_limit) {
+            convert_to_dense();
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+uint64_t UniqueViewTracker::fingerprint(const std::string& client_ip, const std::string& user_agent) {
+    std::string key;
+    key.reserve(client_ip.size() + 1 + user_agent.size());
+    key += client_ip;
+    key += '\n';
+    key += user_agent;
+    return mix64(std::hash<std::string>{}(key));
+}
+
+UniqueViewTracker::UniqueViewTracker(size_t capacity)
+    : capacity(capacity == 0 ? 1 : capacity) {
+}
+
+UniqueViewTracker::Entry& UniqueViewTracker::touch(const std::string& post_id) {
+    auto [it, inserted] = sketches.try_emplace(post_id);
+    if (inserted) {
+        lru.push_front(post_id);
+    } else {
+        lru.splice(lru.begin(), lru, it->second.position);
+    }
+    it->second.position = lru.begin();
+    return it->second;
+}
+
+void UniqueViewTracker::evict() {
+    if (sketches.size() <= capacity) {
+        return;
+    }
+    // 刚访问的草图在头部，不会被淘汰
+    auto it = std::prev(lru.end());
+    while (sketches.size() > capacity && it != lru.begin()) {
+        auto current = it--;
+        if (!dirty.count(*current)) {
+            sketches.erase(*current);
+            lru.erase(current);
+        }
+    }
+}
+
+bool UniqueViewTracker::is_loaded(const std::string& post_id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sketches.find(post_id);
+    return it != sketches.end() && it->second.loaded;
+}
+
+void UniqueViewTracker::load(const std::string& post_id, const std::string& hex) {
+    HyperLogLog stored;
+    if (!hex.empty()) {
+        stored.from_hex(hex);
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = touch(post_id);
+    if (entry.loaded) {
+        return;
+    }
+    // 内存中已有的访客（快照恢复或载入失败期间的记录）并入库中的草图，库中缺少这些访客时需要写回
+    if (stored.merge(entry.sketch)) {
+        dirty.insert(post_id);
+    }
+    entry.sketch = std::move(stored);
+    entry.loaded = true;
+    evict();
+}
+
+uint64_t UniqueViewTracker::record(const std::string& post_id, uint64_t fingerprint) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Entry& entry = touch(post_id);
+    HyperLogLog& sketch = entry.sketch;
+    uint64_t before = entry.loaded ? sketch.estimate() : 0;
+    if (!sketch.add(fingerprint)) {
+        evict();
+        return 0;
+    }
+    dirty.insert(post_id);
+    
+    uint64_t delta = 1;
+    if (entry.loaded) {
+        uint64_t after = sketch.estimate();
+        delta = after > before ? after - before : 0;
+    }
+    evict();
+    return delta;
+}
+
+uint64_t UniqueViewTracker::unique_views(const std::string& post_id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sketches.find(post_id);
+    return it == sketches.end() ? 0 : it->second.sketch.estimate();
+}
+
+std::vector<std::pair<std::string, std::string>> UniqueViewTracker::take_dirty() {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    std::vector<std::pair<std::string, std::string>> entries;
+    entries.reserve(dirty.size());
+    for (auto it = dirty.begin(); it != dirty.end();) {
+        auto found = sketches.find(*it);
+        if (found != sketches.end() && !found->second.loaded) {
+            ++it;
+            continue;
+        }
+        if (found != sketches.end()) {
+            entries.emplace_back(*it, found->second.sketch.to_hex());
+        }
+        it = dirty.erase(it);
+    }
+    
+    // 取出的内容已在返回值中，持久化失败时由mark_dirty恢复，这里就可以淘汰
+    evict();
+    return entries;
+}
+
+void UniqueViewTracker::mark_dirty(const std::vector<std::pair<std::string, std::string>>& entries) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [post_id, hex] : entries) {
+        HyperLogLog taken;
+        if (!taken.from_hex(hex)) {
+            continue;
+        }
+        // 取出时已合并过库中的草图：被淘汰后重建的直接视为已载入，仍在内存中的合并取出后新增的访客
+        bool evicted = sketches.count(post_id) == 0;
+        Entry& entry = touch(post_id);
+        entry.sketch.merge(taken);
+        if (evicted) {
+            entry.loaded = true;
+        }
+        dirty.insert(post_id);
+    }
+    evict();
+}
+
+size_t UniqueViewTracker::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sketches.size();
+}
+
+void UniqueViewTracker::save(snapshot::Writer& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    // 按最近使用顺序写出，恢复后LRU顺序不变
+    out.put_u64(lru.size());
+    for (const auto& post_id : lru) {
+        out.put_string(post_id);
+        out.put_string(sketches.at(post_id).sketch.to_hex());
+        out.put_u32(dirty.count(post_id) ? 1 : 0);
+    }
+}
+
+bool UniqueViewTracker::load_snapshot(snapshot::Reader& in) {
+    uint64_t count = 0;
+    if (!in.get_u64(count)) {
+        return false;
+    }
+    
+    std::vector<std::tuple<std::string, HyperLogLog, bool>> restored;
+    for (uint64_t n = 0; n < count; ++n) {
+        std::string post_id;
+        std::string hex;
+        uint32_t is_dirty = 0;
+        HyperLogLog sketch;
+        if (!in.get_string(post_id) || !in.get_string(hex) || !in.get_u32(is_dirty) || !sketch.from_hex(hex)) {
+            return false;
+        }
+        restored.emplace_back(std::move(post_id), std::move(sketch), is_dirty != 0);
+    }
+    
+    // 逆序插入到头部，快照中最近使用的排在最前；已在内存中的草图保持不变
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = restored.rbegin(); it != restored.rend(); ++it) {
+        auto& [post_id, sketch, is_dirty] = *it;
+        if (sketches.count(post_id)) {
+            continue;
+        }
+        Entry& entry = touch(post_id);
+        entry.sketch = std::move(sketch);
+        if (is_dirty) {
+            dirty.insert(post_id);
+        }
+    }
+    evict();
+    return true;
+}
+
+} // namespace hll
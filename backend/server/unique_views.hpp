@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "snapshot.hpp"
+
+namespace hll {
+
+// HyperLogLog基数估计（精度p=12，4096个寄存器，标准误差约1.6%）
+// 访客少时使用稀疏表示（有序的 寄存器下标<<8 | 值），超过阈值后转为每寄存器1字节的稠密表示
+class HyperLogLog {
+public:
+    static constexpr int precision = 12;
+    static constexpr uint32_t register_count = 1u << precision;
+    static constexpr size_t sparse_limit = register_count / 8;   // 稀疏表示最多512项（2KB）
+    
+private:
+    std::vector<uint32_t> sparse;     // 稀疏表示，按寄存器下标排序
+    std::vector<uint8_t> dense;       // 稠密表示，非空时表示已转换
+    mutable uint64_t cached_estimate = 0;
+    mutable bool estimate_valid = true;
+    
+public:
+    // 加入一个64位哈希值，返回寄存器是否发生变化（即估计值可能变化）
+    bool add(uint64_t hash);
+    
+    // 按寄存器取最大值合并另一个草图（结果等价于两者访客的并集），返回寄存器是否发生变化
+    bool merge(const HyperLogLog& other);
+    
+    // 估计基数（寄存器不变时直接返回缓存值）
+    uint64_t estimate() const;
+    
+    // 序列化为十六进制字符串（首字节为格式：0稀疏/1稠密）
+    std::string to_hex() const;
+    
+    // 从十六进制字符串恢复，格式错误时返回false并保持为空
+    bool from_hex(const std::string& hex);
+    
+    bool is_dense() const { return !dense.empty(); }
+    
+private:
+    static void split_hash(uint64_t hash, uint32_t& index, uint8_t& rank);
+    bool update_register(uint32_t index, uint8_t rank);
+    uint64_t compute_estimate() const;
+    void convert_to_dense();
+};
+
+// 每条评论的独立访客计数
+// 只有HLL估计值变化时才需要写数据库的浏览数，重复访问直接在内存中过滤
+// 内存中最多保留capacity个草图（LRU），超出时淘汰最久未访问且已持久化的草图，下次访问再从数据库载入；
+// 未持久化的草图要等定时持久化之后才能淘汰
+class UniqueViewTracker {
+private:
+    struct Entry {
+        HyperLogLog sketch;
+        bool loaded = false;    // 是否已合并数据库中的草图；未合并前不能持久化，否则会覆盖库中的访客
+        std::list<std::string>::iterator position;
+    };
+    
+    size_t capacity;
+    std::list<std::string> lru;                // 头部为最近使用
+    std::unordered_map<std::string, Entry> sketches;
+    std::unordered_set<std::string> dirty;     // 尚未持久化的评论
+    mutable std::mutex mutex;
+    
+public:
+    explicit UniqueViewTracker(size_t capacity = 20000);
+    
+
+    // 访客指纹（IP + User-Agent）
+    static uint64_t fingerprint(const std::string& client_ip, const std::string& user_agent);
+    
+    // 是否已合并数据库中的草图
+    bool is_loaded(const std::string& post_id) const;
+    
+    // 合并从数据库读出的草图并标记为已载入（hex为空或格式错误时按库中没有草图处理）
+    void load(const std::string& post_id, const std::string& hex);
+    
+    // 记录一次访问，返回独立访客估计值的增量（重复访客为0）
+    // 未载入时估计值不含库中的访客，按寄存器是否变化返回1或0，访客留待载入时合并
+    uint64_t record(const std::string& post_id, uint64_t fingerprint);
+    
+    // 独立访客估计值（不存在时为0，未载入时只含内存中的访客）
+    uint64_t unique_views(const std::string& post_id) const;
+    
+    // 取出所有待持久化的草图（post_id, hex），并清空脏标记；尚未载入的草图留到载入之后
+    std::vector<std::pair<std::string, std::string>> take_dirty();
+    
+    // 持久化失败时重新标记；期间已被淘汰的草图按取出时的内容恢复
+    void mark_dirty(const std::vector<std::pair<std::string, std::string>>& entries);
+    
+    size_t size() const;
+    
+    // 热启动快照：内存中的全部草图及其脏标记，恢复后未持久化的访客不会丢失
+    // 快照期间其他实例可能更新了库中的草图，恢复的草图按未载入处理，首次访问时再与库中的合并
+    void save(snapshot::Writer& out) const;
+    bool load_snapshot(snapshot::Reader& in);
+
+private:
+    // 取出（不存在时创建）草图并移到LRU头部，调用方须持有锁
+    Entry& touch(const std::string& post_id);
+    
+    // 超出容量时从LRU尾部淘汰已持久化的草图，调用方须持有锁
+    void evict();
+};
+
+} // namespace hll
+
+namespace server {
+// 全局独立访客统计（定义于main.cpp）
+extern std::shared_ptr<hll::UniqueViewTracker> g_unique_views;
+}
@@ -3,10 +3,14 @@
 #include <iomanip>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <charconv>
 #include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <openssl/evp.h>
 
 namespace utils {
 
@@ -19,10 +23,10 @@ const std::vector<std::string> IdGenerator::words = {
     "piano", "quiet", "rapid", "sweet", "trust", "upper", "vital", "world"
 };
 
-IdGenerator::IdGenerator() 
+IdGenerator::IdGenerator(int max_number)
     : generator(std::chrono::steady_clock::now().time_since_epoch().count()),
       word_dist(0, words.size() - 1),
-      num_dist(1, 999) {
+      num_dist(1, max_number) {
 }
 
 std::string IdGenerator::generate() {
@@ -60,39 +64,210 @@ bool FileHandler::validate_image_format(const std::string& filename) {
     return false;
 }
 
-std::string FileHandler::save_uploaded_file(const std::string& content, const std::string& filename) {
+bool FileHandler::sniff_image_type(const std::string& content, std::string& mime_type, std::string& extension) {
+    auto starts_with = [&content](const char* magic, size_t len, size_t offset = 0) {
+        return content.size() >= offset + len && content.compare(offset, len, magic, len) == 0;
+    };
+    
+    // 只认文件头，不信任客户端提供的扩展名和Content-Type
+    if (starts_with("\xFF\xD8\xFF", 3)) {
+        mime_type = "image/jpeg";
+        extension = ".jpg";
+    } else if (starts_with("\x89PNG\r\n\x1A\n", 8)) {
+        mime_type = "image/png";
+        extension = ".png";
+    } else if (starts_with("GIF87a", 6) || starts_with("GIF89a", 6)) {
+        mime_type = "image/gif";
+        extension = ".gif";
+    } else if (starts_with("RIFF", 4) && starts_with("WEBP", 4, 8)) {
+        mime_type = "image/webp";
+        extension = ".webp";
+    } else if (starts_with("BM", 2)) {
+        mime_type = "image/bmp";
+        extension = ".bmp";
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::optional<StoredFile> FileHandler::prepare_upload(const std::string& content, const std::string& filename) {
+    StoredFile stored;
+    stored.filename = filename;
+    stored.size = content.size();
+    
+    std::string extension;
+    if (!sniff_image_type(content, stored.mime_type, extension)) {
+        return std::nullopt;
+    }
+    
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(content.data(), content.size(), digest, &digest_len, EVP_sha256(), nullptr) != 1) {
+        std::cerr << "计算SHA-256失败" << std::endl;
+        return std::nullopt;
+    }
+    
+    std::ostringstream hex;
+    hex << std::hex << std::setfill('0');
+    for (unsigned int i = 0; i < digest_len; ++i) {
+        hex << std::setw(2) << static_cast<int>(digest[i]);
+    }
+    std::string hash = hex.str();
+    
+    // 两级256路分片目录，避免单目录文件过多
+    stored.path = "uploads/" + hash.substr(0, 2) + "/" + hash.substr(2, 2) + "/" + hash + extension;
+    return stored;
+}
+
+bool FileHandler::write_upload(const std::string& content, StoredFile& stored) {
+    static std::atomic<uint64_t> temp_counter{0};
+    
+    std::string temp_path;
     try {
-        // 确保uploads目录存在
-        if (!ensure_directory("uploads")) {
-            return "";
+        if (!ensure_directory(std::filesystem::path(stored.path).parent_path().string())) {
+            return false;
         }
         
-        // 生成唯一的文件名
-        auto now = std::chrono::system_clock::now();
-        auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
-        
-        std::string file_extension = "";
-        size_t dot_pos = filename.find_last_of('.');
-        if (dot_pos != std::string::npos) {
-            file_extension = filename.substr(dot_pos);
+        // 相同内容已存在时直接复用，多条post_images记录引用同一个文件；
+        // 刷新修改时间，入库前不会被当作无人引用的文件清理掉
+        if (std::filesystem::exists(stored.path)) {
+            std::error_code ec;
+            std::filesystem::last_write_time(stored.path, std::filesystem::file_time_type::clock::now(), ec);
+            stored.deduplicated = true;
+            return true;
         }
         
-        std::string new_filename = "img_" + std::to_string(timestamp) + file_extension;
-        std::string filepath = "uploads/" + new_filename;
-        
-        // 写入文件
-        std::ofstream file(filepath, std::ios::binary);
+        // 先写同目录临时文件再改名，读者不会看到写了一半的文件
+        temp_path = stored.path + "." + std::to_string(temp_counter++) + ".part";
+        std::ofstream file(temp_path, std::ios::binary);
         if (!file.is_open()) {
-            return "";
+            return false;
         }
-        
-        file.write(content.c_str(), content.size());
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
         file.close();
+        if (!file) {
+            std::filesystem::remove(temp_path);
+            return false;
+        }
         
-        return filepath;
-    } catch (const std::exception&) {
-        return "";
+        std::filesystem::rename(temp_path, stored.path);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "保存上传文件失败: " << e.what() << std::endl;
+        if (!temp_path.empty()) {
+            std::error_code ec;
+            std::filesystem::remove(temp_path, ec);
+        }
+        return false;
+    }
+}
+
+size_t FileHandler::sweep_orphan_uploads(const std::string& root, std::chrono::seconds grace,
+    const std::function<bool(const std::vector<std::string>&, std::unordered_set<std::string>&)>& referenced) {
+    namespace fs = std::filesystem;
+    constexpr size_t query_batch = 500;
+    
+    const auto cutoff = fs::file_time_type::clock::now() - grace;
+    auto is_stale = [&](const fs::path& path) {
+        std::error_code ec;
+        auto mtime = fs::last_write_time(path, ec);
+        return !ec && mtime < cutoff;
+    };
+    auto is_hash = [](const std::string& name) {
+        return name.size() == 64 && std::all_of(name.begin(), name.end(), [](char c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+        });
+    };
+    
+    size_t removed = 0;
+    auto remove_file = [&](const fs::path& path) {
+        std::error_code ec;
+        if (fs::remove(path, ec)) {
+            removed++;
+        }
+    };
+    
+    // 原图 -> 同目录下的缩略图/中图（<sha256>_thumb.*、<sha256>_medium.*）
+    std::vector<std::string> candidates;
+    std::unordered_map<std::string, std::vector<fs::path>> variants;
+    auto flush = [&]() {
+        std::unordered_set<std::string> in_use;
+        if (!referenced(candidates, in_use)) {
+            return false;
+        }
+        // 删除前再看一次修改时间，查询期间被去重复用的文件会跳过
+        for (const auto& path : candidates) {
+            if (in_use.count(path) || !is_stale(path)) {
+                continue;
+            }
+            for (const auto& variant : variants[path]) {
+                remove_file(variant);
+            }
+            remove_file(path);
+        }
+        candidates.clear();
+        variants.clear();
+        return true;
+    };
+    
+    try {
+        std::error_code ec;
+        // 只进入两级两位十六进制的分片目录（uploads/ab/cd）
+        for (const auto& level1 : fs::directory_iterator(root, ec)) {
+            if (!level1.is_directory() || level1.path().filename().string().size() != 2) {
+                continue;
+            }
+            for (const auto& level2 : fs::directory_iterator(level1.path(), ec)) {
+                if (!level2.is_directory() || level2.path().filename().string().size() != 2) {
+                    continue;
+                }
+                
+                // 先列完整个分片目录再删除，不在遍历过程中修改目录
+                std::vector<fs::path> files;
+                for (const auto& entry : fs::directory_iterator(level2.path(), ec)) {
+                    if (entry.is_regular_file()) {
+                        files.push_back(entry.path());
+                    }
+                }
+                
+                std::unordered_map<std::string, std::vector<fs::path>> local_variants;
+                for (const auto& file : files) {
+                    std::string name = file.filename().string();
+                    if (name.find(".part") != std::string::npos) {
+                        // 崩溃遗留的临时文件
+                        if (is_stale(file)) {
+                            remove_file(file);
+                        }
+                    } else if (name.size() > 64 && name[64] == '_' && is_hash(name.substr(0, 64))) {
+                        local_variants[name.substr(0, 64)].push_back(file);
+                    }
+                }
+                for (const auto& file : files) {
+                    std::string stem = file.stem().string();
+                    if (!is_hash(stem) || !is_stale(file)) {
+                        continue;
+                    }
+                    std::string path = file.generic_string();
+                    auto it = local_variants.find(stem);
+                    if (it != local_variants.end()) {
+                        variants[path] = std::move(it->second);
+                    }
+                    candidates.push_back(std::move(path));
+                }
+                
+                if (candidates.size() >= query_batch && !flush()) {
+                    return removed;
+                }
+            }
+        }
+        if (!candidates.empty()) {
+            flush();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "清理上传文件失败: " << e.what() << std::endl;
     }
+    return removed;
 }
 
 bool FileHandler::ensure_directory(const std::string& path) {
@@ -151,6 +326,30 @@ std::string StringUtils::url_decode(const std::string& value) {
     return result;
 }
 
+std::unordered_map<std::string, std::string> StringUtils::parse_query_string(const std::string& query) {
+    std::unordered_map<std::string, std::string> params;
+    size_t pos = 0;
+    
+    while (pos <= query.length()) {
+        size_t amp = query.find('&', pos);
+        if (amp == std::string::npos) amp = query.length();
+        
+        std::string pair = query.substr(pos, amp - pos);
+        if (!pair.empty()) {
+            size_t eq = pair.find('=');
+            if (eq == std::string::npos) {
+                params[url_decode(pair)] = "";
+            } else {
+                params[url_decode(pair.substr(0, eq))] = url_decode(pair.substr(eq + 1));
+            }
+        }
+        
+        pos = amp + 1;
+    }
+    
+    return params;
+}
+
 std::string StringUtils::trim(const std::string& str) {
     size_t start = str.find_first_not_of(" \t\r\n");
     if (start == std::string::npos) {
@@ -160,6 +359,73 @@ std::string StringUtils::trim(const std::string& str) {
     return str.substr(start, end - start + 1);
 }
 
+std::optional<int64_t> StringUtils::parse_int(std::string_view str, int64_t min, int64_t max) {
+    int64_t value = 0;
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec != std::errc() || end != str.data() + str.size() || value < min || value > max) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+size_t StringUtils::utf8_length(const std::string& str) {
+    size_t count = 0;
+    for (unsigned char c : str) {
+        // 只统计非续字节（10xxxxxx）
+        if ((c & 0xC0) != 0x80) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool StringUtils::is_valid_text(const std::string& str) {
+    size_t i = 0;
+    while (i < str.size()) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c == 0) {
+            return false;
+        }
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        
+        // 首字节决定长度和第二字节的范围，排除超长编码、代理区和超出U+10FFFF的码点
+        size_t length;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            length = 2;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            length = 3;
+            if (c == 0xE0) low = 0xA0;
+            if (c == 0xED) high = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            length = 4;
+            if (c == 0xF0) low = 0x90;
+            if (c == 0xF4) high = 0x8F;
+        } else {
+            return false;
+        }
+        if (str.size() - i < length) {
+            return false;
+        }
+        
+        unsigned char second = static_cast<unsigned char>(str[i + 1]);
+        if (second < low || second > high) {
+            return false;
+        }
+        for (size_t k = 2; k < length; ++k) {
+            if ((static_cast<unsigned char>(str[i + k]) & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
 bool StringUtils::validate_content_length(const std::string& content, size_t min_length) {
     std::string trimmed = trim(content);
     return trimmed.length() >= min_length;
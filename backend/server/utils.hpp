@@ -1,8 +1,15 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <vector>
 #include <random>
+#include <unordered_map>
+#include <unordered_set>
 #include <boost/filesystem.hpp>
 
 namespace utils {
@@ -16,10 +23,25 @@ private:
     std::uniform_int_distribution<> num_dist;
 
 public:
-    IdGenerator();
+    explicit IdGenerator(int max_number = 999);
     std::string generate();
 };
 
+// 按内容寻址保存后的上传文件
+struct StoredFile {
+    std::string path;           // uploads/ab/cd/<sha256>.<ext>
+    std::string filename;       // 客户端提供的原始文件名
+    std::string mime_type;      // 按文件头识别的类型
+    size_t size = 0;
+    bool deduplicated = false;  // 相同内容已存在，没有重复写盘
+};
+
+// multipart中的一个上传文件（尚未写盘）
+struct UploadPart {
+    std::string filename;
+    std::string content;
+};
+
 // 文件处理工具
 class FileHandler {
 public:
@@ -29,8 +51,19 @@ public:
     // 验证文件格式（只允许常见图片格式）
     static bool validate_image_format(const std::string& filename);
     
-    // 保存上传的文件
-    static std::string save_uploaded_file(const std::string& content, const std::string& filename);
+    // 按文件头识别图片类型，返回MIME类型和规范扩展名
+    static bool sniff_image_type(const std::string& content, std::string& mime_type, std::string& extension);
+    
+    // 按文件头识别类型并计算SHA-256，得到内容寻址的保存路径（纯计算，不写盘）
+    static std::optional<StoredFile> prepare_upload(const std::string& content, const std::string& filename);
+    
+    // 同步写入prepare_upload得到的路径，相同内容只保存一份（没有异步文件I/O时使用）
+    static bool write_upload(const std::string& content, StoredFile& stored);
+    
+    // 清理root下没有评论引用的上传文件（连同缩略图/中图）和遗留的临时文件，返回删除的文件数
+    // 只处理修改时间早于grace的文件，去重复用时会刷新修改时间；referenced找出给定路径中仍被引用的，返回false时中止
+    static size_t sweep_orphan_uploads(const std::string& root, std::chrono::seconds grace,
+        const std::function<bool(const std::vector<std::string>&, std::unordered_set<std::string>&)>& referenced);
     
     // 创建目录（如果不存在）
     static bool ensure_directory(const std::string& path);
@@ -43,9 +76,21 @@ public:
     static std::string url_encode(const std::string& value);
     static std::string url_decode(const std::string& value);
     
+    // 解析URL查询字符串（a=1&b=2），键和值都会做URL解码
+    static std::unordered_map<std::string, std::string> parse_query_string(const std::string& query);
+    
     // 去除首尾空白
     static std::string trim(const std::string& str);
     
+    // 解析十进制整数（整个字符串都须是数字，不接受空白和多余字符），格式错误或超出[min, max]时返回空
+    static std::optional<int64_t> parse_int(std::string_view str, int64_t min, int64_t max);
+    
+    // UTF-8字符数（与PostgreSQL的LENGTH()一致）
+    static size_t utf8_length(const std::string& str);
+    
+    // 是否为合法UTF-8且不含NUL（PostgreSQL的text拒绝这两类数据，须在确认提交之前检查）
+    static bool is_valid_text(const std::string& str);
+    
     // 验证文本长度（至少50字）
     static bool validate_content_length(const std::string& content, size_t min_length = 50);
 };
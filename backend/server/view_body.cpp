@@ -0,0 +1,100 @@
+#include "view_body.hpp"
+#include "utils.hpp"
+#include <charconv>
+
+namespace cache {
+
+namespace {
+
+constexpr std::string_view like_slot = ",\"like_count\":";
+constexpr std::string_view unique_views_slot = ",\"unique_views\":";
+
+template<class T>
+uint8_t format_counter(std::array<char, 24>& out, T value) {
+    auto result = std::to_chars(out.data(), out.data() + out.size(), value);
+    return static_cast<uint8_t>(result.ptr - out.data());
+}
+
+} // namespace
+
+void append_post_head(std::string& out, const db::Post& post) {
+    out += "{\"id\":\"";
+    out += utils::JsonUtils::escape_json_string(post.id);
+    out += "\",\"content\":\"";
+    out += utils::JsonUtils::escape_json_string(post.content);
+    out += "\",\"created_at\":\"";
+    out += utils::JsonUtils::escape_json_string(post.created_at);
+    out += "\",\"view_count\":";
+}
+
+void append_post_tail(std::string& out, const db::Post& post) {
+    out += ",\"images\":[";
+    
+    for (size_t i = 0; i < post.image_paths.size(); ++i) {
+        if (i > 0) out += ",";
+        out += "\"" + utils::JsonUtils::escape_json_string(post.image_paths[i]) + "\"";
+    }
+    out += "]";
+    
+    // 与images一一对应；变体尚未生成时对应字段为null，前端退回原图
+    if (!post.image_variants.empty()) {
+        out += ",\"image_variants\":[";
+        for (size_t i = 0; i < post.image_variants.size(); ++i) {
+            const auto& variants = post.image_variants[i];
+            if (i > 0) out += ",";
+            out += "{\"thumbnail\":";
+            out += variants.thumbnail.empty() ? "null" : "\"" + utils::JsonUtils::escape_json_string(variants.thumbnail) + "\"";
+            out += ",\"medium\":";
+            out += variants.medium.empty() ? "null" : "\"" + utils::JsonUtils::escape_json_string(variants.medium) + "\"";
+            out += "}";
+        }
+        out += "]";
+    }
+    out += "}";
+}
+
+std::shared_ptr<const ViewTemplate> ViewTemplate::build(const db::Post& post) {
+    // 与 create_success_response(append_post_json(post)) 逐字节相同
+    auto view = std::make_shared<ViewTemplate>();
+    view->head = "{\"status\":\"success\",\"data\":";
+    append_post_head(view->head, post);
+    append_post_tail(view->tail, post);
+    view->tail += "}";
+    return view;
+}
+
+ViewBody::value_type::value_type(std::shared_ptr<const ViewTemplate> view, const db::PostCounters& counters,
+                                 std::optional<uint64_t> unique_views)
+    : view(std::move(view)), has_unique_views(unique_views.has_value()) {
+    lengths[0] = format_counter(digits[0], counters.view_count);
+    lengths[1] = format_counter(digits[1], counters.like_count);
+    if (unique_views) {
+        lengths[2] = format_counter(digits[2], *unique_views);
+    }
+}
+
+std::uint64_t ViewBody::size(const value_type& body) {
+    std::uint64_t total = body.view->head.size() + body.lengths[0] + like_slot.size() + body.lengths[1] +
+                          body.view->tail.size();
+    if (body.has_unique_views) {
+        total += unique_views_slot.size() + body.lengths[2];
+    }
+    return total;
+}
+
+boost::optional<std::pair<ViewBody::writer::const_buffers_type, bool>>
+ViewBody::writer::get(boost::beast::error_code& ec) {
+    ec = {};
+    const_buffers_type buffers{
+        boost::asio::buffer(body.view->head),
+        boost::asio::buffer(body.digits[0].data(), body.lengths[0]),
+        boost::asio::buffer(like_slot.data(), like_slot.size()),
+        boost::asio::buffer(body.digits[1].data(), body.lengths[1]),
+        boost::asio::buffer(unique_views_slot.data(), body.has_unique_views ? unique_views_slot.size() : 0),
+        boost::asio::buffer(body.digits[2].data(), body.lengths[2]),
+        boost::asio::buffer(body.view->tail)
+    };
+    return std::make_pair(buffers, false);
+}
+
+} // namespace cache
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include "db.hpp"
+
+namespace cache {
+
+// 评论JSON中不变的部分：计数器之前（id、内容、时间）和之后（图片、图片变体）
+// append_post_head以"view_count":结尾，后面依次是浏览数、点赞数、可选的独立访客数，再接append_post_tail
+void append_post_head(std::string& out, const db::Post& post);
+void append_post_tail(std::string& out, const db::Post& post);
+
+// /api/view 成功响应的预序列化模板：已转义的不变片段，计数器位置留空
+// 由PostCache按评论缓存，评论变化（缩略图生成）时随缓存项一起丢弃
+struct ViewTemplate {
+    std::string head;   // {"status":"success","data":{..."view_count":
+    std::string tail;   // ,"images":[...]...}}
+    
+    static std::shared_ptr<const ViewTemplate> build(const db::Post& post);
+};
+
+// 由模板片段和现场格式化的计数器拼成的响应体，写出时作为一组缓冲区一次writev，不再拼接字符串
+struct ViewBody {
+    struct value_type {
+        std::shared_ptr<const ViewTemplate> view;
+        std::array<std::array<char, 24>, 3> digits{};   // 浏览数、点赞数、独立访客数
+        std::array<uint8_t, 3> lengths{};
+        bool has_unique_views = false;
+        
+        value_type() = default;
+        value_type(std::shared_ptr<const ViewTemplate> view, const db::PostCounters& counters,
+                   std::optional<uint64_t> unique_views);
+    };
+    
+    static std::uint64_t size(const value_type& body);
+    
+    class writer {
+    public:
+        // head, 浏览数, 分隔, 点赞数, 分隔, 独立访客数, tail；没有独立访客数时对应两段为空
+        using const_buffers_type = std::array<boost::asio::const_buffer, 7>;
+    
+    private:
+        const value_type& body;
+    
+    public:
+        template<bool isRequest, class Fields>
+        writer(const boost::beast::http::header<isRequest, Fields>&, const value_type& body) : body(body) {}
+        
+        void init(boost::beast::error_code& ec) { ec = {}; }
+        
+        boost::optional<std::pair<const_buffers_type, bool>> get(boost::beast::error_code& ec);
+    };
+};
+
+} // namespace cache
@@ -5,7 +5,7 @@
 CREATE TABLE IF NOT EXISTS posts (
     id VARCHAR(16) PRIMARY KEY,
     content TEXT NOT NULL,
-    created_at TIMESTAMP DEFAULT NOW(),
+    created_at TIMESTAMP DEFAULT (NOW() AT TIME ZONE 'UTC'),
     view_count INTEGER DEFAULT 0,
     like_count INTEGER DEFAULT 0
 );
@@ -14,12 +14,28 @@ CREATE TABLE IF NOT EXISTS posts (
 CREATE TABLE IF NOT EXISTS post_images (
     id SERIAL PRIMARY KEY,
     post_id VARCHAR(16) REFERENCES posts(id) ON DELETE CASCADE,
-    path TEXT NOT NULL
+    path TEXT NOT NULL,
+    filename TEXT,
+    file_size INTEGER,
+    mime_type VARCHAR(100),
+    thumbnail_path TEXT,
+    medium_path TEXT
+);
+
+-- 创建独立访客草图表（HyperLogLog寄存器）
+CREATE TABLE IF NOT EXISTS post_viewer_sketches (
+    post_id VARCHAR(16) PRIMARY KEY REFERENCES posts(id) ON DELETE CASCADE,
+    registers BYTEA NOT NULL,
+    updated_at TIMESTAMP DEFAULT NOW()
 );
 
 -- 创建基本索引
 CREATE INDEX IF NOT EXISTS idx_posts_created_at ON posts(created_at);
+CREATE INDEX IF NOT EXISTS idx_posts_created_at_id ON posts(created_at DESC, id DESC);
+CREATE INDEX IF NOT EXISTS idx_posts_view_count ON posts(view_count DESC NULLS LAST);
+CREATE INDEX IF NOT EXISTS idx_posts_like_count ON posts(like_count DESC NULLS LAST);
 CREATE INDEX IF NOT EXISTS idx_post_images_post_id ON post_images(post_id);
+CREATE INDEX IF NOT EXISTS idx_post_images_path ON post_images(path);
 
 -- 插入测试数据
 INSERT INTO posts (id, content, view_count, like_count) VALUES 
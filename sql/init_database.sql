@@ -15,7 +15,7 @@
 CREATE TABLE IF NOT EXISTS posts (
     id VARCHAR(16) PRIMARY KEY,                    -- 评论ID（如 word42）
     content TEXT NOT NULL,                         -- 评论内容
-    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP, -- 创建时间
+    created_at TIMESTAMP DEFAULT (NOW() AT TIME ZONE 'UTC'), -- 创建时间（UTC）
     view_count INTEGER DEFAULT 0,                 -- 浏览次数
     like_count INTEGER DEFAULT 0,                 -- 点赞次数
     ip_address INET,                               -- 发布者IP（可选，用于防护）
@@ -30,21 +30,33 @@ CREATE TABLE IF NOT EXISTS post_images (
     filename TEXT,                                 -- 原始文件名
     file_size INTEGER,                             -- 文件大小（字节）
     mime_type VARCHAR(100),                        -- MIME类型
+    thumbnail_path TEXT,                           -- 缩略图路径（后台生成）
+    medium_path TEXT,                              -- 中图路径（后台生成）
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP, -- 上传时间
     FOREIGN KEY (post_id) REFERENCES posts(id) ON DELETE CASCADE
 );
 
+-- 创建独立访客草图表
+CREATE TABLE IF NOT EXISTS post_viewer_sketches (
+    post_id VARCHAR(16) PRIMARY KEY,               -- 关联评论ID
+    registers BYTEA NOT NULL,                      -- HyperLogLog寄存器（稀疏/稠密编码）
+    updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP, -- 最后持久化时间
+    FOREIGN KEY (post_id) REFERENCES posts(id) ON DELETE CASCADE
+);
+
 -- ================================================================
 -- 3. 创建索引（提高查询性能）
 -- ================================================================
 
 -- 评论表索引
 CREATE INDEX IF NOT EXISTS idx_posts_created_at ON posts(created_at DESC);
-CREATE INDEX IF NOT EXISTS idx_posts_view_count ON posts(view_count DESC);
-CREATE INDEX IF NOT EXISTS idx_posts_like_count ON posts(like_count DESC);
+CREATE INDEX IF NOT EXISTS idx_posts_created_at_id ON posts(created_at DESC, id DESC);  -- 列表keyset分页
+CREATE INDEX IF NOT EXISTS idx_posts_view_count ON posts(view_count DESC NULLS LAST);
+CREATE INDEX IF NOT EXISTS idx_posts_like_count ON posts(like_count DESC NULLS LAST);
 
 -- 图片表索引
 CREATE INDEX IF NOT EXISTS idx_post_images_post_id ON post_images(post_id);
+CREATE INDEX IF NOT EXISTS idx_post_images_path ON post_images(path);            -- 内容寻址文件的引用查询（清理无人引用的文件）
 CREATE INDEX IF NOT EXISTS idx_post_images_created_at ON post_images(created_at DESC);
 
 -- ================================================================
@@ -106,15 +118,15 @@ RETURNS TABLE(
     avg_content_length NUMERIC
 ) AS $$
 BEGIN
+    -- posts与post_images分别聚合，避免LEFT JOIN按图片数放大浏览/点赞总数
     RETURN QUERY
     SELECT 
         COUNT(p.id) as total_posts,
-        COUNT(pi.id) as total_images,
+        (SELECT COUNT(*) FROM post_images) as total_images,
         SUM(COALESCE(p.view_count, 0)) as total_views,
         SUM(COALESCE(p.like_count, 0)) as total_likes,
         AVG(LENGTH(p.content)) as avg_content_length
-    FROM posts p
-    LEFT JOIN post_images pi ON p.id = pi.post_id;
+    FROM posts p;
 END;
 $$ LANGUAGE plpgsql;
 
@@ -158,6 +170,7 @@ BEGIN
     RAISE NOTICE '已创建的表：';
     RAISE NOTICE '  - posts: 评论主表';
     RAISE NOTICE '  - post_images: 评论图片表';
+    RAISE NOTICE '  - post_viewer_sketches: 独立访客草图表';
     RAISE NOTICE '已创建的索引：';
     RAISE NOTICE '  - 时间索引、计数索引等';
     RAISE NOTICE '已创建的视图：';